@@ -35,7 +35,18 @@ SOURCES += \
     kfrustum.cpp \
     kimage.cpp \
     kabstracthdrparser.cpp \
-    kbufferedbinaryfilereader.cpp
+    kbufferedbinaryfilereader.cpp \
+    kmeshoptimizer.cpp \
+    kmeshlet.cpp \
+    kflattree.cpp \
+    klooseoctree.cpp \
+    kkdtree.cpp \
+    kocclusionbuffer.cpp \
+    kparallel.cpp \
+    ksweepandprune.cpp \
+    khashgrid.cpp \
+    kaabbarray.cpp \
+    ktransformarray.cpp
 
 HEADERS += \
     kcolor.h \
@@ -106,4 +117,17 @@ HEADERS += \
     kvector4d.h \
     kimage.h \
     kabstracthdrparser.h \
-    kbufferedbinaryfilereader.h
+    kbufferedbinaryfilereader.h \
+    kparallel.h \
+    kradixsort.h \
+    kmeshoptimizer.h \
+    kmeshlet.h \
+    kflattree.h \
+    kmorton.h \
+    klooseoctree.h \
+    kkdtree.h \
+    kocclusionbuffer.h \
+    ksweepandprune.h \
+    khashgrid.h \
+    kaabbarray.h \
+    ktransformarray.h
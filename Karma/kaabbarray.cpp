@@ -0,0 +1,227 @@
+#include "kaabbarray.h"
+
+#include <algorithm>
+#include <limits>
+#include <KMatrix4x4>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*******************************************************************************
+ * KAabbArray Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Affine transform of the box along one output axis (Arvo's method): every term takes
+  // whichever of the two extents makes it smaller (or larger), so no corners are formed.
+  struct KAabbAffineRow
+  {
+    float m[3];
+    float t;
+  };
+
+  inline void transformScalar(KAabbAffineRow const rows[3], float const min[3], float const max[3], float outMin[3], float outMax[3])
+  {
+    for (int r = 0; r < 3; ++r)
+    {
+      float lo = rows[r].t, hi = rows[r].t;
+      for (int c = 0; c < 3; ++c)
+      {
+        float a = rows[r].m[c] * min[c];
+        float b = rows[r].m[c] * max[c];
+        lo += std::min(a, b);
+        hi += std::max(a, b);
+      }
+      outMin[r] = lo;
+      outMax[r] = hi;
+    }
+  }
+
+}
+
+/*******************************************************************************
+ * KAabbArray
+ ******************************************************************************/
+KAabbArray::KAabbArray()
+{
+  // Intentionally Empty
+}
+
+KAabbArray::KAabbArray(size_t count)
+{
+  resize(count);
+}
+
+void KAabbArray::clear()
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_min[axis].clear();
+    m_max[axis].clear();
+  }
+}
+
+void KAabbArray::reserve(size_t count)
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_min[axis].reserve(count);
+    m_max[axis].reserve(count);
+  }
+}
+
+void KAabbArray::resize(size_t count)
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_min[axis].resize(count, 0.0f);
+    m_max[axis].resize(count, 0.0f);
+  }
+}
+
+void KAabbArray::push_back(KAabbBoundingVolume const &aabb)
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_min[axis].push_back(aabb.minExtent()[axis]);
+    m_max[axis].push_back(aabb.maxExtent()[axis]);
+  }
+}
+
+KAabbBoundingVolume KAabbArray::operator[](size_t index) const
+{
+  return KAabbBoundingVolume(minExtent(index), maxExtent(index));
+}
+
+KAabbBoundingVolume KAabbArray::bounds() const
+{
+  return bounds(0, size());
+}
+
+KAabbBoundingVolume KAabbArray::bounds(size_t begin, size_t end) const
+{
+  if (begin >= end) return KAabbBoundingVolume();
+  float lo[3], hi[3];
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    float const *min = m_min[axis].data();
+    float const *max = m_max[axis].data();
+    size_t i = begin;
+    lo[axis] = std::numeric_limits<float>::max();
+    hi[axis] = -std::numeric_limits<float>::max();
+#ifdef __SSE2__
+    if (end - begin >= 4)
+    {
+      __m128 vlo = _mm_set1_ps(lo[axis]), vhi = _mm_set1_ps(hi[axis]);
+      for (; i + 4 <= end; i += 4)
+      {
+        vlo = _mm_min_ps(vlo, _mm_loadu_ps(min + i));
+        vhi = _mm_max_ps(vhi, _mm_loadu_ps(max + i));
+      }
+      float lanes[4];
+      _mm_storeu_ps(lanes, vlo);
+      lo[axis] = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+      _mm_storeu_ps(lanes, vhi);
+      hi[axis] = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    }
+#endif
+    for (; i < end; ++i)
+    {
+      lo[axis] = std::min(lo[axis], min[i]);
+      hi[axis] = std::max(hi[axis], max[i]);
+    }
+  }
+  return KAabbBoundingVolume(KVector3D(lo[0], lo[1], lo[2]), KVector3D(hi[0], hi[1], hi[2]));
+}
+
+void KAabbArray::transform(KMatrix4x4 const &mtx, KAabbArray &result) const
+{
+  KAabbAffineRow rows[3];
+  for (int r = 0; r < 3; ++r)
+  {
+    for (int c = 0; c < 3; ++c) rows[r].m[c] = mtx(r, c);
+    rows[r].t = mtx(r, 3);
+  }
+
+  // Every box is read completely before it's written, so `result` may be this array
+  size_t count = size();
+  result.resize(count);
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 min[3], max[3];
+    for (int c = 0; c < 3; ++c)
+    {
+      min[c] = _mm_loadu_ps(m_min[c].data() + i);
+      max[c] = _mm_loadu_ps(m_max[c].data() + i);
+    }
+    for (int r = 0; r < 3; ++r)
+    {
+      __m128 lo = _mm_set1_ps(rows[r].t), hi = lo;
+      for (int c = 0; c < 3; ++c)
+      {
+        __m128 m = _mm_set1_ps(rows[r].m[c]);
+        __m128 a = _mm_mul_ps(m, min[c]);
+        __m128 b = _mm_mul_ps(m, max[c]);
+        lo = _mm_add_ps(lo, _mm_min_ps(a, b));
+        hi = _mm_add_ps(hi, _mm_max_ps(a, b));
+      }
+      _mm_storeu_ps(result.m_min[r].data() + i, lo);
+      _mm_storeu_ps(result.m_max[r].data() + i, hi);
+    }
+  }
+#endif
+  for (; i < count; ++i)
+  {
+    float min[3], max[3], outMin[3], outMax[3];
+    for (int c = 0; c < 3; ++c)
+    {
+      min[c] = m_min[c][i];
+      max[c] = m_max[c][i];
+    }
+    transformScalar(rows, min, max, outMin, outMax);
+    for (int r = 0; r < 3; ++r)
+    {
+      result.m_min[r][i] = outMin[r];
+      result.m_max[r][i] = outMax[r];
+    }
+  }
+}
+
+size_t KAabbArray::contains(KVector3D const &point, uint8_t *results) const
+{
+  // Same rule as KAabbBoundingVolume::contains(), points on the surface are inside
+  size_t count = size(), inside = 0, i = 0;
+#ifdef __SSE2__
+  __m128 p[3] = { _mm_set1_ps(point.x()), _mm_set1_ps(point.y()), _mm_set1_ps(point.z()) };
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 outside = _mm_setzero_ps();
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      outside = _mm_or_ps(outside, _mm_cmpgt_ps(p[axis], _mm_loadu_ps(m_max[axis].data() + i)));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(p[axis], _mm_loadu_ps(m_min[axis].data() + i)));
+    }
+    int mask = ~_mm_movemask_ps(outside) & 0xF;
+    for (int lane = 0; lane < 4; ++lane)
+    {
+      results[i + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+    }
+    inside += static_cast<size_t>(((mask >> 0) & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1));
+  }
+#endif
+  for (; i < count; ++i)
+  {
+    bool outside = false;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      outside |= (point[axis] > m_max[axis][i]) | (point[axis] < m_min[axis][i]);
+    }
+    results[i] = outside ? 0 : 1;
+    inside += outside ? 0 : 1;
+  }
+  return inside;
+}
@@ -0,0 +1,96 @@
+#ifndef KAABBARRAY_H
+#define KAABBARRAY_H KAabbArray
+
+class KMatrix4x4;
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <KAabbBoundingVolume>
+
+// Many axis-aligned boxes, stored as one array per component (structure of arrays).
+// Batched operations work on several boxes per instruction where SIMD is available.
+class KAabbArray
+{
+public:
+  KAabbArray();
+  explicit KAabbArray(size_t count);
+
+  // Container
+  size_t size() const;
+  bool empty() const;
+  void clear();
+  void reserve(size_t count);
+  void resize(size_t count);
+  void push_back(KAabbBoundingVolume const &aabb);
+  void set(size_t index, KAabbBoundingVolume const &aabb);
+  void set(size_t index, KVector3D const &minExtent, KVector3D const &maxExtent);
+  KAabbBoundingVolume operator[](size_t index) const;
+  KVector3D minExtent(size_t index) const;
+  KVector3D maxExtent(size_t index) const;
+  KVector3D center(size_t index) const;
+
+  // Component arrays (Each holds size() floats)
+  float const *minData(int axis) const;
+  float const *maxData(int axis) const;
+
+  // Batched Operations
+  KAabbBoundingVolume bounds() const;
+  KAabbBoundingVolume bounds(size_t begin, size_t end) const;
+  void transform(KMatrix4x4 const &mtx, KAabbArray &result) const; // Affine transforms only
+  size_t contains(KVector3D const &point, uint8_t *results) const;  // Returns the number of boxes containing the point
+
+private:
+  std::vector<float> m_min[3];
+  std::vector<float> m_max[3];
+};
+
+inline size_t KAabbArray::size() const
+{
+  return m_min[0].size();
+}
+
+inline bool KAabbArray::empty() const
+{
+  return m_min[0].empty();
+}
+
+inline void KAabbArray::set(size_t index, KVector3D const &minExtent, KVector3D const &maxExtent)
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_min[axis][index] = minExtent[axis];
+    m_max[axis][index] = maxExtent[axis];
+  }
+}
+
+inline void KAabbArray::set(size_t index, KAabbBoundingVolume const &aabb)
+{
+  set(index, aabb.minExtent(), aabb.maxExtent());
+}
+
+inline KVector3D KAabbArray::minExtent(size_t index) const
+{
+  return KVector3D(m_min[0][index], m_min[1][index], m_min[2][index]);
+}
+
+inline KVector3D KAabbArray::maxExtent(size_t index) const
+{
+  return KVector3D(m_max[0][index], m_max[1][index], m_max[2][index]);
+}
+
+inline KVector3D KAabbArray::center(size_t index) const
+{
+  return (minExtent(index) + maxExtent(index)) * 0.5f;
+}
+
+inline float const *KAabbArray::minData(int axis) const
+{
+  return m_min[axis].data();
+}
+
+inline float const *KAabbArray::maxData(int axis) const
+{
+  return m_max[axis].data();
+}
+
+#endif // KAABBARRAY_H
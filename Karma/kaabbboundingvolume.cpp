@@ -7,129 +7,64 @@
 #include <KMatrix4x4>
 #include <KMath>
 
-class KAabbBoundingVolumePrivate
+KAabbBoundingVolume::KAabbBoundingVolume(const KAabbBoundingVolume &a, const KAabbBoundingVolume &b)
 {
-public:
-  KAabbBoundingVolumePrivate();
-  void calculateMinMaxMethod(KHalfEdgeMesh const &mesh);
-  Karma::MinMaxKVector3D maxMin;
-};
-
-KAabbBoundingVolumePrivate::KAabbBoundingVolumePrivate() :
-  maxMin(std::numeric_limits<float>::min(), std::numeric_limits<float>::max())
-{
-  // Intentionally Empty
-}
-
-void KAabbBoundingVolumePrivate::calculateMinMaxMethod(const KHalfEdgeMesh &mesh)
-{
-  KHalfEdgeMesh::VertexContainer const &vertices = mesh.vertices();
-  maxMin = Karma::findMinMaxBounds(vertices.begin(), vertices.end(), KHalfEdgeMesh::VertexPositionPred());
-}
-
-KAabbBoundingVolume::KAabbBoundingVolume() :
-  m_private(new KAabbBoundingVolumePrivate)
-{
-  // Intentionally Empty
-}
-
-KAabbBoundingVolume::KAabbBoundingVolume(const KAabbBoundingVolume &rhs) :
-  m_private(new KAabbBoundingVolumePrivate)
-{
-  P(KAabbBoundingVolumePrivate);
-  p.maxMin = rhs.m_private->maxMin;
-}
-
-KAabbBoundingVolume::KAabbBoundingVolume(const KAabbBoundingVolume &a, const KAabbBoundingVolume &b) :
-  m_private(new KAabbBoundingVolumePrivate)
-{
-  P(KAabbBoundingVolumePrivate);
-
   // Get new maximum
   if (a.extents().max.x() > b.extents().max.x())
-    p.maxMin.max.setX(a.extents().max.x());
+    m_extents.max.setX(a.extents().max.x());
   else
-    p.maxMin.max.setX(b.extents().max.x());
+    m_extents.max.setX(b.extents().max.x());
 
   if (a.extents().max.y() > b.extents().max.y())
-    p.maxMin.max.setY(a.extents().max.y());
+    m_extents.max.setY(a.extents().max.y());
   else
-    p.maxMin.max.setY(b.extents().max.y());
+    m_extents.max.setY(b.extents().max.y());
 
   if (a.extents().max.z() > b.extents().max.z())
-    p.maxMin.max.setZ(a.extents().max.z());
+    m_extents.max.setZ(a.extents().max.z());
   else
-    p.maxMin.max.setZ(b.extents().max.z());
+    m_extents.max.setZ(b.extents().max.z());
 
   // Get new minimum
   if (a.extents().min.x() < b.extents().min.x())
-    p.maxMin.min.setX(a.extents().min.x());
+    m_extents.min.setX(a.extents().min.x());
   else
-    p.maxMin.min.setX(b.extents().min.x());
+    m_extents.min.setX(b.extents().min.x());
 
   if (a.extents().min.y() < b.extents().min.y())
-    p.maxMin.min.setY(a.extents().min.y());
+    m_extents.min.setY(a.extents().min.y());
   else
-    p.maxMin.min.setY(b.extents().min.y());
+    m_extents.min.setY(b.extents().min.y());
 
   if (a.extents().min.z() < b.extents().min.z())
-    p.maxMin.min.setZ(a.extents().min.z());
+    m_extents.min.setZ(a.extents().min.z());
   else
-    p.maxMin.min.setZ(b.extents().min.z());
+    m_extents.min.setZ(b.extents().min.z());
 }
 
 KAabbBoundingVolume::KAabbBoundingVolume(KHalfEdgeMesh const &mesh, Method method) :
-  m_private(new KAabbBoundingVolumePrivate)
+  m_extents(std::numeric_limits<float>::min(), std::numeric_limits<float>::max())
 {
-  P(KAabbBoundingVolumePrivate);
   switch (method)
   {
   case MinMaxMethod:
-    p.calculateMinMaxMethod(mesh);
+  {
+    KHalfEdgeMesh::VertexContainer const &vertices = mesh.vertices();
+    m_extents = Karma::findMinMaxBounds(vertices.begin(), vertices.end(), KHalfEdgeMesh::VertexPositionPred());
     break;
   }
+  }
 }
 
-KAabbBoundingVolume::KAabbBoundingVolume(const KAabbBoundingVolume &a, const KVector3D &offset) :
-  m_private(new KAabbBoundingVolumePrivate)
-{
-  P(KAabbBoundingVolumePrivate);
-  p.maxMin.max = a.maxExtent() + offset;
-  p.maxMin.min = a.minExtent() + offset;
-}
-
-KAabbBoundingVolume::~KAabbBoundingVolume()
-{
-  delete m_private;
-}
-
-void KAabbBoundingVolume::operator=(const KAabbBoundingVolume &rhs)
-{
-  m_private->maxMin = rhs.m_private->maxMin;
-}
-
-Karma::MinMaxKVector3D const &KAabbBoundingVolume::extents() const
-{
-  P(KAabbBoundingVolumePrivate);
-  return p.maxMin;
-}
-
-KVector3D const &KAabbBoundingVolume::minExtent() const
-{
-  P(KAabbBoundingVolumePrivate);
-  return p.maxMin.min;
-}
-
-KVector3D const &KAabbBoundingVolume::maxExtent() const
+KAabbBoundingVolume::KAabbBoundingVolume(const KAabbBoundingVolume &a, const KVector3D &offset)
 {
-  P(KAabbBoundingVolumePrivate);
-  return p.maxMin.max;
+  m_extents.max = a.maxExtent() + offset;
+  m_extents.min = a.minExtent() + offset;
 }
 
 KVector3D KAabbBoundingVolume::maxAxis() const
 {
-  P(KAabbBoundingVolumePrivate);
-  KVector3D diff = p.maxMin.max - p.maxMin.min;
+  KVector3D diff = m_extents.max - m_extents.min;
   if (diff.x() > diff.y())
   {
     if (diff.x() > diff.z())
@@ -148,8 +83,7 @@ KVector3D KAabbBoundingVolume::maxAxis() const
 
 KVector3D KAabbBoundingVolume::minAxis() const
 {
-  P(KAabbBoundingVolumePrivate);
-  KVector3D diff = p.maxMin.max - p.maxMin.min;
+  KVector3D diff = m_extents.max - m_extents.min;
   if (diff.x() < diff.y())
   {
     if (diff.x() < diff.z())
@@ -168,61 +102,55 @@ KVector3D KAabbBoundingVolume::minAxis() const
 
 KVector3D KAabbBoundingVolume::center() const
 {
-  P(KAabbBoundingVolumePrivate);
-  return (p.maxMin.max + p.maxMin.min) / 2.0f;
+  return (m_extents.max + m_extents.min) / 2.0f;
 }
 
 void KAabbBoundingVolume::shiftCenter(const KVector3D &tr)
 {
-  P(KAabbBoundingVolumePrivate);
-  p.maxMin.max += tr;
-  p.maxMin.min += tr;
+  m_extents.max += tr;
+  m_extents.min += tr;
 }
 
 void KAabbBoundingVolume::encompassPoint(const KVector3D &vector)
 {
-  P(KAabbBoundingVolumePrivate);
-  if (p.maxMin.min.x() > vector.x()) p.maxMin.min.setX(vector.x());
-  if (p.maxMin.min.y() > vector.y()) p.maxMin.min.setY(vector.y());
-  if (p.maxMin.min.z() > vector.z()) p.maxMin.min.setZ(vector.z());
-  if (p.maxMin.max.x() < vector.x()) p.maxMin.max.setX(vector.x());
-  if (p.maxMin.max.y() < vector.y()) p.maxMin.max.setY(vector.y());
-  if (p.maxMin.max.z() < vector.z()) p.maxMin.max.setZ(vector.z());
+  if (m_extents.min.x() > vector.x()) m_extents.min.setX(vector.x());
+  if (m_extents.min.y() > vector.y()) m_extents.min.setY(vector.y());
+  if (m_extents.min.z() > vector.z()) m_extents.min.setZ(vector.z());
+  if (m_extents.max.x() < vector.x()) m_extents.max.setX(vector.x());
+  if (m_extents.max.y() < vector.y()) m_extents.max.setY(vector.y());
+  if (m_extents.max.z() < vector.z()) m_extents.max.setZ(vector.z());
 }
 
 void KAabbBoundingVolume::setMinMaxBounds(const Karma::MinMaxKVector3D &minMax)
 {
-  P(KAabbBoundingVolumePrivate);
-  p.maxMin = minMax;
+  m_extents = minMax;
 }
 
 void KAabbBoundingVolume::draw(KTransform3D &t, KColor const &color) const
 {
   KAabbBoundingVolume aabb = (*this) * t.toMatrix();
-  OpenGLDebugDraw::World::drawAabb(aabb.m_private->maxMin.min, aabb.m_private->maxMin.max, color);
+  OpenGLDebugDraw::World::drawAabb(aabb.m_extents.min, aabb.m_extents.max, color);
 }
 
 void KAabbBoundingVolume::makeCube()
 {
-  P(KAabbBoundingVolumePrivate);
   KVector3D centroid = center();
-  KVector3D halfExtents = (p.maxMin.max - p.maxMin.min) / 2.0f;
+  KVector3D halfExtents = (m_extents.max - m_extents.min) / 2.0f;
   float maxHalfExtent = halfExtents.x();
   if (halfExtents.y() > maxHalfExtent) maxHalfExtent = halfExtents.y();
   if (halfExtents.z() > maxHalfExtent) maxHalfExtent = halfExtents.z();
-  p.maxMin.max = centroid + KVector3D(maxHalfExtent, maxHalfExtent, maxHalfExtent);
-  p.maxMin.min = centroid - KVector3D(maxHalfExtent, maxHalfExtent, maxHalfExtent);
+  m_extents.max = centroid + KVector3D(maxHalfExtent, maxHalfExtent, maxHalfExtent);
+  m_extents.min = centroid - KVector3D(maxHalfExtent, maxHalfExtent, maxHalfExtent);
 }
 
 bool KAabbBoundingVolume::contains(const KVector3D &pos) const
 {
-  P(const KAabbBoundingVolumePrivate);
-  if (pos.x() > p.maxMin.max.x()) return false;
-  if (pos.y() > p.maxMin.max.y()) return false;
-  if (pos.z() > p.maxMin.max.z()) return false;
-  if (pos.x() < p.maxMin.min.x()) return false;
-  if (pos.y() < p.maxMin.min.y()) return false;
-  if (pos.z() < p.maxMin.min.z()) return false;
+  if (pos.x() > m_extents.max.x()) return false;
+  if (pos.y() > m_extents.max.y()) return false;
+  if (pos.z() > m_extents.max.z()) return false;
+  if (pos.x() < m_extents.min.x()) return false;
+  if (pos.y() < m_extents.min.y()) return false;
+  if (pos.z() < m_extents.min.z()) return false;
   return true;
 }
 
@@ -233,33 +161,31 @@ KAabbBoundingVolume KAabbBoundingVolume::copyOffset(float x, float y, float z)
 
 void KAabbBoundingVolume::scale(float k)
 {
-  P(KAabbBoundingVolumePrivate);
   KVector3D centroid = center();
-  p.maxMin.max = (p.maxMin.max - centroid) * k + centroid;
-  p.maxMin.min = (p.maxMin.min - centroid) * k + centroid;
+  m_extents.max = (m_extents.max - centroid) * k + centroid;
+  m_extents.min = (m_extents.min - centroid) * k + centroid;
 }
 
 KVector3D KAabbBoundingVolume::point(int idx) const
 {
-  P(KAabbBoundingVolumePrivate);
   switch (idx)
   {
   case 0:
-    return KVector3D(p.maxMin.min.x(), p.maxMin.min.y(), p.maxMin.min.z());
+    return KVector3D(m_extents.min.x(), m_extents.min.y(), m_extents.min.z());
   case 1:
-    return KVector3D(p.maxMin.min.x(), p.maxMin.min.y(), p.maxMin.max.z());
+    return KVector3D(m_extents.min.x(), m_extents.min.y(), m_extents.max.z());
   case 2:
-    return KVector3D(p.maxMin.min.x(), p.maxMin.max.y(), p.maxMin.min.z());
+    return KVector3D(m_extents.min.x(), m_extents.max.y(), m_extents.min.z());
   case 3:
-    return KVector3D(p.maxMin.max.x(), p.maxMin.min.y(), p.maxMin.min.z());
+    return KVector3D(m_extents.max.x(), m_extents.min.y(), m_extents.min.z());
   case 4:
-    return KVector3D(p.maxMin.max.x(), p.maxMin.max.y(), p.maxMin.max.z());
+    return KVector3D(m_extents.max.x(), m_extents.max.y(), m_extents.max.z());
   case 5:
-    return KVector3D(p.maxMin.max.x(), p.maxMin.max.y(), p.maxMin.min.z());
+    return KVector3D(m_extents.max.x(), m_extents.max.y(), m_extents.min.z());
   case 6:
-    return KVector3D(p.maxMin.max.x(), p.maxMin.min.y(), p.maxMin.max.z());
+    return KVector3D(m_extents.max.x(), m_extents.min.y(), m_extents.max.z());
   case 7:
-    return KVector3D(p.maxMin.min.x(), p.maxMin.max.y(), p.maxMin.max.z());
+    return KVector3D(m_extents.min.x(), m_extents.max.y(), m_extents.max.z());
   default:
     qFatal("Invalid index into KAabbBoundingVollume::point(int idx)!");
     break;
@@ -269,28 +195,22 @@ KVector3D KAabbBoundingVolume::point(int idx) const
 
 KAabbBoundingVolume KAabbBoundingVolume::operator*(const KMatrix4x4 &mtx) const
 {
-  P(const KAabbBoundingVolumePrivate);
   KAabbBoundingVolume retVal;
 
   // Construct translated pointset
-  std::vector<KVector3D> tVec =
+  KVector3D tVec[8] =
   {
-    mtx * p.maxMin.min,
-    mtx * p.maxMin.max,
-    mtx * KVector3D( p.maxMin.min.x(), p.maxMin.max.y(), p.maxMin.max.z()),
-    mtx * KVector3D( p.maxMin.min.x(), p.maxMin.min.y(), p.maxMin.max.z()),
-    mtx * KVector3D( p.maxMin.max.x(), p.maxMin.min.y(), p.maxMin.max.z()),
-    mtx * KVector3D( p.maxMin.max.x(), p.maxMin.min.y(), p.maxMin.min.z()),
-    mtx * KVector3D( p.maxMin.max.x(), p.maxMin.max.y(), p.maxMin.min.z()),
-    mtx * KVector3D( p.maxMin.min.x(), p.maxMin.max.y(), p.maxMin.min.z())
+    mtx * m_extents.min,
+    mtx * m_extents.max,
+    mtx * KVector3D( m_extents.min.x(), m_extents.max.y(), m_extents.max.z()),
+    mtx * KVector3D( m_extents.min.x(), m_extents.min.y(), m_extents.max.z()),
+    mtx * KVector3D( m_extents.max.x(), m_extents.min.y(), m_extents.max.z()),
+    mtx * KVector3D( m_extents.max.x(), m_extents.min.y(), m_extents.min.z()),
+    mtx * KVector3D( m_extents.max.x(), m_extents.max.y(), m_extents.min.z()),
+    mtx * KVector3D( m_extents.min.x(), m_extents.max.y(), m_extents.min.z())
   };
 
   // Find and draw the Aabb of the translated pointset
-  retVal.m_private->maxMin = Karma::findMinMaxBounds(tVec.begin(), tVec.end());
+  retVal.m_extents = Karma::findMinMaxBounds(tVec, tVec + 8);
   return retVal;
 }
-
-void KAabbBoundingVolume::constructPrivate()
-{
-  m_private = new KAabbBoundingVolumePrivate;
-}
@@ -2,14 +2,14 @@
 #define KAABBBOUNDINGVOLUME_H KAabbBoundingVolume
 
 #include <KMath>
-#include <KAbstractBoundingVolume>
 class KColor;
 class KHalfEdgeMesh;
 class KTransform3D;
 class KMatrix4x4;
 
-class KAabbBoundingVolumePrivate;
-class KAabbBoundingVolume : public KAbstractBoundingVolume
+// Axis-aligned box, stored inline as a plain value (copies never allocate).
+// For many boxes at once see KAabbArray.
+class KAabbBoundingVolume
 {
 public:
 
@@ -19,18 +19,16 @@ public:
     MinMaxMethod
   };
 
-  // Constructors & Destructor
+  // Constructors
   KAabbBoundingVolume();
-  KAabbBoundingVolume(KAabbBoundingVolume const &rhs);
   template <typename It, typename Accessor = Karma::DefaultAccessor<KVector3D const>>
   KAabbBoundingVolume(It begin, It end, Accessor accessor = Karma::DefaultAccessor<KVector3D const>());
+  KAabbBoundingVolume(KVector3D const &minExtent, KVector3D const &maxExtent);
   KAabbBoundingVolume(KAabbBoundingVolume const &a, KAabbBoundingVolume const &b);
   KAabbBoundingVolume(KHalfEdgeMesh const &mesh, Method method);
   KAabbBoundingVolume(KAabbBoundingVolume const &a, KVector3D const &offset);
-  ~KAabbBoundingVolume();
-  void operator=(KAabbBoundingVolume const &rhs);
 
-  // Virtual Implementation
+  // Accessors
   Karma::MinMaxKVector3D const &extents() const;
   KVector3D const &minExtent() const;
   KVector3D const &maxExtent() const;
@@ -49,15 +47,43 @@ public:
   KAabbBoundingVolume operator*(KMatrix4x4 const &mtx) const;
 
 private:
-  void constructPrivate();
-  KAabbBoundingVolumePrivate *m_private;
+  Karma::MinMaxKVector3D m_extents;
 };
 
+static_assert(sizeof(KAabbBoundingVolume) == 6 * sizeof(float), "KAabbBoundingVolume is expected to only hold its extents.");
+
+inline KAabbBoundingVolume::KAabbBoundingVolume() :
+  m_extents(std::numeric_limits<float>::min(), std::numeric_limits<float>::max())
+{
+  // Intentionally Empty
+}
+
 template <typename It, typename Accessor>
-KAabbBoundingVolume::KAabbBoundingVolume(It begin, It end, Accessor accessor)
+KAabbBoundingVolume::KAabbBoundingVolume(It begin, It end, Accessor accessor) :
+  m_extents(Karma::findMinMaxBounds(begin, end, accessor))
+{
+  // Intentionally Empty
+}
+
+inline KAabbBoundingVolume::KAabbBoundingVolume(KVector3D const &minExtent, KVector3D const &maxExtent)
+{
+  m_extents.min = minExtent;
+  m_extents.max = maxExtent;
+}
+
+inline Karma::MinMaxKVector3D const &KAabbBoundingVolume::extents() const
+{
+  return m_extents;
+}
+
+inline KVector3D const &KAabbBoundingVolume::minExtent() const
+{
+  return m_extents.min;
+}
+
+inline KVector3D const &KAabbBoundingVolume::maxExtent() const
 {
-  constructPrivate();
-  setMinMaxBounds(Karma::findMinMaxBounds(begin, end, accessor));
+  return m_extents.max;
 }
 
 #endif // KAABBBOUNDINGVOLUME_H
@@ -8,6 +8,11 @@
 #include <KAabbBoundingVolume>
 #include <KTrianglePartition>
 #include <KTrianglePointIterator>
+#include <KTriangleIndexIterator>
+#include <KFlatTree>
+#include <KMorton>
+#include <KParallel>
+#include <KRadixSort>
 #include <OpenGLDebugDraw>
 
 /*******************************************************************************
@@ -28,10 +33,12 @@ public:
   KAabbBoundingVolume m_aabb;
   KAdaptiveOctreeNode *m_children[8];
   KTriangleIndexCloud m_objects;
+  size_t m_begin;         // Bottom-up nodes index m_mortonTriangles instead of holding a copy
+  size_t m_end;
 };
 
 KAdaptiveOctreeNode::KAdaptiveOctreeNode(size_t depth, KAabbBoundingVolume const &aabb, KPointCloud &cloud) :
-  m_depth(depth), m_color(float(std::rand()) / RAND_MAX, float(std::rand()) / RAND_MAX, float(std::rand()) / RAND_MAX), m_pointCloud(cloud), m_aabb(aabb)
+  m_depth(depth), m_color(float(std::rand()) / RAND_MAX, float(std::rand()) / RAND_MAX, float(std::rand()) / RAND_MAX), m_pointCloud(cloud), m_aabb(aabb), m_begin(0), m_end(0)
 {
   for (int i = 0; i < 8; ++i)
   {
@@ -80,23 +87,129 @@ public:
   void buildBottomUp(TerminationPred pred);
   void buildTopDown(TerminationPred pred);
   KAdaptiveOctreeNode* recursiveTopDown(size_t depth, KAabbBoundingVolume aabb, TriangleIterator begin, TriangleIterator end, TerminationPred pred);
+  KAdaptiveOctreeNode* recursiveBottomUp(size_t depth, KVector3D const &minExtent, float size, size_t begin, size_t end, TerminationPred pred, size_t *maxDepth);
+  void flatten();
+  void recursiveFlatten(KAdaptiveOctreeNode const *node);
 
   size_t m_maxDepth;
+  size_t m_forkSize;      // Bottom-up subtrees at least this large build their octants in parallel
   KGeometryCloud m_parent;
   KPointCloud m_pointCloud;
   KAdaptiveOctreeNode *m_root;
+  KFlatTree m_flatTree;
+  uint32_t m_buildMethod;
+  uint64_t m_sourceHash;  // Hash of the geometry the tree was built from (It is consumed by the build)
+
+  // Bottom-up construction (sorted by Morton code)
+  std::vector<uint32_t> m_mortonCodes;
+  std::vector<KTriangleIndexCloud::ElementType> m_mortonTriangles;
 };
 
 KAdaptiveOctreePrivate::KAdaptiveOctreePrivate(KGeometryCloud &parent) :
-  m_parent(parent), m_root(0)
+  m_maxDepth(0), m_forkSize(0), m_parent(parent), m_root(0), m_buildMethod(0), m_sourceHash(0)
 {
   // Intentionally Empty
 }
 
 void KAdaptiveOctreePrivate::buildBottomUp(TerminationPred pred)
 {
-  (void)pred;
-  qFatal("Unsupported Build Method!");
+  m_maxDepth = 0;
+  KTriangleIndexCloud & triangleCloud = m_parent.triangleIndexCloud();
+  KPointCloud const & pointCloud = m_parent.pointCloud();
+  size_t numTriangles = triangleCloud.size();
+  KAabbBoundingVolume boundingVolume(KTrianglePointIterator(triangleCloud.begin(), pointCloud), KTrianglePointIterator(triangleCloud.end(), pointCloud));
+  boundingVolume.makeCube();
+  m_pointCloud = m_parent.pointCloud();
+
+  // Morton codes of the triangle centroids (Reminder: FaceIndices start from 1)
+  KVector3D minExtent = boundingVolume.minExtent();
+  float size = boundingVolume.maxExtent().x() - minExtent.x();
+  float scale = (size > 0.0f) ? Karma::MortonResolution / size : 0.0f;
+  std::vector<uint32_t> order(numTriangles);
+  m_mortonCodes.resize(numTriangles);
+  TriangleIterator triangles = triangleCloud.begin();
+  Karma::parallelFor(numTriangles, [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      KTriangleIndexCloud::ElementType const &triangle = triangles[i];
+      KVector3D centroid = (pointCloud[triangle.indices[0] - 1] + pointCloud[triangle.indices[1] - 1] + pointCloud[triangle.indices[2] - 1]) / 3.0f;
+      m_mortonCodes[i] = Karma::mortonCode(centroid, minExtent, scale);
+      order[i] = static_cast<uint32_t>(i);
+    }
+  });
+  Karma::radixSort(m_mortonCodes, order);
+
+  // Sorted by code, every octree cell owns a contiguous range of triangles
+  m_mortonTriangles.resize(numTriangles);
+  Karma::parallelFor(numTriangles, [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      m_mortonTriangles[i] = triangles[order[i]];
+    }
+  });
+
+  // Subtrees holding more than one thread's share of the triangles fork their octants
+  m_forkSize = std::max(Karma::ParallelGrainSize, numTriangles / Karma::threadCount());
+  m_root = recursiveBottomUp(0, minExtent, size, 0, numTriangles, pred, &m_maxDepth);
+  m_mortonCodes.clear();
+}
+
+KAdaptiveOctreeNode* KAdaptiveOctreePrivate::recursiveBottomUp(size_t depth, KVector3D const &minExtent, float size, size_t begin, size_t end, TerminationPred pred, size_t *maxDepth)
+{
+  size_t numTriangles = end - begin;
+  if (*maxDepth < depth) *maxDepth = depth;
+
+  // Note: Triangles are binned by centroid, so they may stick out of their cell
+  Karma::MinMaxKVector3D bounds;
+  bounds.min = minExtent;
+  bounds.max = minExtent + KVector3D(size, size, size);
+  KAabbBoundingVolume aabb;
+  aabb.setMinMaxBounds(bounds);
+  KAdaptiveOctreeNode *node = new KAdaptiveOctreeNode(depth, aabb, m_pointCloud);
+  node->m_begin = begin;
+  node->m_end = end;
+  if (depth >= Karma::MortonLevels || pred(numTriangles, depth))
+  {
+    return node;
+  }
+
+  // Octants are the next 3 bits of the code, so their ranges follow each other
+  size_t octantBegin[9];
+  octantBegin[0] = begin;
+  uint32_t const *codes = m_mortonCodes.data();
+  uint32_t level = static_cast<uint32_t>(depth);
+  for (uint32_t octant = 0; octant < 8; ++octant)
+  {
+    octantBegin[octant + 1] = std::upper_bound(codes + octantBegin[octant], codes + end, octant, [level](uint32_t o, uint32_t code)
+    {
+      return o < Karma::mortonOctant(code, level);
+    }) - codes;
+  }
+
+  // Empty octants are left out, large subtrees are built in parallel
+  float half = size * 0.5f;
+  size_t octantDepth[8] = { 0 };
+  auto buildOctants = [&](size_t first, size_t last)
+  {
+    for (size_t octant = first; octant < last; ++octant)
+    {
+      if (octantBegin[octant] == octantBegin[octant + 1]) continue;
+      KVector3D octantMin = minExtent + KVector3D((octant & 4) ? half : 0.0f, (octant & 2) ? half : 0.0f, (octant & 1) ? half : 0.0f);
+      node->m_children[octant] = recursiveBottomUp(depth + 1, octantMin, half, octantBegin[octant], octantBegin[octant + 1], pred, &octantDepth[octant]);
+    }
+  };
+  if (numTriangles >= m_forkSize && Karma::threadCount() > 1)
+  {
+    Karma::parallelFor(8, buildOctants, 1);
+  }
+  else
+  {
+    buildOctants(0, 8);
+  }
+  *maxDepth = std::max(*maxDepth, *std::max_element(octantDepth, octantDepth + 8));
+  return node;
 }
 
 void KAdaptiveOctreePrivate::buildTopDown(TerminationPred pred)
@@ -154,6 +267,58 @@ KAdaptiveOctreeNode* KAdaptiveOctreePrivate::recursiveTopDown(size_t depth, KAab
   return node;
 }
 
+void KAdaptiveOctreePrivate::flatten()
+{
+  m_flatTree.clear();
+  m_flatTree.setPoints(m_pointCloud);
+  recursiveFlatten(m_root);
+  m_mortonTriangles.clear();
+}
+
+void KAdaptiveOctreePrivate::recursiveFlatten(KAdaptiveOctreeNode const *node)
+{
+  if (!node) return;
+
+  // Bottom-up cells split all of their triangles between the octants, nothing straddles.
+  if (node->m_end > node->m_begin)
+  {
+    if (node->isLeaf())
+    {
+      m_flatTree.addLeaf(KTriangleIndexIterator(m_mortonTriangles.cbegin() + node->m_begin), KTriangleIndexIterator(m_mortonTriangles.cbegin() + node->m_end), 1);
+      return;
+    }
+    size_t index = m_flatTree.beginNode();
+    for (int i = 0; i < 8; ++i)
+    {
+      recursiveFlatten(node->m_children[i]);
+    }
+    m_flatTree.endNode(index);
+    return;
+  }
+
+  KAdaptiveOctreeNode::ConstIterator end = node->m_objects.cend();
+  if (node->isLeaf())
+  {
+    m_flatTree.addLeaf(KTriangleIndexIterator(node->m_objects.cbegin()), KTriangleIndexIterator(end), 1);
+    return;
+  }
+
+  // Inner nodes hold the triangles of all children, followed by those straddling them.
+  // The straddling triangles become the first child, so that empty octants can be dropped.
+  size_t straddling = node->m_objects.size();
+  for (int i = 0; i < 8; ++i)
+  {
+    if (node->m_children[i]) straddling -= node->m_children[i]->m_objects.size();
+  }
+  size_t index = m_flatTree.beginNode();
+  m_flatTree.addLeaf(KTriangleIndexIterator(end - straddling), KTriangleIndexIterator(end), 1);
+  for (int i = 0; i < 8; ++i)
+  {
+    recursiveFlatten(node->m_children[i]);
+  }
+  m_flatTree.endNode(index);
+}
+
 /*******************************************************************************
  * KAdaptiveOctree
  ******************************************************************************/
@@ -180,12 +345,20 @@ size_t KAdaptiveOctree::depth() const
   return p.m_maxDepth;
 }
 
+KFlatTree const &KAdaptiveOctree::flatTree() const
+{
+  P(const KAdaptiveOctreePrivate);
+  return p.m_flatTree;
+}
+
 void KAdaptiveOctree::build(BuildMethod method, TerminationPred pred)
 {
   P(KAdaptiveOctreePrivate);
 
   // If there is no new geometry to build, do nothing.
   if (!dirty()) return;
+  p.m_buildMethod = method;
+  p.m_sourceHash = hash();
 
   // Build based on selected method
   switch (method)
@@ -194,17 +367,53 @@ void KAdaptiveOctree::build(BuildMethod method, TerminationPred pred)
     p.buildBottomUp(pred);
     break;
   case TopDownMethod:
+  case SahMethod:
     p.buildTopDown(pred);
     break;
   }
 
+  // Depth-first search forming one contiguous index array of all leaf nodes.
+  p.flatten();
+
   // We no longer need this data
   KGeometryCloud::clear();
+}
 
-  // Next: Depth-first search to find all leaf nodes.
-  //       Form an index buffer of all contiguous leaf nodes.
-  //       As we iterate through, update the parent nodes so they
-  //       understand the "drawable range" of the children.
+bool KAdaptiveOctree::save(const char *filename, uint32_t parameters) const
+{
+  P(const KAdaptiveOctreePrivate);
+  if (p.m_flatTree.empty()) return false;
+  KFlatTreeHeader header = KFlatTreeHeader();
+  header.structure = KFlatTreeHeader::AdaptiveOctree;
+  header.buildMethod = p.m_buildMethod;
+  header.parameters = parameters;
+  header.depth = static_cast<uint32_t>(p.m_maxDepth);
+  header.sourceHash = p.m_sourceHash;
+  return p.m_flatTree.save(filename, header);
+}
+
+bool KAdaptiveOctree::load(const char *filename, BuildMethod method, uint32_t parameters)
+{
+  // Only valid for the geometry waiting to be built, which is consumed like build() would.
+  if (!dirty()) return false;
+  KFlatTreeHeader header = KFlatTreeHeader();
+  header.structure = KFlatTreeHeader::AdaptiveOctree;
+  header.buildMethod = method;
+  header.parameters = parameters;
+  header.sourceHash = hash();
+
+  KAdaptiveOctreePrivate *loaded = new KAdaptiveOctreePrivate(*this);
+  if (!loaded->m_flatTree.load(filename, &header))
+  {
+    delete loaded;
+    return false;
+  }
+  loaded->m_buildMethod = method;
+  loaded->m_sourceHash = header.sourceHash;
+  loaded->m_maxDepth = header.depth;
+  m_private = loaded;
+  KGeometryCloud::clear();
+  return true;
 }
 
 void KAdaptiveOctree::debugDraw(size_t min, size_t max)
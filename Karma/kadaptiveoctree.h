@@ -2,9 +2,11 @@
 #define KADAPTIVEOCTREE_H KAdaptiveOctree
 
 class KColor;
+class KFlatTree;
 class KHalfEdgeMesh;
 class KTransform3D;
 #include <cstddef>
+#include <cstdint>
 #include <KGeometryCloud>
 #include <KSharedPointer>
 
@@ -17,7 +19,12 @@ public:
 
   void clear();
   size_t depth() const;
+  KFlatTree const &flatTree() const;
   void build(BuildMethod method, TerminationPred pred);
+
+  // Serialization (See KStaticGeometry, debug drawing needs a tree built in memory)
+  bool save(char const *filename, uint32_t parameters = 0) const;
+  bool load(char const *filename, BuildMethod method, uint32_t parameters = 0);
   void debugDraw(size_t min = 0, size_t max = std::numeric_limits<size_t>::max());
   void debugDraw(KTransform3D &trans, size_t min = 0, size_t max = std::numeric_limits<size_t>::max());
 
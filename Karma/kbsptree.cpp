@@ -1,5 +1,7 @@
 #include "kbsptree.h"
 
+#include <cstring>
+#include <random>
 #include <KMacros>
 #include <KMatrix4x4>
 #include <KHalfEdgeMesh>
@@ -8,9 +10,41 @@
 #include <KAabbBoundingVolume>
 #include <KTrianglePartition>
 #include <KTrianglePointIterator>
+#include <KTriangleIndexIterator>
+#include <KFlatTree>
+#include <KParallel>
 #include <OpenGLDebugDraw>
 #include <KPlane>
 
+/*******************************************************************************
+ * KBspTree Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Candidate planes scored per node, and random planes tried when none of them divide the range.
+  static const size_t BspCandidateCount = 32;
+  static const size_t BspFallbackAttempts = 16;
+
+  struct KBspClassification
+  {
+    KBspClassification() : coplanar(0), front(0), back(0), straddling(0) {}
+    int coplanar, front, back, straddling;
+  };
+
+  // Splitting planes in depth-first order, the front child follows its parent.
+  // Point location only needs these, so they're all that is kept (and saved) besides the flat tree.
+  static const uint32_t BspPlaneNoLeaf = 0xFFFFFFFF;
+  struct KBspPlaneNode
+  {
+    float normal[3];
+    float dTerm;
+    uint32_t back;  // Inner: offset to the back child. Leaf: 0.
+    uint32_t leaf;  // Leaf: index within the flat tree (BspPlaneNoLeaf if empty).
+  };
+
+}
+
 /*******************************************************************************
  * KAdaptiveOctreeNode
  ******************************************************************************/
@@ -28,12 +62,13 @@ public:
   KPlane m_plane;
   KBspTreeNode *m_left;
   KBspTreeNode *m_right;
+  size_t m_flatIndex;
   KTriangleIndexCloud m_objects;
   KPointCloud &m_pointCloud;
 };
 
 KBspTreeNode::KBspTreeNode(size_t depth, KPointCloud &cloud) :
-  m_depth(depth), m_color(float(std::rand()) / RAND_MAX, float(std::rand()) / RAND_MAX, float(std::rand()) / RAND_MAX), m_left(0), m_right(0), m_pointCloud(cloud)
+  m_depth(depth), m_color(float(std::rand()) / RAND_MAX, float(std::rand()) / RAND_MAX, float(std::rand()) / RAND_MAX), m_left(0), m_right(0), m_flatIndex(KBspTree::NoLeaf), m_pointCloud(cloud)
 {
   // Intentionally Empty
 }
@@ -82,17 +117,25 @@ public:
   KBspTreePrivate(KGeometryCloud &parent);
   void buildBottomUp(TerminationPred pred);
   void buildTopDown(TerminationPred pred);
-  KBspTreeNode* recursiveTopDown(size_t depth, TriangleIterator begin, TriangleIterator end, TerminationPred pred);
-  KPlane pickSplittingPlane(TriangleIterator begin, TriangleIterator end, float skipWeight = 0.0f);
+  KBspTreeNode* recursiveTopDown(size_t depth, TriangleIterator begin, TriangleIterator end, TerminationPred pred, size_t *maxDepth);
+  bool pickSplittingPlane(size_t depth, TriangleIterator begin, TriangleIterator end, KPlane *result);
+  void classifyCandidates(size_t depth, KPlane const *planes, size_t count, TriangleIterator begin, TriangleIterator end, KBspClassification *results);
+  void flatten();
+  void recursiveFlatten(KBspTreeNode *node);
+  void recursivePlanes(KBspTreeNode const *node);
 
   KBspTreeNode *m_root;
   size_t m_maxDepth;
   KGeometryCloud m_parent;
   KPointCloud m_pointCloud;
+  KFlatTree m_flatTree;
+  std::vector<KBspPlaneNode> m_planes;
+  uint32_t m_buildMethod;
+  uint64_t m_sourceHash;  // Hash of the geometry the tree was built from (It is consumed by the build)
 };
 
 KBspTreePrivate::KBspTreePrivate(KGeometryCloud &parent) :
-  m_root(0), m_parent(parent)
+  m_root(0), m_maxDepth(0), m_parent(parent), m_buildMethod(0), m_sourceHash(0)
 {
   // Intentionally Empty
 }
@@ -108,114 +151,170 @@ void KBspTreePrivate::buildTopDown(TerminationPred pred)
   m_maxDepth = 0;
   KTriangleIndexCloud & triangleCloud = m_parent.triangleIndexCloud();
   m_pointCloud = m_parent.pointCloud();
-  m_root = recursiveTopDown(0, triangleCloud.begin(), triangleCloud.end(), pred);
+  m_root = recursiveTopDown(0, triangleCloud.begin(), triangleCloud.end(), pred, &m_maxDepth);
 }
 
-KBspTreeNode* KBspTreePrivate::recursiveTopDown(size_t depth, TriangleIterator begin, TriangleIterator end, TerminationPred pred)
+KBspTreeNode* KBspTreePrivate::recursiveTopDown(size_t depth, TriangleIterator begin, TriangleIterator end, TerminationPred pred, size_t *maxDepth)
 {
-  KPointCloud const & pointCloud = m_parent.pointCloud();
   size_t numTriangles = std::distance(begin, end);
-  if (m_maxDepth < depth) m_maxDepth = depth;
+  if (*maxDepth < depth) *maxDepth = depth;
 
   // Check if the predicate was met (terminating condition)
   KBspTreeNode *node = new KBspTreeNode(depth, m_pointCloud);
-  if (pred(numTriangles, m_maxDepth))
+  KPlane plane;
+  if (pred(numTriangles, depth) || !pickSplittingPlane(depth, begin, end, &plane))
   {
     node->m_objects.copy(begin, end);
     return node;
   }
-
-  // Calculate Plane
-  float skip = 0.0f;
-  size_t testTriangles = numTriangles;
-  while (testTriangles > 1000)
-  {
-    skip += 0.1f;
-    testTriangles /= 10;
-  }
-  KPlane plane = pickSplittingPlane(begin, end, skip);
   node->m_plane = plane;
 
-  // Create all nodes
-  TriangleIterator middle = std::partition(begin, end, KTrianglePartitionPlane(pointCloud, plane));
-  node->m_left = recursiveTopDown(depth + 1, begin, middle, pred);
-  node->m_right = recursiveTopDown(depth + 1, middle, end, pred);
+  // Create all nodes, large halves are built on their own thread
+  size_t leftDepth = depth, rightDepth = depth;
+  TriangleIterator middle = std::partition(begin, end, KTrianglePartitionPlane(m_pointCloud, plane));
+  bool parallel = (std::min(middle - begin, end - middle) >= static_cast<std::ptrdiff_t>(Karma::ParallelGrainSize));
+  Karma::parallelInvoke(
+    [&]() { node->m_left = recursiveTopDown(depth + 1, begin, middle, pred, &leftDepth); },
+    [&]() { node->m_right = recursiveTopDown(depth + 1, middle, end, pred, &rightDepth); },
+    parallel
+  );
+  *maxDepth = std::max(*maxDepth, std::max(leftDepth, rightDepth));
 
   // Grab remaining indices
   node->m_objects.copy(begin, end);
   return node;
 }
 
-KPlane KBspTreePrivate::pickSplittingPlane(TriangleIterator begin, TriangleIterator end, float skipWeight)
+bool KBspTreePrivate::pickSplittingPlane(size_t depth, TriangleIterator begin, TriangleIterator end, KPlane *result)
 {
   const float K = 0.8f;
 
-  // Initialize search statistics
-  float bestScore = std::numeric_limits<float>::max();
+  // Candidates are a fixed-size random sample of the faces (seeded per node, so builds are repeatable)
   size_t numPolygons = std::distance(begin, end);
-  size_t skipSize = numPolygons * skipWeight;
-  skipSize = Karma::clamp(skipSize, static_cast<size_t>(1), numPolygons);
-
-  // For analysis
-  float score;
-  KPlane plane, bestPlane;
-  int numCoplanar, numInFront, numInBack, numStraddling;
-  int bestCoplanar, bestInFront, bestInBack, bestStraddling;
-  bestCoplanar = bestInFront = bestInBack = bestStraddling = 0;
-
-  // Iterate over the range, skipping based on the weight provided.
-  size_t numRemaining;
-  TriangleIterator origBegin = begin;
-  while (begin != end)
+  if (numPolygons == 0) return false; // Nothing to sample, empty ranges stay leaves
+  std::minstd_rand random(static_cast<uint32_t>(numPolygons * 2654435761u + depth + 1));
+  size_t numCandidates = std::min(numPolygons, BspCandidateCount);
+  KPlane candidates[BspCandidateCount];
+  for (size_t i = 0; i < numCandidates; ++i)
   {
-    // Test if we have no more remaining
-    numRemaining = std::distance(begin, end);
-    if (numRemaining < skipSize) break;
-
-    // Construct the sample plane
-    KTriangleIndexCloud::ElementType const &sampleTriangle = *begin;
-    plane = KPlane(
+    size_t sample = (numCandidates == numPolygons) ? i : random() % numPolygons;
+    KTriangleIndexCloud::ElementType const &sampleTriangle = *(begin + sample);
+    candidates[i] = KPlane(
       m_pointCloud[sampleTriangle.indices[0] - 1],
       m_pointCloud[sampleTriangle.indices[1] - 1],
       m_pointCloud[sampleTriangle.indices[2] - 1]
     );
+  }
 
-    // Count the polygons
-    numCoplanar = numInFront = numInBack = numStraddling = 0;
-    Karma::classifyRange(plane, origBegin, end, m_pointCloud, &numCoplanar, &numInFront, &numInBack, &numStraddling);
-
-    // Score the polygons
-    score = K * (numStraddling + numCoplanar) + (1.0f - K) * std::abs(numInFront - numInBack);
-    if (score < bestScore)
+  // Score the polygons, only planes which actually divide the range are accepted
+  KBspClassification counts[BspCandidateCount];
+  classifyCandidates(depth, candidates, numCandidates, begin, end, counts);
+  float bestScore = std::numeric_limits<float>::max();
+  for (size_t i = 0; i < numCandidates; ++i)
+  {
+    KBspClassification const &c = counts[i];
+    float score = K * (c.straddling + c.coplanar) + (1.0f - K) * std::abs(c.front - c.back);
+    if (c.front > 0 && c.back > 0 && score < bestScore)
     {
-      bestCoplanar = numCoplanar;
-      bestInFront = numInFront;
-      bestInBack = numInBack;
-      bestStraddling = numStraddling;
       bestScore = score;
-      bestPlane = plane;
+      *result = candidates[i];
     }
-
-    // Note: Skipping through a percentage of the mesh was introduced for efficiency reasons
-    begin += skipSize;
   }
+  if (bestScore < std::numeric_limits<float>::max()) return true;
 
   // Edge case: No plane formed by the faces of the mesh will reduce sample size
-  while (bestInFront == 0 || bestInBack == 0)
+  for (size_t attempt = 0; attempt < BspFallbackAttempts; ++attempt)
   {
-    KTriangleIndexCloud::ElementType const &a = *(origBegin + (std::rand() % numPolygons));
-    KTriangleIndexCloud::ElementType const &b = *(origBegin + (std::rand() % numPolygons));
-    KTriangleIndexCloud::ElementType const &c = *(origBegin + (std::rand() % numPolygons));
-    bestPlane = KPlane(
+    KTriangleIndexCloud::ElementType const &a = *(begin + (random() % numPolygons));
+    KTriangleIndexCloud::ElementType const &b = *(begin + (random() % numPolygons));
+    KTriangleIndexCloud::ElementType const &c = *(begin + (random() % numPolygons));
+    *result = KPlane(
       m_pointCloud[a.indices[0] - 1],
       m_pointCloud[b.indices[1] - 1],
       m_pointCloud[c.indices[2] - 1]
     );
-    Karma::classifyRange(bestPlane, origBegin, end, m_pointCloud, &bestCoplanar, &bestInFront, &bestInBack, &bestStraddling);
+    classifyCandidates(depth, result, 1, begin, end, counts);
+    if (counts[0].front > 0 && counts[0].back > 0) return true;
+  }
+
+  // Nothing divides this range (eg. all faces are coplanar), keep it as a leaf.
+  return false;
+}
+
+void KBspTreePrivate::classifyCandidates(size_t depth, KPlane const *planes, size_t count, TriangleIterator begin, TriangleIterator end, KBspClassification *results)
+{
+  // Every chunk classifies against all candidates, partial counts are summed afterwards.
+  // Subtrees near the root are already running in parallel, so they share the threads.
+  size_t numTriangles = std::distance(begin, end);
+  size_t chunks = std::max<size_t>(1, Karma::parallelChunkCount(numTriangles) >> std::min<size_t>(depth, 16));
+  std::vector<KBspClassification> partial(chunks * count, KBspClassification());
+  Karma::parallelChunks(numTriangles, chunks, [&](size_t chunk, size_t first, size_t last)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      KBspClassification &c = partial[chunk * count + i];
+      Karma::classifyRange(planes[i], begin + first, begin + last, m_pointCloud, &c.coplanar, &c.front, &c.back, &c.straddling);
+    }
+  });
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    results[i] = KBspClassification();
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+      KBspClassification const &c = partial[chunk * count + i];
+      results[i].coplanar += c.coplanar;
+      results[i].front += c.front;
+      results[i].back += c.back;
+      results[i].straddling += c.straddling;
+    }
+  }
+}
+
+void KBspTreePrivate::flatten()
+{
+  m_flatTree.clear();
+  m_flatTree.setPoints(m_pointCloud);
+  recursiveFlatten(m_root);
+  m_planes.clear();
+  if (m_root) recursivePlanes(m_root);
+}
+
+void KBspTreePrivate::recursivePlanes(KBspTreeNode const *node)
+{
+  size_t index = m_planes.size();
+  m_planes.push_back(KBspPlaneNode());
+  if (node->isLeaf())
+  {
+    m_planes[index].back = 0;
+    m_planes[index].leaf = (node->m_flatIndex == KBspTree::NoLeaf) ? BspPlaneNoLeaf : static_cast<uint32_t>(node->m_flatIndex);
+    return;
+  }
+
+  KVector3D const &normal = node->m_plane.normal();
+  for (int axis = 0; axis < 3; ++axis) m_planes[index].normal[axis] = normal[axis];
+  m_planes[index].dTerm = node->m_plane.dot(KVector3D(0.0f, 0.0f, 0.0f));
+  m_planes[index].leaf = BspPlaneNoLeaf;
+  recursivePlanes(node->m_left);
+  m_planes[index].back = static_cast<uint32_t>(m_planes.size() - index);
+  recursivePlanes(node->m_right);
+}
+
+void KBspTreePrivate::recursiveFlatten(KBspTreeNode *node)
+{
+  if (!node) return;
+  if (node->isLeaf())
+  {
+    node->m_flatIndex = m_flatTree.size();
+    if (!m_flatTree.addLeaf(KTriangleIndexIterator(node->m_objects.cbegin()), KTriangleIndexIterator(node->m_objects.cend()), 1)) node->m_flatIndex = KBspTree::NoLeaf;
+    return;
   }
 
-  // Due to the edge case, the splitting of the mesh isn't always the same.
-  return bestPlane;
+  // Note: Every triangle is partitioned into one of the halves, inner nodes own none.
+  size_t index = m_flatTree.beginNode();
+  recursiveFlatten(node->m_left);
+  recursiveFlatten(node->m_right);
+  m_flatTree.endNode(index);
 }
 
 /*******************************************************************************
@@ -244,12 +343,64 @@ size_t KBspTree::depth() const
   return p.m_maxDepth;
 }
 
+KFlatTree const &KBspTree::flatTree() const
+{
+  P(const KBspTreePrivate);
+  return p.m_flatTree;
+}
+
+size_t KBspTree::locate(KVector3D const &point) const
+{
+  P(const KBspTreePrivate);
+
+  // Same rule as the partitioning: only points strictly in front descend to the left.
+  if (p.m_planes.empty()) return NoLeaf;
+  KBspPlaneNode const *node = p.m_planes.data();
+  while (node->back != 0)
+  {
+    KVector3D normal(node->normal[0], node->normal[1], node->normal[2]);
+    node += (KVector3D::dotProduct(normal, point) + node->dTerm > 0.0f) ? 1 : node->back;
+  }
+  return (node->leaf == BspPlaneNoLeaf) ? NoLeaf : node->leaf;
+}
+
+bool KBspTree::inside(KVector3D const &point) const
+{
+  P(const KBspTreePrivate);
+
+  // The first face hit from inside of a closed mesh is seen from behind.
+  // Note: The direction is skewed so that rays rarely run along edges of axis-aligned geometry.
+  static const KVector3D direction(0.5773f, 0.5774f, 0.5775f);
+  KRayHit hit;
+  if (!p.m_flatTree.raycast(point, direction, std::numeric_limits<float>::infinity(), &hit)) return false;
+  KFlatTree::IndexContainer const &indices = p.m_flatTree.indices();
+  KFlatTree::PointContainer const &points = p.m_flatTree.points();
+  KVector3D const &a = points[indices[3 * hit.triangle + 0]];
+  KVector3D const &b = points[indices[3 * hit.triangle + 1]];
+  KVector3D const &c = points[indices[3 * hit.triangle + 2]];
+  return KVector3D::dotProduct(KVector3D::crossProduct(b - a, c - a), direction) > 0.0f;
+}
+
+bool KBspTree::raycast(KVector3D const &origin, KVector3D const &direction, float tMax, KRayHit *hit) const
+{
+  P(const KBspTreePrivate);
+  return p.m_flatTree.raycast(origin, direction, tMax, hit);
+}
+
+bool KBspTree::occluded(KVector3D const &origin, KVector3D const &direction, float tMax) const
+{
+  P(const KBspTreePrivate);
+  return p.m_flatTree.occluded(origin, direction, tMax);
+}
+
 void KBspTree::build(KGeometryCloud::BuildMethod method, KGeometryCloud::TerminationPred pred)
 {
   P(KBspTreePrivate);
 
   // If there is no new geometry to build, do nothing.
   if (!dirty()) return;
+  p.m_buildMethod = method;
+  p.m_sourceHash = hash();
 
   // Build based on selected method
   switch (method)
@@ -258,17 +409,73 @@ void KBspTree::build(KGeometryCloud::BuildMethod method, KGeometryCloud::Termina
     p.buildBottomUp(pred);
     break;
   case TopDownMethod:
+  case SahMethod:
     p.buildTopDown(pred);
     break;
   }
 
+  // Depth-first search forming one contiguous index array of all leaf nodes.
+  p.flatten();
+
   // We no longer need this data
   KGeometryCloud::clear();
+}
 
-  // Next: Depth-first search to find all leaf nodes.
-  //       Form an index buffer of all contiguous leaf nodes.
-  //       As we iterate through, update the parent nodes so they
-  //       understand the "drawable range" of the children.
+bool KBspTree::save(const char *filename, uint32_t parameters) const
+{
+  P(const KBspTreePrivate);
+  if (p.m_planes.empty()) return false;
+  KFlatTreeHeader header = KFlatTreeHeader();
+  header.structure = KFlatTreeHeader::BspTree;
+  header.buildMethod = p.m_buildMethod;
+  header.parameters = parameters;
+  header.depth = static_cast<uint32_t>(p.m_maxDepth);
+  header.sourceHash = p.m_sourceHash;
+  char const *planes = reinterpret_cast<char const*>(p.m_planes.data());
+  return p.m_flatTree.save(filename, header, std::vector<char>(planes, planes + p.m_planes.size() * sizeof(KBspPlaneNode)));
+}
+
+bool KBspTree::load(const char *filename, BuildMethod method, uint32_t parameters)
+{
+  // Only valid for the geometry waiting to be built, which is consumed like build() would.
+  if (!dirty()) return false;
+  KFlatTreeHeader header = KFlatTreeHeader();
+  header.structure = KFlatTreeHeader::BspTree;
+  header.buildMethod = method;
+  header.parameters = parameters;
+  header.sourceHash = hash();
+
+  std::vector<char> planes;
+  KBspTreePrivate *loaded = new KBspTreePrivate(*this);
+  if (!loaded->m_flatTree.load(filename, &header, &planes) || planes.empty() || planes.size() % sizeof(KBspPlaneNode) != 0)
+  {
+    delete loaded;
+    return false;
+  }
+  loaded->m_planes.resize(planes.size() / sizeof(KBspPlaneNode));
+  std::memcpy(loaded->m_planes.data(), planes.data(), planes.size());
+
+  // Point location follows the stored offsets unchecked, so they must stay within the planes (and leaves within the tree)
+  size_t planeCount = loaded->m_planes.size();
+  size_t leafCount = loaded->m_flatTree.size();
+  for (size_t i = 0; i < planeCount; ++i)
+  {
+    KBspPlaneNode const &node = loaded->m_planes[i];
+    bool valid = (node.back == 0) ?
+      (node.leaf == BspPlaneNoLeaf || node.leaf < leafCount) :
+      (node.back > 1 && i + node.back < planeCount && i + 1 < planeCount);
+    if (!valid)
+    {
+      delete loaded;
+      return false;
+    }
+  }
+  loaded->m_buildMethod = method;
+  loaded->m_sourceHash = header.sourceHash;
+  loaded->m_maxDepth = header.depth;
+  m_private = loaded;
+  KGeometryCloud::clear();
+  return true;
 }
 
 void KBspTree::debugDraw(size_t min, size_t max)
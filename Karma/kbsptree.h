@@ -2,8 +2,13 @@
 #define KBSPTREE_H KBspTree
 
 class KColor;
+class KFlatTree;
 class KHalfEdgeMesh;
 class KTransform3D;
+class KVector3D;
+struct KRayHit;
+#include <cstddef>
+#include <cstdint>
 #include <KGeometryCloud>
 #include <KSharedPointer>
 
@@ -11,12 +16,25 @@ class KBspTreePrivate;
 class KBspTree : public KGeometryCloud
 {
 public:
+  static const size_t NoLeaf = static_cast<size_t>(-1);
+
   KBspTree();
   ~KBspTree();
 
   void clear();
   size_t depth() const;
+  KFlatTree const &flatTree() const;
+  // Point queries (`locate` returns the flatTree() leaf of the cell around the point, `inside` assumes a closed mesh)
+  size_t locate(KVector3D const &point) const;
+  bool inside(KVector3D const &point) const;
+  bool raycast(KVector3D const &origin, KVector3D const &direction, float tMax, KRayHit *hit) const;
+  bool occluded(KVector3D const &origin, KVector3D const &direction, float tMax) const;
   void build(BuildMethod method, TerminationPred pred);
+
+  // Serialization (See KStaticGeometry, debug drawing needs a tree built in memory)
+  bool save(char const *filename, uint32_t parameters = 0) const;
+  bool load(char const *filename, BuildMethod method, uint32_t parameters = 0);
+
   void debugDraw(size_t min = 0, size_t max = std::numeric_limits<size_t>::max());
   void debugDraw(KTransform3D &trans, size_t min = 0, size_t max = std::numeric_limits<size_t>::max());
 
@@ -59,6 +59,11 @@ const KMatrix4x4 &KCamera3D::toMatrix() const
   return m_world;
 }
 
+const KMatrix4x4 &KCamera3D::projection() const
+{
+  return m_projection;
+}
+
 const KFrustum &KCamera3D::frustum() const
 {
   clean();
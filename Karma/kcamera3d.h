@@ -37,6 +37,7 @@ public:
   const KVector3D& translation() const;
   const KQuaternion& rotation() const;
   const KMatrix4x4& toMatrix() const;
+  const KMatrix4x4& projection() const;
   const KFrustum& frustum() const;
   bool dirty() const;
 
@@ -0,0 +1,632 @@
+#include "kflattree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <QFile>
+#include <KParallel>
+#include <KPointCloud>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*******************************************************************************
+ * Ray Helpers
+ ******************************************************************************/
+namespace
+{
+
+  struct KFlatRay
+  {
+    KFlatRay(KVector3D const &origin, KVector3D const &direction);
+    KVector3D origin;
+    KVector3D direction;
+    float invDirection[3];
+  };
+
+  inline KFlatRay::KFlatRay(KVector3D const &o, KVector3D const &d) :
+    origin(o), direction(d)
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      invDirection[axis] = 1.0f / d[axis];
+    }
+  }
+
+  // Slab test, rays parallel to an axis rely on IEEE infinities.
+  inline bool intersectNode(KFlatRay const &ray, KFlatNode const &node, float tMax, float *tEntry)
+  {
+    float tNear = 0.0f, tFar = tMax;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      float t0 = (node.min[axis] - ray.origin[axis]) * ray.invDirection[axis];
+      float t1 = (node.max[axis] - ray.origin[axis]) * ray.invDirection[axis];
+      tNear = std::max(tNear, std::min(t0, t1));
+      tFar = std::min(tFar, std::max(t0, t1));
+    }
+    *tEntry = tNear;
+    return tNear <= tFar;
+  }
+
+  // Nodes waiting to be visited, children are pushed far-to-near so the nearest pops first.
+  // Traversals keep this many entries on their own stack, deeper trees allocate theirs.
+  static const size_t TraversalStackSize = 1024;
+
+  struct KFlatStackEntry
+  {
+    uint32_t node;
+    float tNear;
+  };
+
+  class KFlatStack
+  {
+  public:
+    KFlatStack(size_t size) : m_entries(m_local)
+    {
+      if (size > TraversalStackSize)
+      {
+        m_heap.resize(size);
+        m_entries = m_heap.data();
+      }
+    }
+    KFlatStackEntry &operator[](size_t index) { return m_entries[index]; }
+    KFlatStackEntry *data() { return m_entries; }
+  private:
+    KFlatStackEntry m_local[TraversalStackSize];
+    std::vector<KFlatStackEntry> m_heap;
+    KFlatStackEntry *m_entries;
+  };
+
+  // Every inner node pushes all of its children and pops one of them to descend,
+  // so the stack is deepest below the inner node with the most entries left behind it.
+  size_t requiredStackSize(KFlatNode const *nodes, size_t count)
+  {
+    if (count == 0) return 0;
+    size_t required = 1;
+    std::vector<std::pair<size_t, size_t>> open; // Subtree end, entries below its children
+    for (size_t node = 0; node < count; ++node)
+    {
+      while (!open.empty() && open.back().first <= node) open.pop_back();
+      if (nodes[node].isLeaf()) continue;
+      size_t below = open.empty() ? 0 : open.back().second;
+      size_t end = node + nodes[node].offset;
+      size_t children = 0;
+      for (size_t child = node + 1; child < end; child += nodes[child].subtreeSize()) ++children;
+      required = std::max(required, below + children);
+      open.push_back(std::make_pair(end, below + children - 1));
+    }
+    return required;
+  }
+
+  inline void sortFarToNear(KFlatStackEntry *begin, KFlatStackEntry *end)
+  {
+    for (KFlatStackEntry *it = begin + 1; it < end; ++it)
+    {
+      KFlatStackEntry entry = *it;
+      KFlatStackEntry *hole = it;
+      for (; hole != begin && (hole - 1)->tNear < entry.tNear; --hole)
+      {
+        *hole = *(hole - 1);
+      }
+      *hole = entry;
+    }
+  }
+
+  // Moller-Trumbore, double-sided. Only hits within [0, tMax) are reported.
+  inline bool intersectTriangle(KFlatRay const &ray, KVector3D const &p0, KVector3D const &p1, KVector3D const &p2, float tMax, KRayHit *hit)
+  {
+    KVector3D e1 = p1 - p0;
+    KVector3D e2 = p2 - p0;
+    KVector3D pvec = KVector3D::crossProduct(ray.direction, e2);
+    float det = KVector3D::dotProduct(e1, pvec);
+    if (det == 0.0f) return false;
+
+    float invDet = 1.0f / det;
+    KVector3D tvec = ray.origin - p0;
+    float u = KVector3D::dotProduct(tvec, pvec) * invDet;
+    if (u < 0.0f || u > 1.0f) return false;
+
+    KVector3D qvec = KVector3D::crossProduct(tvec, e1);
+    float v = KVector3D::dotProduct(ray.direction, qvec) * invDet;
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    float t = KVector3D::dotProduct(e2, qvec) * invDet;
+    if (t < 0.0f || t >= tMax) return false;
+
+    hit->distance = t;
+    hit->u = u;
+    hit->v = v;
+    return true;
+  }
+
+  template <bool AnyHit>
+  bool traverse(KFlatTree const &tree, KFlatRay const &ray, float tMax, KRayHit *hit)
+  {
+    if (tree.empty()) return false;
+    bool found = false;
+    KFlatNode const *nodes = tree.nodes().data();
+    uint32_t const *indices = tree.indices().data();
+    KVector3D const *points = tree.points().data();
+
+    float tNear;
+    size_t top = 0;
+    size_t stackSize = tree.traversalStackSize();
+    KFlatStack stack(stackSize);
+    if (!intersectNode(ray, nodes[0], tMax, &tNear)) return false;
+    stack[top++] = { 0, tNear };
+    while (top > 0)
+    {
+      KFlatStackEntry entry = stack[--top];
+      if (entry.tNear > tMax) continue;
+      KFlatNode const &node = nodes[entry.node];
+      if (node.isLeaf())
+      {
+        for (uint32_t triangle = node.offset; triangle != node.offset + node.count; ++triangle)
+        {
+          uint32_t const *index = &indices[3 * triangle];
+          if (intersectTriangle(ray, points[index[0]], points[index[1]], points[index[2]], tMax, hit))
+          {
+            if (AnyHit) return true;
+            hit->triangle = triangle;
+            tMax = hit->distance;
+            found = true;
+          }
+        }
+        continue;
+      }
+
+      size_t first = top;
+      uint32_t end = entry.node + node.offset;
+      for (uint32_t child = entry.node + 1; child < end; child += nodes[child].subtreeSize())
+      {
+        if (intersectNode(ray, nodes[child], tMax, &tNear))
+        {
+          Q_ASSERT(top < stackSize);
+          stack[top++] = { child, tNear };
+        }
+      }
+      sortFarToNear(stack.data() + first, stack.data() + top);
+    }
+    return found;
+  }
+
+#ifdef __SSE2__
+  inline __m128 select(__m128 mask, __m128 a, __m128 b)
+  {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+#endif
+
+}
+
+/*******************************************************************************
+ * KFlatTree
+ ******************************************************************************/
+/*******************************************************************************
+ * Refit Helpers
+ ******************************************************************************/
+namespace
+{
+
+  inline void fitLeaf(KFlatNode &node, uint32_t const *indices, KVector3D const *points)
+  {
+    node.min[0] = node.min[1] = node.min[2] = std::numeric_limits<float>::max();
+    node.max[0] = node.max[1] = node.max[2] = -std::numeric_limits<float>::max();
+    for (uint32_t const *it = indices + 3 * node.offset, *end = it + 3 * node.count; it != end; ++it)
+    {
+      KVector3D const &p = points[*it];
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        node.min[axis] = std::min(node.min[axis], p[axis]);
+        node.max[axis] = std::max(node.max[axis], p[axis]);
+      }
+    }
+  }
+
+  // The bounds of an inner node are the union of its direct children
+  inline void fitInner(KFlatNode *nodes, size_t index)
+  {
+    KFlatNode &node = nodes[index];
+    node.min[0] = node.min[1] = node.min[2] = std::numeric_limits<float>::max();
+    node.max[0] = node.max[1] = node.max[2] = -std::numeric_limits<float>::max();
+    for (size_t child = index + 1; child < index + node.offset; child += nodes[child].subtreeSize())
+    {
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        node.min[axis] = std::min(node.min[axis], nodes[child].min[axis]);
+        node.max[axis] = std::max(node.max[axis], nodes[child].max[axis]);
+      }
+    }
+  }
+
+}
+
+KFlatTree::KFlatTree() :
+  m_traversalStackSize(0)
+{
+  // Intentionally Empty
+}
+
+void KFlatTree::clear()
+{
+  m_nodes.clear();
+  m_indices.clear();
+  m_points.clear();
+  m_traversalStackSize = 0;
+  m_levelNodes.clear();
+  m_levelOffsets.clear();
+}
+
+void KFlatTree::setPoints(KPointCloud const &cloud)
+{
+  m_points.resize(cloud.size());
+  for (size_t i = 0; i < cloud.size(); ++i)
+  {
+    m_points[i] = cloud[i];
+  }
+}
+
+size_t KFlatTree::beginNode()
+{
+  KFlatNode node = KFlatNode();
+  m_nodes.push_back(node);
+  return m_nodes.size() - 1;
+}
+
+bool KFlatTree::endNode(size_t index)
+{
+  // Inner nodes without any (non-empty) children are dropped
+  uint32_t subtree = static_cast<uint32_t>(m_nodes.size() - index);
+  if (subtree == 1)
+  {
+    m_nodes.pop_back();
+    return false;
+  }
+
+  m_nodes[index].offset = subtree;
+  m_nodes[index].count = 0;
+  fitInner(m_nodes.data(), index);
+  if (index == 0) m_traversalStackSize = requiredStackSize(m_nodes.data(), m_nodes.size());
+  return true;
+}
+
+void KFlatTree::refit()
+{
+  // Small trees are refit serially, back to front (Children always follow their parent)
+  KFlatNode *nodes = m_nodes.data();
+  if (m_nodes.size() < Karma::ParallelGrainSize)
+  {
+    for (size_t node = m_nodes.size(); node-- > 0;)
+    {
+      if (nodes[node].isLeaf())
+        fitLeaf(nodes[node], m_indices.data(), m_points.data());
+      else
+        fitInner(nodes, node);
+    }
+    return;
+  }
+
+  // Group the nodes by depth (depth-first order only tells us where subtrees end)
+  if (m_levelOffsets.empty() && !m_nodes.empty())
+  {
+    std::vector<uint32_t> depths(m_nodes.size());
+    std::vector<size_t> subtreeEnds;
+    for (size_t node = 0; node < m_nodes.size(); ++node)
+    {
+      while (!subtreeEnds.empty() && subtreeEnds.back() <= node) subtreeEnds.pop_back();
+      depths[node] = static_cast<uint32_t>(subtreeEnds.size());
+      if (!m_nodes[node].isLeaf()) subtreeEnds.push_back(node + m_nodes[node].offset);
+    }
+    m_levelOffsets.assign(*std::max_element(depths.begin(), depths.end()) + 2, 0);
+    for (uint32_t depth : depths) ++m_levelOffsets[depth + 1];
+    for (size_t level = 1; level < m_levelOffsets.size(); ++level) m_levelOffsets[level] += m_levelOffsets[level - 1];
+    std::vector<size_t> cursor(m_levelOffsets.begin(), m_levelOffsets.end() - 1);
+    m_levelNodes.resize(m_nodes.size());
+    for (size_t node = 0; node < m_nodes.size(); ++node) m_levelNodes[cursor[depths[node]]++] = static_cast<uint32_t>(node);
+  }
+
+  // Deepest level first, nodes within a level don't depend on each other.
+  // Levels below the grain size run on the calling thread.
+  for (size_t level = m_levelOffsets.size() - 1; level-- > 0;)
+  {
+    uint32_t const *levelNodes = m_levelNodes.data() + m_levelOffsets[level];
+    Karma::parallelFor(m_levelOffsets[level + 1] - m_levelOffsets[level], [&](size_t begin, size_t end)
+    {
+      for (size_t i = begin; i < end; ++i)
+      {
+        uint32_t node = levelNodes[i];
+        if (nodes[node].isLeaf())
+          fitLeaf(nodes[node], m_indices.data(), m_points.data());
+        else
+          fitInner(nodes, node);
+      }
+    });
+  }
+}
+
+static_assert(sizeof(KVector3D) == 3 * sizeof(float), "Points are written to disk as-is.");
+static const char FlatTreeMagic[4] = { 'K', 'F', 'L', 'T' };
+
+// Loaded trees are traversed without bounds checks, so every node and index has to stay within its arrays.
+static bool validTopology(KFlatNode const *nodes, uint64_t nodeCount, uint32_t const *indices, uint64_t indexCount, uint64_t pointCount)
+{
+  if (indexCount % 3 != 0) return false;
+  for (uint64_t i = 0; i < indexCount; ++i)
+  {
+    if (indices[i] >= pointCount) return false;
+  }
+  if (nodeCount == 0) return true;
+  if (nodes[0].subtreeSize() != nodeCount) return false;
+
+  // Children of an inner node have to tile its subtree exactly
+  uint64_t triangleCount = indexCount / 3;
+  for (uint64_t i = 0; i < nodeCount; ++i)
+  {
+    KFlatNode const &node = nodes[i];
+    if (node.isLeaf())
+    {
+      if (static_cast<uint64_t>(node.offset) + node.count > triangleCount) return false;
+      continue;
+    }
+    uint64_t end = i + node.offset;
+    if (node.offset < 2 || end > nodeCount) return false;
+    uint64_t child = i + 1;
+    while (child < end) child += nodes[child].subtreeSize();
+    if (child != end) return false;
+  }
+  return true;
+}
+
+bool KFlatTree::save(char const *filename, KFlatTreeHeader const &header, std::vector<char> const &extra) const
+{
+  KFlatTreeHeader written = header;
+  std::memcpy(written.magic, FlatTreeMagic, sizeof(FlatTreeMagic));
+  written.version = KFlatTreeHeader::CurrentVersion;
+  written.reserved = 0;
+  written.nodeCount = m_nodes.size();
+  written.indexCount = m_indices.size();
+  written.pointCount = m_points.size();
+  written.extraSize = extra.size();
+
+  QFile file(filename);
+  if (!file.open(QFile::WriteOnly | QFile::Truncate)) return false;
+  auto write = [&file](void const *data, size_t size) -> bool
+  {
+    return size == 0 || file.write(static_cast<char const*>(data), static_cast<qint64>(size)) == static_cast<qint64>(size);
+  };
+  return write(&written, sizeof(written)) &&
+         write(m_nodes.data(), m_nodes.size() * sizeof(KFlatNode)) &&
+         write(m_indices.data(), m_indices.size() * sizeof(uint32_t)) &&
+         write(m_points.data(), m_points.size() * sizeof(KVector3D)) &&
+         write(extra.data(), extra.size());
+}
+
+bool KFlatTree::load(char const *filename, KFlatTreeHeader *header, std::vector<char> *extra)
+{
+  QFile file(filename);
+  if (!file.open(QFile::ReadOnly)) return false;
+  qint64 fileSize = file.size();
+  if (fileSize < static_cast<qint64>(sizeof(KFlatTreeHeader))) return false;
+  uchar const *data = file.map(0, fileSize);
+  if (!data) return false;
+
+  // Anything which doesn't describe the expected tree, or the file's size, is rejected.
+  // Counts are untrusted, each is bounded by the bytes left before multiplying so sizes can't wrap.
+  KFlatTreeHeader stored;
+  std::memcpy(&stored, data, sizeof(stored));
+  uint64_t remaining = static_cast<uint64_t>(fileSize) - sizeof(KFlatTreeHeader);
+  auto consume = [&remaining](uint64_t count, uint64_t elementSize) -> bool
+  {
+    if (count > remaining / elementSize) return false;
+    remaining -= count * elementSize;
+    return true;
+  };
+  bool valid =
+    std::memcmp(stored.magic, FlatTreeMagic, sizeof(FlatTreeMagic)) == 0 &&
+    stored.version == KFlatTreeHeader::CurrentVersion &&
+    stored.structure == header->structure &&
+    stored.buildMethod == header->buildMethod &&
+    stored.parameters == header->parameters &&
+    stored.sourceHash == header->sourceHash &&
+    consume(stored.nodeCount, sizeof(KFlatNode)) &&
+    consume(stored.indexCount, sizeof(uint32_t)) &&
+    consume(stored.pointCount, sizeof(KVector3D)) &&
+    consume(stored.extraSize, 1) &&
+    remaining == 0;
+  if (!valid) return false;
+
+  // Arrays are stored contiguously, so every one of them is a single copy
+  uchar const *cursor = data + sizeof(KFlatTreeHeader);
+  KFlatNode const *nodes = reinterpret_cast<KFlatNode const*>(cursor);
+  cursor += stored.nodeCount * sizeof(KFlatNode);
+  uint32_t const *indices = reinterpret_cast<uint32_t const*>(cursor);
+  cursor += stored.indexCount * sizeof(uint32_t);
+  KVector3D const *points = reinterpret_cast<KVector3D const*>(cursor);
+  cursor += stored.pointCount * sizeof(KVector3D);
+  if (!validTopology(nodes, stored.nodeCount, indices, stored.indexCount, stored.pointCount)) return false;
+  clear();
+  m_nodes.assign(nodes, nodes + stored.nodeCount);
+  m_indices.assign(indices, indices + stored.indexCount);
+  m_points.assign(points, points + stored.pointCount);
+  m_traversalStackSize = requiredStackSize(m_nodes.data(), m_nodes.size());
+  if (extra) extra->assign(cursor, cursor + stored.extraSize);
+  *header = stored;
+  return true;
+}
+
+bool KFlatTree::raycast(KVector3D const &origin, KVector3D const &direction, float tMax, KRayHit *hit) const
+{
+  KRayHit result;
+  if (!traverse<false>(*this, KFlatRay(origin, direction), tMax, &result)) return false;
+  if (hit) *hit = result;
+  return true;
+}
+
+bool KFlatTree::occluded(KVector3D const &origin, KVector3D const &direction, float tMax) const
+{
+  KRayHit result;
+  return traverse<true>(*this, KFlatRay(origin, direction), tMax, &result);
+}
+
+// Returns a bitmask of the rays which hit anything, only their hits are written.
+int KFlatTree::raycast(KRayPacket const &packet, KRayHit *hits) const
+{
+  int hitMask = 0;
+#ifdef __SSE2__
+  __m128 origin[3], direction[3], invDirection[3];
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    origin[axis] = _mm_loadu_ps(packet.origin[axis]);
+    direction[axis] = _mm_loadu_ps(packet.direction[axis]);
+    invDirection[axis] = _mm_div_ps(_mm_set1_ps(1.0f), direction[axis]);
+  }
+  __m128 const zero = _mm_setzero_ps();
+  __m128 const one = _mm_set1_ps(1.0f);
+  __m128 tMax = _mm_loadu_ps(packet.tMax);
+  __m128 hitU = zero, hitV = zero;
+  uint32_t hitTriangle[KRayPacket::Width];
+
+  // Slab test for all rays, returns the nearest entry of any ray which hits the node
+  auto intersectPacket = [&](KFlatNode const &node, float *tEntry) -> bool
+  {
+    __m128 tNear = zero, tFar = tMax;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min[axis]), origin[axis]), invDirection[axis]);
+      __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max[axis]), origin[axis]), invDirection[axis]);
+      tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+      tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+    }
+    __m128 hit = _mm_cmple_ps(tNear, tFar);
+    if (_mm_movemask_ps(hit) == 0) return false;
+    float entries[KRayPacket::Width];
+    _mm_storeu_ps(entries, select(hit, tNear, _mm_set1_ps(std::numeric_limits<float>::infinity())));
+    *tEntry = std::min(std::min(entries[0], entries[1]), std::min(entries[2], entries[3]));
+    return true;
+  };
+
+  float tNear;
+  size_t top = 0;
+  KFlatStack stack(m_traversalStackSize);
+  if (!m_nodes.empty() && intersectPacket(m_nodes[0], &tNear))
+  {
+    stack[top++] = { 0, tNear };
+  }
+  while (top > 0)
+  {
+    // Subtrees are only skipped once every ray found a closer hit, or misses the node now
+    KFlatStackEntry entry = stack[--top];
+    KFlatNode const &node = m_nodes[entry.node];
+    if (!intersectPacket(node, &tNear)) continue;
+    if (!node.isLeaf())
+    {
+      size_t first = top;
+      uint32_t end = entry.node + node.offset;
+      for (uint32_t child = entry.node + 1; child < end; child += m_nodes[child].subtreeSize())
+      {
+        if (intersectPacket(m_nodes[child], &tNear))
+        {
+          Q_ASSERT(top < m_traversalStackSize);
+          stack[top++] = { child, tNear };
+        }
+      }
+      sortFarToNear(stack.data() + first, stack.data() + top);
+      continue;
+    }
+
+    // Moller-Trumbore against one triangle at a time, four rays wide
+    for (uint32_t triangle = node.offset; triangle != node.offset + node.count; ++triangle)
+    {
+      uint32_t const *index = &m_indices[3 * triangle];
+      KVector3D const &p0 = m_points[index[0]];
+      KVector3D const e1v = m_points[index[1]] - p0;
+      KVector3D const e2v = m_points[index[2]] - p0;
+      __m128 e1[3] = { _mm_set1_ps(e1v.x()), _mm_set1_ps(e1v.y()), _mm_set1_ps(e1v.z()) };
+      __m128 e2[3] = { _mm_set1_ps(e2v.x()), _mm_set1_ps(e2v.y()), _mm_set1_ps(e2v.z()) };
+      __m128 pvec[3] =
+      {
+        _mm_sub_ps(_mm_mul_ps(direction[1], e2[2]), _mm_mul_ps(direction[2], e2[1])),
+        _mm_sub_ps(_mm_mul_ps(direction[2], e2[0]), _mm_mul_ps(direction[0], e2[2])),
+        _mm_sub_ps(_mm_mul_ps(direction[0], e2[1]), _mm_mul_ps(direction[1], e2[0]))
+      };
+      __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], pvec[0]), _mm_mul_ps(e1[1], pvec[1])), _mm_mul_ps(e1[2], pvec[2]));
+      __m128 invDet = _mm_div_ps(one, det);
+      __m128 tvec[3] =
+      {
+        _mm_sub_ps(origin[0], _mm_set1_ps(p0.x())),
+        _mm_sub_ps(origin[1], _mm_set1_ps(p0.y())),
+        _mm_sub_ps(origin[2], _mm_set1_ps(p0.z()))
+      };
+      __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tvec[0], pvec[0]), _mm_mul_ps(tvec[1], pvec[1])), _mm_mul_ps(tvec[2], pvec[2])), invDet);
+      __m128 qvec[3] =
+      {
+        _mm_sub_ps(_mm_mul_ps(tvec[1], e1[2]), _mm_mul_ps(tvec[2], e1[1])),
+        _mm_sub_ps(_mm_mul_ps(tvec[2], e1[0]), _mm_mul_ps(tvec[0], e1[2])),
+        _mm_sub_ps(_mm_mul_ps(tvec[0], e1[1]), _mm_mul_ps(tvec[1], e1[0]))
+      };
+      __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(direction[0], qvec[0]), _mm_mul_ps(direction[1], qvec[1])), _mm_mul_ps(direction[2], qvec[2])), invDet);
+      __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], qvec[0]), _mm_mul_ps(e2[1], qvec[1])), _mm_mul_ps(e2[2], qvec[2])), invDet);
+
+      // Note: A zero determinant yields NaNs, which fail every comparison
+      __m128 valid = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+      valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+      valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, tMax)));
+      int mask = _mm_movemask_ps(valid);
+      if (mask == 0) continue;
+
+      tMax = select(valid, t, tMax);
+      hitU = select(valid, u, hitU);
+      hitV = select(valid, v, hitV);
+      for (int ray = 0; ray < KRayPacket::Width; ++ray)
+      {
+        if (mask & (1 << ray)) hitTriangle[ray] = triangle;
+      }
+      hitMask |= mask;
+    }
+  }
+
+
+  float distances[KRayPacket::Width], us[KRayPacket::Width], vs[KRayPacket::Width];
+  _mm_storeu_ps(distances, tMax);
+  _mm_storeu_ps(us, hitU);
+  _mm_storeu_ps(vs, hitV);
+  for (int ray = 0; ray < KRayPacket::Width; ++ray)
+  {
+    if (!(hitMask & (1 << ray))) continue;
+    hits[ray].distance = distances[ray];
+    hits[ray].u = us[ray];
+    hits[ray].v = vs[ray];
+    hits[ray].triangle = hitTriangle[ray];
+  }
+#else
+  for (int ray = 0; ray < KRayPacket::Width; ++ray)
+  {
+    KVector3D origin(packet.origin[0][ray], packet.origin[1][ray], packet.origin[2][ray]);
+    KVector3D direction(packet.direction[0][ray], packet.direction[1][ray], packet.direction[2][ray]);
+    if (raycast(origin, direction, packet.tMax[ray], &hits[ray])) hitMask |= (1 << ray);
+  }
+#endif
+  return hitMask;
+}
+
+// Reference implementation testing every triangle, for validation and benchmarks.
+bool KFlatTree::raycastBruteForce(KVector3D const &origin, KVector3D const &direction, float tMax, KRayHit *hit) const
+{
+  bool found = false;
+  KRayHit result;
+  KFlatRay ray(origin, direction);
+  for (uint32_t triangle = 0; triangle < triangleCount(); ++triangle)
+  {
+    uint32_t const *index = &m_indices[3 * triangle];
+    if (intersectTriangle(ray, m_points[index[0]], m_points[index[1]], m_points[index[2]], tMax, &result))
+    {
+      result.triangle = triangle;
+      tMax = result.distance;
+      found = true;
+    }
+  }
+  if (found && hit) *hit = result;
+  return found;
+}
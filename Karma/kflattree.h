@@ -0,0 +1,232 @@
+#ifndef KFLATTREE_H
+#define KFLATTREE_H KFlatTree
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <KVector3D>
+
+class KPointCloud;
+
+// A node of a flattened hierarchy, nodes are stored in depth-first order.
+// The first child of an inner node is always the node directly after it, the
+// next sibling is found by skipping over the subtree (`offset` nodes ahead).
+// Since offsets are relative, subtrees can be moved around without fixups.
+struct KFlatNode
+{
+  float min[3];
+  float max[3];
+  uint32_t offset;  // Leaf: first triangle in the index array. Inner: size of the subtree.
+  uint32_t count;   // Leaf: number of triangles (never 0). Inner: 0.
+
+  bool isLeaf() const;
+  uint32_t subtreeSize() const;
+};
+
+static_assert(sizeof(KFlatNode) == 32, "KFlatNode is expected to fill half a cache line.");
+
+inline bool KFlatNode::isLeaf() const
+{
+  return count != 0;
+}
+
+inline uint32_t KFlatNode::subtreeSize() const
+{
+  return (count != 0) ? 1 : offset;
+}
+
+// Header of a saved tree, the arrays follow it as they are laid out in memory.
+// Whoever owns the tree decides whether a file still matches its source geometry.
+struct KFlatTreeHeader
+{
+  enum Structure
+  {
+    BoundingVolumeHierarchy = 1,
+    AdaptiveOctree,
+    BspTree
+  };
+  static const uint32_t CurrentVersion = 1;
+
+  char magic[4];
+  uint32_t version;
+  uint32_t structure;
+  uint32_t buildMethod;
+  uint32_t parameters;  // Caller defined build settings (e.g. of the termination predicate)
+  uint32_t depth;
+  uint64_t sourceHash;  // See KGeometryCloud::hash()
+  float cost;
+  uint32_t reserved;
+  uint64_t nodeCount;
+  uint64_t indexCount;
+  uint64_t pointCount;
+  uint64_t extraSize;   // Owner specific data after the points
+};
+
+static_assert(sizeof(KFlatTreeHeader) == 72, "KFlatTreeHeader is written to disk as-is.");
+
+// Closest intersection along a ray, `triangle` indexes the index array in triples.
+struct KRayHit
+{
+  float distance;
+  float u, v;  // Barycentrics of the second and third vertex
+  uint32_t triangle;
+};
+
+// Rays in structure-of-arrays layout, traversed together as a packet.
+struct KRayPacket
+{
+  enum { Width = 4 };
+  float origin[3][Width];
+  float direction[3][Width];
+  float tMax[Width];
+};
+
+class KFlatTree
+{
+public:
+  typedef std::vector<KFlatNode> NodeContainer;
+  typedef std::vector<uint32_t> IndexContainer;
+  typedef std::vector<KVector3D> PointContainer;
+
+  KFlatTree();
+
+  // Construction (Depth-first, inner nodes are closed after their children are added)
+  void clear();
+  void setPoints(KPointCloud const &cloud);
+  size_t beginNode();
+  bool endNode(size_t node);
+  template <typename It>
+  bool addLeaf(It begin, It end, size_t indexBase = 0);
+
+  // Refitting (Bounds follow the current points, the hierarchy itself is kept)
+  void refit();
+
+  // Serialization (Loading maps the file and copies the arrays in bulk)
+  // `header` holds the expected structure, build method, parameters and source hash,
+  // which have to match the file; on success it's replaced by the file's header.
+  bool save(char const *filename, KFlatTreeHeader const &header, std::vector<char> const &extra = std::vector<char>()) const;
+  bool load(char const *filename, KFlatTreeHeader *header, std::vector<char> *extra = 0);
+
+  // Query
+  bool empty() const;
+  size_t size() const;
+  size_t triangleCount() const;
+  size_t memoryUsage() const;
+  NodeContainer const &nodes() const;
+  IndexContainer const &indices() const;
+  PointContainer const &points() const;
+  size_t traversalStackSize() const;
+  template <typename F>
+  void forEachLeaf(KVector3D const &min, KVector3D const &max, F f) const;
+
+  // Ray Queries (Directions needn't be normalized, distances are in units of the direction)
+  bool raycast(KVector3D const &origin, KVector3D const &direction, float tMax, KRayHit *hit) const;
+  bool occluded(KVector3D const &origin, KVector3D const &direction, float tMax) const;
+  int raycast(KRayPacket const &packet, KRayHit *hits) const;
+  bool raycastBruteForce(KVector3D const &origin, KVector3D const &direction, float tMax, KRayHit *hit) const;
+
+private:
+  NodeContainer m_nodes;
+  IndexContainer m_indices;
+  PointContainer m_points;
+  size_t m_traversalStackSize;  // Deepest stack a traversal needs, known once the root is added
+
+  // Nodes grouped by depth for refitting, collected on first use
+  std::vector<uint32_t> m_levelNodes;
+  std::vector<size_t> m_levelOffsets;
+};
+
+// Adds a leaf over three point indices per triangle, empty leaves are dropped.
+// Reminder: `indexBase` is 1 for indices taken from a KTriangleIndexCloud.
+template <typename It>
+bool KFlatTree::addLeaf(It begin, It end, size_t indexBase)
+{
+  KFlatNode node;
+  node.offset = static_cast<uint32_t>(m_indices.size() / 3);
+  node.min[0] = node.min[1] = node.min[2] = std::numeric_limits<float>::max();
+  node.max[0] = node.max[1] = node.max[2] = -std::numeric_limits<float>::max();
+  for (; begin != end; ++begin)
+  {
+    uint32_t index = static_cast<uint32_t>(*begin - indexBase);
+    KVector3D const &p = m_points[index];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      node.min[axis] = std::min(node.min[axis], p[axis]);
+      node.max[axis] = std::max(node.max[axis], p[axis]);
+    }
+    m_indices.push_back(index);
+  }
+  node.count = static_cast<uint32_t>(m_indices.size() / 3) - node.offset;
+  if (node.count == 0) return false;
+  m_nodes.push_back(node);
+  if (m_nodes.size() == 1) m_traversalStackSize = 1;
+  return true;
+}
+
+inline bool KFlatTree::empty() const
+{
+  return m_nodes.empty();
+}
+
+inline size_t KFlatTree::size() const
+{
+  return m_nodes.size();
+}
+
+inline size_t KFlatTree::triangleCount() const
+{
+  return m_indices.size() / 3;
+}
+
+inline size_t KFlatTree::memoryUsage() const
+{
+  return m_nodes.size() * sizeof(KFlatNode) + m_indices.size() * sizeof(uint32_t) + m_points.size() * sizeof(KVector3D);
+}
+
+inline auto KFlatTree::nodes() const -> NodeContainer const&
+{
+  return m_nodes;
+}
+
+inline auto KFlatTree::indices() const -> IndexContainer const&
+{
+  return m_indices;
+}
+
+inline auto KFlatTree::points() const -> PointContainer const&
+{
+  return m_points;
+}
+
+inline size_t KFlatTree::traversalStackSize() const
+{
+  return m_traversalStackSize;
+}
+
+// Stackless traversal, calls `f(KFlatNode const&)` for every leaf overlapping [min, max].
+template <typename F>
+void KFlatTree::forEachLeaf(KVector3D const &min, KVector3D const &max, F f) const
+{
+  KFlatNode const *node = m_nodes.data();
+  KFlatNode const *end = node + m_nodes.size();
+  while (node < end)
+  {
+    bool overlaps =
+      node->min[0] <= max.x() && node->max[0] >= min.x() &&
+      node->min[1] <= max.y() && node->max[1] >= min.y() &&
+      node->min[2] <= max.z() && node->max[2] >= min.z();
+    if (!overlaps)
+    {
+      node += node->subtreeSize();
+    }
+    else
+    {
+      if (node->isLeaf()) f(*node);
+      ++node;
+    }
+  }
+}
+
+#endif // KFLATTREE_H
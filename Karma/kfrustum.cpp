@@ -1,8 +1,108 @@
 #include "kfrustum.h"
 
+#include <KAabbArray>
 #include <KVector4D>
 #include <KMatrix4x4>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*******************************************************************************
+ * KFrustum Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Planes as plain arrays, ready to be broadcast into every lane
+  struct KFrustumPlanes
+  {
+    float normal[6][3];
+    float dTerm[6];
+  };
+
+  // One box per lane, the SIMD types below provide the same operations on more lanes.
+  struct KFrustumScalar
+  {
+    typedef float Vec;
+    static const int Width = 1;
+    static Vec load(float const *p) { return *p; }
+    static Vec set1(float v) { return v; }
+    static Vec mul(Vec a, Vec b) { return a * b; }
+    static Vec add(Vec a, Vec b) { return a + b; }
+    static Vec max(Vec a, Vec b) { return (a > b) ? a : b; }
+    static int behind(Vec dist) { return (dist < 0.0f) ? 1 : 0; }
+  };
+
+#if defined(__AVX__)
+  struct KFrustumSimd
+  {
+    typedef __m256 Vec;
+    static const int Width = 8;
+    static Vec load(float const *p) { return _mm256_loadu_ps(p); }
+    static Vec set1(float v) { return _mm256_set1_ps(v); }
+    static Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+    static Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+    static Vec max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+    static int behind(Vec dist) { return _mm256_movemask_ps(_mm256_cmp_ps(dist, _mm256_setzero_ps(), _CMP_LT_OQ)); }
+  };
+#elif defined(__SSE2__)
+  struct KFrustumSimd
+  {
+    typedef __m128 Vec;
+    static const int Width = 4;
+    static Vec load(float const *p) { return _mm_loadu_ps(p); }
+    static Vec set1(float v) { return _mm_set1_ps(v); }
+    static Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+    static Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+    static Vec max(Vec a, Vec b) { return _mm_max_ps(a, b); }
+    static int behind(Vec dist) { return _mm_movemask_ps(_mm_cmplt_ps(dist, _mm_setzero_ps())); }
+  };
+#endif
+
+  // Distance of the corner furthest along the normal, summed in the same order as KPlane::dot()
+  template <typename Simd>
+  inline typename Simd::Vec furthestDistance(typename Simd::Vec const min[3], typename Simd::Vec const max[3], typename Simd::Vec const normal[3], typename Simd::Vec dTerm)
+  {
+    typename Simd::Vec dist = Simd::max(Simd::mul(normal[0], min[0]), Simd::mul(normal[0], max[0]));
+    dist = Simd::add(dist, Simd::max(Simd::mul(normal[1], min[1]), Simd::mul(normal[1], max[1])));
+    dist = Simd::add(dist, Simd::max(Simd::mul(normal[2], min[2]), Simd::mul(normal[2], max[2])));
+    return Simd::add(dist, dTerm);
+  }
+
+  // Returns a bit per lane whose box is outside. Neighbouring boxes tend to be rejected by the
+  // same plane, so planes are visited starting with the one which last rejected the first box
+  // of the batch (only its entry of the cache is kept), and only while some box could still be visible.
+  template <typename Simd>
+  inline int cullBatch(KFrustumPlanes const &planes, float const *const min[3], float const *const max[3], size_t index, uint8_t *planeCache)
+  {
+    typedef typename Simd::Vec Vec;
+    static const int AllLanes = (1 << Simd::Width) - 1;
+    Vec lo[3], hi[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      lo[axis] = Simd::load(min[axis] + index);
+      hi[axis] = Simd::load(max[axis] + index);
+    }
+
+    int outside = 0;
+    int first = planeCache ? planeCache[index] % 6 : 0, rejecting = first;
+    for (int i = 0; i < 6 && outside != AllLanes; ++i)
+    {
+      int plane = (first + i < 6) ? first + i : first + i - 6;
+      Vec normal[3] = { Simd::set1(planes.normal[plane][0]), Simd::set1(planes.normal[plane][1]), Simd::set1(planes.normal[plane][2]) };
+      int rejected = Simd::behind(furthestDistance<Simd>(lo, hi, normal, Simd::set1(planes.dTerm[plane]))) & ~outside;
+      if (rejected & 1) rejecting = plane;
+      outside |= rejected;
+    }
+    if (planeCache && rejecting != first) planeCache[index] = static_cast<uint8_t>(rejecting);
+    return outside;
+  }
+
+}
+
 KFrustum::KFrustum()
 {
   // Intentionally Empty
@@ -65,21 +165,104 @@ void KFrustum::setFrustum(const KMatrix4x4 &viewProj)
 }
 
 bool KFrustum::intersects(const KAabbBoundingVolume &aabb) const
+{
+  // The box is behind a plane exactly when the corner furthest along its normal is
+  int planeMask = AllPlanes;
+  return intersects(aabb.minExtent(), aabb.maxExtent(), &planeMask);
+}
+
+bool KFrustum::intersects(const KVector3D &center, float radius) const
 {
   for (int i = 0; i < 6; ++i)
   {
-    if (m_planes[i].pointInBack(aabb.point(0)) &&
-        m_planes[i].pointInBack(aabb.point(1)) &&
-        m_planes[i].pointInBack(aabb.point(2)) &&
-        m_planes[i].pointInBack(aabb.point(3)) &&
-        m_planes[i].pointInBack(aabb.point(4)) &&
-        m_planes[i].pointInBack(aabb.point(5)) &&
-        m_planes[i].pointInBack(aabb.point(6)) &&
-        m_planes[i].pointInBack(aabb.point(7))
-        )
+    if (m_planes[i].dot(center) < -radius)
     {
       return false;
     }
   }
   return true;
 }
+
+bool KFrustum::intersects(const KVector3D &minExtent, const KVector3D &maxExtent, int *planeMask) const
+{
+  for (int i = 0; i < 6; ++i)
+  {
+    if (!(*planeMask & (1 << i))) continue;
+
+    // Test the corners furthest along (positive) and against (negative) the normal
+    KVector3D const &normal = m_planes[i].normal();
+    KVector3D positive(
+      (normal.x() >= 0.0f) ? maxExtent.x() : minExtent.x(),
+      (normal.y() >= 0.0f) ? maxExtent.y() : minExtent.y(),
+      (normal.z() >= 0.0f) ? maxExtent.z() : minExtent.z()
+    );
+    if (m_planes[i].pointInBack(positive))
+    {
+      return false;
+    }
+    KVector3D negative(
+      (normal.x() >= 0.0f) ? minExtent.x() : maxExtent.x(),
+      (normal.y() >= 0.0f) ? minExtent.y() : maxExtent.y(),
+      (normal.z() >= 0.0f) ? minExtent.z() : maxExtent.z()
+    );
+    if (!m_planes[i].pointInBack(negative))
+    {
+      *planeMask &= ~(1 << i);
+    }
+  }
+  return true;
+}
+
+KFrustum::Containment KFrustum::classify(const KVector3D &minExtent, const KVector3D &maxExtent) const
+{
+  int planeMask = AllPlanes;
+  if (!intersects(minExtent, maxExtent, &planeMask)) return Outside;
+  return (planeMask == 0) ? Inside : Intersecting;
+}
+
+KFrustum::Containment KFrustum::classify(const KAabbBoundingVolume &aabb) const
+{
+  return classify(aabb.minExtent(), aabb.maxExtent());
+}
+
+size_t KFrustum::cullBatchSize()
+{
+#if defined(__AVX__) || defined(__SSE2__)
+  return KFrustumSimd::Width;
+#else
+  return KFrustumScalar::Width;
+#endif
+}
+
+size_t KFrustum::cull(const KAabbArray &boxes, uint8_t *visibleMask, uint8_t *planeCache) const
+{
+  KFrustumPlanes planes;
+  for (int i = 0; i < 6; ++i)
+  {
+    for (int axis = 0; axis < 3; ++axis) planes.normal[i][axis] = m_planes[i].normal()[axis];
+    planes.dTerm[i] = m_planes[i].dot(KVector3D(0.0f, 0.0f, 0.0f));
+  }
+  float const *min[3] = { boxes.minData(0), boxes.minData(1), boxes.minData(2) };
+  float const *max[3] = { boxes.maxData(0), boxes.maxData(1), boxes.maxData(2) };
+
+  size_t count = boxes.size(), visible = 0, i = 0;
+#if defined(__AVX__) || defined(__SSE2__)
+  for (; i + KFrustumSimd::Width <= count; i += KFrustumSimd::Width)
+  {
+    int outside = cullBatch<KFrustumSimd>(planes, min, max, i, planeCache);
+    for (int lane = 0; lane < KFrustumSimd::Width; ++lane)
+    {
+      uint8_t inside = static_cast<uint8_t>(((outside >> lane) & 1) ^ 1);
+      visibleMask[i + lane] = inside;
+      visible += inside;
+    }
+  }
+#endif
+  for (; i < count; ++i)
+  {
+    uint8_t inside = static_cast<uint8_t>(cullBatch<KFrustumScalar>(planes, min, max, i, planeCache) ^ 1);
+    visibleMask[i] = inside;
+    visible += inside;
+  }
+  return visible;
+}
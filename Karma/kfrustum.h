@@ -1,7 +1,10 @@
 #ifndef KFRUSTUM_H
 #define KFRUSTUM_H KFrustum
 
+class KAabbArray;
 class KMatrix4x4;
+#include <cstddef>
+#include <cstdint>
 #include <KPlane>
 #include <KAabbBoundingVolume>
 
@@ -13,6 +16,25 @@ public:
   void setFrustum(KMatrix4x4 const &viewProj);
 
   bool intersects(KAabbBoundingVolume const &aabb) const;
+  bool intersects(KVector3D const &center, float radius) const;
+
+  // Hierarchical culling: planes the volume is fully inside of are cleared from `planeMask`,
+  // so contained children needn't test them again (the volume is contained once it's 0).
+  enum { AllPlanes = 0x3F };
+  bool intersects(KVector3D const &minExtent, KVector3D const &maxExtent, int *planeMask) const;
+
+  // Boxes only test the corners furthest along (and against) each plane's normal
+  enum Containment { Outside, Intersecting, Inside };
+  Containment classify(KVector3D const &minExtent, KVector3D const &maxExtent) const;
+  Containment classify(KAabbBoundingVolume const &aabb) const;
+
+  // Batched culling, sets `visibleMask[i]` to 1 for every box not outside (returns how many).
+  // `planeCache` (Sized like the boxes, zero-initialized is fine) optionally remembers which plane
+  // rejected boxes last time, later calls test that plane first. Boxes are tested in batches of
+  // cullBatchSize() which share one entry: only every cullBatchSize()-th entry is used, except for
+  // the boxes after the last full batch. Neighbouring boxes should be spatially close to benefit.
+  size_t cull(KAabbArray const &boxes, uint8_t *visibleMask, uint8_t *planeCache = 0) const;
+  static size_t cullBatchSize();
 
 private:
   KPlane m_planes[6];
@@ -1,12 +1,66 @@
 #include "kgeometrycloud.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
 #include <KHalfEdgeMesh>
 #include <KMacros>
 #include <KMatrix4x4>
+#include <KParallel>
 #include <KPointCloud>
 #include <KTransform3D>
 #include <KTriangleIndexCloud>
 
+/*******************************************************************************
+ * Hash Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Blocks are hashed independently, their size is fixed so the result doesn't depend on the thread count.
+  static const size_t HashBlockSize = 16384;
+  static const uint64_t HashOffsetBasis = 14695981039346656037ull;
+  static const uint64_t HashPrime = 1099511628211ull;
+
+  inline uint64_t hashWord(uint64_t hash, uint64_t word)
+  {
+    return (hash ^ word) * HashPrime;
+  }
+
+  inline uint64_t hashFloat(uint64_t hash, float value)
+  {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return hashWord(hash, bits);
+  }
+
+  // Calls hashElement(hash, index) for every element, block by block
+  template <typename Func>
+  uint64_t hashBlocks(uint64_t hash, size_t count, Func hashElement)
+  {
+    std::vector<uint64_t> blocks((count + HashBlockSize - 1) / HashBlockSize);
+    Karma::parallelFor(blocks.size(), [&](size_t begin, size_t end)
+    {
+      for (size_t block = begin; block < end; ++block)
+      {
+        uint64_t blockHash = HashOffsetBasis;
+        for (size_t i = block * HashBlockSize, last = std::min(count, i + HashBlockSize); i < last; ++i)
+        {
+          blockHash = hashElement(blockHash, i);
+        }
+        blocks[block] = blockHash;
+      }
+    }, 1);
+    hash = hashWord(hash, count);
+    for (uint64_t blockHash : blocks)
+    {
+      hash = hashWord(hash, blockHash);
+    }
+    return hash;
+  }
+
+}
+
 /*******************************************************************************
  * KGeometryCloudPrivate
  ******************************************************************************/
@@ -15,6 +69,7 @@ class KGeometryCloudPrivate
 public:
   KPointCloud m_pointCloud;
   KTriangleIndexCloud m_triangleCloud;
+  std::vector<size_t> m_geometryOffsets;
 };
 
 /*******************************************************************************
@@ -41,6 +96,7 @@ void KGeometryCloud::addGeometry(const KHalfEdgeMesh &mesh, const KTransform3D &
 {
   P(KGeometryCloudPrivate);
   size_t currOffset = p.m_pointCloud.size();
+  p.m_geometryOffsets.push_back(currOffset);
 
   // Add points to point cloud
   p.m_pointCloud.reserve(p.m_pointCloud.size() + mesh.vertices().size());
@@ -65,6 +121,42 @@ void KGeometryCloud::addGeometry(const KHalfEdgeMesh &mesh, const KTransform3D &
   }
 }
 
+void KGeometryCloud::updateGeometry(size_t geometry, const KHalfEdgeMesh &mesh, const KTransform3D &trans)
+{
+  P(KGeometryCloudPrivate);
+
+  // Only the points move, the geometry must have been added from the same mesh.
+  size_t currOffset = p.m_geometryOffsets[geometry];
+  Q_ASSERT(currOffset + mesh.vertices().size() <= p.m_pointCloud.size());
+  KMatrix4x4 const &modelToWorld = trans.toMatrix();
+  for (KHalfEdgeMesh::Vertex const & v: mesh.vertices())
+  {
+    p.m_pointCloud[currOffset++] = modelToWorld * v.position;
+  }
+}
+
+size_t KGeometryCloud::geometryCount() const
+{
+  P(const KGeometryCloudPrivate);
+  return p.m_geometryOffsets.size();
+}
+
+uint64_t KGeometryCloud::hash() const
+{
+  P(const KGeometryCloudPrivate);
+  KPointCloud const &points = p.m_pointCloud;
+  uint64_t hash = hashBlocks(HashOffsetBasis, points.size(), [&points](uint64_t hash, size_t i)
+  {
+    return hashFloat(hashFloat(hashFloat(hash, points[i].x()), points[i].y()), points[i].z());
+  });
+  KTriangleIndexCloud::ConstIterator triangles = p.m_triangleCloud.begin();
+  return hashBlocks(hash, p.m_triangleCloud.size(), [&triangles](uint64_t hash, size_t i)
+  {
+    KTriangleIndexCloud::ElementType const &triangle = triangles[i];
+    return hashWord(hashWord(hashWord(hash, triangle.indices[0]), triangle.indices[1]), triangle.indices[2]);
+  });
+}
+
 void KGeometryCloud::build(KGeometryCloud::BuildMethod method, KGeometryCloud::TerminationPred pred)
 {
   (void)method;
@@ -5,6 +5,7 @@ class KHalfEdgeMesh;
 class KTransform3D;
 class KPointCloud;
 class KTriangleIndexCloud;
+#include <cstdint>
 #include <KSharedPointer>
 
 class KGeometryCloudPrivate;
@@ -17,12 +18,16 @@ public:
   enum BuildMethod
   {
     TopDownMethod,
-    BottomUpMethod
+    BottomUpMethod,
+    SahMethod       // Binned surface area heuristic (bounding volume hierarchies only)
   };
   typedef bool (*TerminationPred)(size_t numTriangles, size_t depth);
 
   void addGeometry(KHalfEdgeMesh const &mesh);
   void addGeometry(KHalfEdgeMesh const &mesh, KTransform3D const &trans);
+  void updateGeometry(size_t geometry, KHalfEdgeMesh const &mesh, KTransform3D const &trans);
+  size_t geometryCount() const;
+  uint64_t hash() const;  // Identifies the points and triangles (e.g. to validate saved trees)
   virtual void build(BuildMethod method, TerminationPred pred);
 
   void clear();
@@ -5,11 +5,16 @@
 #include "kaabbboundingvolume.h"
 
 #include <algorithm>
+#include <array>
+#include <cmath>
 #include <functional>
 #include <unordered_map>
 
 #include <QFile>
 
+#include <KParallel>
+#include <KRadixSort>
+
 #include <OpenGLBuffer>
 #include <OpenGLFunctions>
 #include <OpenGLMesh>
@@ -74,6 +79,44 @@ struct IndicesHash : public std::unary_function<Indices::index_pair const&, Indi
   }
 };
 
+/*******************************************************************************
+ * EdgeKey (Bulk Construction)
+ ******************************************************************************/
+typedef KHalfEdgeMesh::index_pair EdgeKey;
+
+// Packs an undirected edge as (max << 32 | min) so twins sort adjacently.
+inline EdgeKey edgeKey(KHalfEdgeMesh::index_type a, KHalfEdgeMesh::index_type b)
+{
+  if (a > b) std::swap(a, b);
+  return (static_cast<EdgeKey>(b) << 32) | static_cast<EdgeKey>(a);
+}
+
+inline KHalfEdgeMesh::index_type edgeKeyLow(EdgeKey key)
+{
+  return static_cast<KHalfEdgeMesh::index_type>(key & 0xFFFFFFFF);
+}
+
+inline KHalfEdgeMesh::index_type edgeKeyHigh(EdgeKey key)
+{
+  return static_cast<KHalfEdgeMesh::index_type>(key >> 32);
+}
+
+/*******************************************************************************
+ * WeldKey (Bulk Construction)
+ ******************************************************************************/
+typedef uint64_t WeldKey;
+static const int WeldCellBits = 21;
+static const int WeldCellMax = (1 << WeldCellBits) - 1;
+
+// Packs a grid cell as (x << 42 | y << 21 | z), cells are clamped to the grid.
+inline WeldKey weldKey(int x, int y, int z)
+{
+  x = std::min(std::max(x, 0), WeldCellMax);
+  y = std::min(std::max(y, 0), WeldCellMax);
+  z = std::min(std::max(z, 0), WeldCellMax);
+  return (static_cast<WeldKey>(x) << (2 * WeldCellBits)) | (static_cast<WeldKey>(y) << WeldCellBits) | static_cast<WeldKey>(z);
+}
+
 /*******************************************************************************
  * HalfEdgeMeshPrivate
  ******************************************************************************/
@@ -98,6 +141,10 @@ public:
   typedef KHalfEdgeMesh::HalfEdgeContainer HalfEdgeContainer;
   typedef KHalfEdgeMesh::FaceContainer FaceContainer;
   typedef std::unordered_map<Indices,HalfEdgeIndex,IndicesHash> HalfEdgeLookup;
+  typedef std::array<index_type, 3> PendingFace;
+  typedef std::vector<PendingFace> PendingFaceContainer;
+
+  KHalfEdgeMeshPrivate();
 
   // Add Commands (Does not check if value already exists!)
   inline VertexIndex addVertex(const KVector3D &v);
@@ -105,6 +152,16 @@ public:
   HalfEdgeIndex addHalfEdge(const index_array &from, const index_array &to);
   FaceIndex addFace(index_array &a, index_array &b, index_array &c);
 
+  // Bulk Commands
+  void beginBulkConstruction();
+  void endBulkConstruction();
+  void weldVertices();
+  void removeDegenerateFaces();
+  inline void setWeldTolerance(float tolerance);
+  inline float weldTolerance() const;
+  inline size_t numWeldedVertices() const;
+  inline size_t numDegenerateFaces() const;
+
   // Query Commands (index => elements)
   inline Vertex *vertex(VertexIndex const &idx);
   inline HalfEdge *halfEdge(HalfEdgeIndex const &idx);
@@ -150,11 +207,12 @@ public:
   HalfEdgeIndex findHalfEdge(const index_array &from, const index_array &to);
   HalfEdgeIndex getHalfEdge(const index_array &from, const index_array &to);
   void normalizeIndex(index_type &v, size_t const &sizePlusOne);
+  void constructHalfEdges();
+  void rebuildHalfEdgeLookup();
   void initializeInnerHalfEdge(HalfEdgeIndex const &he, FaceIndex const &f, HalfEdgeIndex const &next);
   KVector3D calculateFaceNormal(const Face *face);
   KVector3D calculateVertexNormal(const Vertex *vertex, std::vector<KVector3D> &accumulator);
   void connectBoundaries();
-  void connectEdges(HalfEdge *edge);
   void calculateFaceNormals();
   void calculateVertexNormals();
   void normalizeVertices();
@@ -165,9 +223,20 @@ private:
   HalfEdgeContainer m_halfEdges;
   FaceContainer m_faces;
   HalfEdgeLookup m_halfEdgeLookup;
+  PendingFaceContainer m_pendingFaces;
+  bool m_bulkConstruction;
+  float m_weldTolerance;
+  size_t m_weldedVertices;
+  size_t m_degenerateFaces;
   KAabbBoundingVolume m_aabb;
 };
 
+KHalfEdgeMeshPrivate::KHalfEdgeMeshPrivate() :
+  m_bulkConstruction(false), m_weldTolerance(1e-6f), m_weldedVertices(0), m_degenerateFaces(0)
+{
+  // Intentionally Empty
+}
+
 /*******************************************************************************
  * HalfEdgeMeshPrivate :: Add Commands
  ******************************************************************************/
@@ -213,6 +282,13 @@ KHalfEdgeMeshPrivate::FaceIndex KHalfEdgeMeshPrivate::addFace(index_array &v1, i
   normalizeIndex(v2[0], size);
   normalizeIndex(v3[0], size);
 
+  // Defer edge creation until the bulk construction ends
+  if (m_bulkConstruction)
+  {
+    m_pendingFaces.push_back({{ v1[0], v2[0], v3[0] }});
+    return FaceIndex(static_cast<index_type>(m_faces.size() + m_pendingFaces.size()));
+  }
+
   // Create edges
   HalfEdgeIndex edgeA = getHalfEdge(v1, v2);
   HalfEdgeIndex edgeB = getHalfEdge(v2, v3);
@@ -235,6 +311,199 @@ KHalfEdgeMeshPrivate::FaceIndex KHalfEdgeMeshPrivate::addFace(index_array &v1, i
   return faceIdx;
 }
 
+/*******************************************************************************
+ * HalfEdgeMeshPrivate :: Bulk Commands
+ ******************************************************************************/
+void KHalfEdgeMeshPrivate::beginBulkConstruction()
+{
+  m_bulkConstruction = true;
+}
+
+void KHalfEdgeMeshPrivate::endBulkConstruction()
+{
+  m_bulkConstruction = false;
+  if (m_pendingFaces.empty()) return;
+
+  // Bulk construction assumes it owns every edge; mixing with
+  // incrementally added faces falls back to the lookup table.
+  if (!m_halfEdges.empty())
+  {
+    index_array a = {{ 0, 0, 0 }}, b = a, c = a;
+    for (PendingFace const &f : m_pendingFaces)
+    {
+      a[0] = f[0]; b[0] = f[1]; c[0] = f[2];
+      addFace(a, b, c);
+    }
+  }
+  else
+  {
+    // No vertex is referenced by an edge yet, so they can still be renumbered.
+    if (m_weldTolerance >= 0.0f)
+    {
+      weldVertices();
+      removeDegenerateFaces();
+    }
+    constructHalfEdges();
+  }
+
+  PendingFaceContainer().swap(m_pendingFaces);
+}
+
+inline void KHalfEdgeMeshPrivate::setWeldTolerance(float tolerance)
+{
+  m_weldTolerance = tolerance;
+}
+
+inline float KHalfEdgeMeshPrivate::weldTolerance() const
+{
+  return m_weldTolerance;
+}
+
+inline size_t KHalfEdgeMeshPrivate::numWeldedVertices() const
+{
+  return m_weldedVertices;
+}
+
+inline size_t KHalfEdgeMeshPrivate::numDegenerateFaces() const
+{
+  return m_degenerateFaces;
+}
+
+void KHalfEdgeMeshPrivate::weldVertices()
+{
+  size_t numVertices = m_vertices.size();
+  if (numVertices < 2) return;
+
+  // Cells are twice the tolerance, so a vertex can only weld with the cells it's near.
+  Karma::MinMaxKVector3D bounds = Karma::findMinMaxBounds(m_vertices.begin(), m_vertices.end(), KHalfEdgeMesh::VertexPositionPred());
+  m_aabb.setMinMaxBounds(bounds);
+  KVector3D const minExtent = bounds.min;
+  KVector3D extent = bounds.max - minExtent;
+  float maxExtent = std::max(extent.x(), std::max(extent.y(), extent.z()));
+  float tolerance = m_weldTolerance * maxExtent;
+  float cellSize = std::max(2.0f * tolerance, maxExtent / (WeldCellMax - 1));
+  if (cellSize <= 0.0f) cellSize = 1.0f;
+  float invCellSize = 1.0f / cellSize;
+  float toleranceSq = tolerance * tolerance;
+
+  // Bucket vertices into the spatial hash grid
+  std::vector<WeldKey> keys(numVertices);
+  std::vector<index_type> order(numVertices);
+  Karma::parallelFor(numVertices, [&](size_t begin, size_t end)
+  {
+    for (size_t v = begin; v < end; ++v)
+    {
+      KVector3D cell = (m_vertices[v].position - minExtent) * invCellSize;
+      keys[v] = weldKey(static_cast<int>(cell.x()), static_cast<int>(cell.y()), static_cast<int>(cell.z()));
+      order[v] = static_cast<index_type>(v);
+    }
+  });
+  Karma::radixSort(keys, order);
+
+  // Every vertex welds to the lowest vertex within tolerance (0-based)
+  std::vector<index_type> weld(numVertices);
+  Karma::parallelFor(numVertices, [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      index_type v = order[i];
+      KVector3D const &position = m_vertices[v].position;
+      KVector3D cell = (position - minExtent) * invCellSize;
+      int cx = static_cast<int>(cell.x()), cy = static_cast<int>(cell.y()), cz = static_cast<int>(cell.z());
+      int nx = (cell.x() - cx < 0.5f) ? cx - 1 : cx + 1;
+      int ny = (cell.y() - cy < 0.5f) ? cy - 1 : cy + 1;
+      int nz = (cell.z() - cz < 0.5f) ? cz - 1 : cz + 1;
+
+      index_type lowest = v;
+      WeldKey visited[8];
+      size_t numVisited = 0;
+      for (int n = 0; n < 8; ++n)
+      {
+        WeldKey key = weldKey((n & 1) ? nx : cx, (n & 2) ? ny : cy, (n & 4) ? nz : cz);
+        if (std::find(visited, visited + numVisited, key) != visited + numVisited) continue;
+        visited[numVisited++] = key;
+
+        auto range = std::equal_range(keys.begin(), keys.end(), key);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+          index_type other = order[it - keys.begin()];
+          if (other < lowest && (m_vertices[other].position - position).lengthSquared() <= toleranceSq)
+          {
+            lowest = other;
+          }
+        }
+      }
+      weld[v] = lowest;
+    }
+  });
+
+  // Resolve chains of welds and compact the survivors (welds always point to lower vertices)
+  std::vector<index_type> remap(numVertices);
+  size_t numWelded = 0;
+  for (size_t v = 0; v < numVertices; ++v)
+  {
+    if (weld[v] == v)
+    {
+      remap[v] = static_cast<index_type>(v - numWelded + 1);
+      m_vertices[v - numWelded] = m_vertices[v];
+    }
+    else
+    {
+      remap[v] = remap[weld[v]];
+      ++numWelded;
+    }
+  }
+  if (numWelded == 0) return;
+  m_vertices.erase(m_vertices.end() - numWelded, m_vertices.end());
+  m_aabb.setMinMaxBounds(Karma::findMinMaxBounds(m_vertices.begin(), m_vertices.end(), KHalfEdgeMesh::VertexPositionPred()));
+  m_weldedVertices += numWelded;
+
+  Karma::parallelFor(m_pendingFaces.size(), [&](size_t begin, size_t end)
+  {
+    for (size_t f = begin; f < end; ++f)
+    {
+      for (index_type &v : m_pendingFaces[f])
+      {
+        v = remap[v - 1];
+      }
+    }
+  });
+}
+
+void KHalfEdgeMeshPrivate::removeDegenerateFaces()
+{
+  // Faces collapsed by welding, or with (relatively) zero area, are dropped.
+  KVector3D extent = m_aabb.maxExtent() - m_aabb.minExtent();
+  float maxExtent = std::max(extent.x(), std::max(extent.y(), extent.z()));
+  float minArea = m_weldTolerance * maxExtent * m_weldTolerance * maxExtent;
+  float minAreaSq = minArea * minArea;
+
+  std::vector<char> degenerate(m_pendingFaces.size());
+  Karma::parallelFor(m_pendingFaces.size(), [&](size_t begin, size_t end)
+  {
+    for (size_t f = begin; f < end; ++f)
+    {
+      PendingFace const &face = m_pendingFaces[f];
+      if (face[0] == face[1] || face[1] == face[2] || face[2] == face[0])
+      {
+        degenerate[f] = 1;
+        continue;
+      }
+      KVector3D const &p0 = vertex(face[0])->position;
+      KVector3D normal = KVector3D::crossProduct(vertex(face[1])->position - p0, vertex(face[2])->position - p0);
+      degenerate[f] = (normal.lengthSquared() <= minAreaSq) ? 1 : 0;
+    }
+  });
+
+  size_t kept = 0;
+  for (size_t f = 0; f < m_pendingFaces.size(); ++f)
+  {
+    if (!degenerate[f]) m_pendingFaces[kept++] = m_pendingFaces[f];
+  }
+  m_degenerateFaces += m_pendingFaces.size() - kept;
+  m_pendingFaces.resize(kept);
+}
+
 /*******************************************************************************
  * HalfEdgeMeshPrivate :: Query Commands (index => element)
  ******************************************************************************/
@@ -415,6 +684,12 @@ inline KHalfEdgeMeshPrivate::HalfEdgeIndex KHalfEdgeMeshPrivate::cwBoundsIndex(H
  ******************************************************************************/
 KHalfEdgeMeshPrivate::HalfEdgeIndex KHalfEdgeMeshPrivate::findHalfEdge(const index_array &from, const index_array &to)
 {
+  // Bulk construction doesn't populate the lookup, recreate it on demand.
+  if (m_halfEdgeLookup.empty() && !m_halfEdges.empty())
+  {
+    rebuildHalfEdgeLookup();
+  }
+
   HalfEdgeLookup::const_iterator it = m_halfEdgeLookup.find(Indices(from[0], to[0]));
   if (it == m_halfEdgeLookup.end()) return 0;
 
@@ -441,6 +716,104 @@ inline void KHalfEdgeMeshPrivate::normalizeIndex(KAbstractMesh::index_type &v, s
   ++v;
 }
 
+void KHalfEdgeMeshPrivate::constructHalfEdges()
+{
+  size_t numFaces = m_pendingFaces.size();
+  size_t numDirected = 3 * numFaces;
+  std::vector<EdgeKey> keys(numDirected);
+  std::vector<index_type> edgeSlots(numDirected);
+
+  // Collect every directed edge as an undirected (min,max) key
+  Karma::parallelFor(numFaces, [&](size_t begin, size_t end)
+  {
+    for (size_t f = begin; f < end; ++f)
+    {
+      PendingFace const &face = m_pendingFaces[f];
+      for (size_t k = 0; k < 3; ++k)
+      {
+        keys[3 * f + k] = edgeKey(face[k], face[(k + 1) % 3]);
+        edgeSlots[3 * f + k] = static_cast<index_type>(3 * f + k);
+      }
+    }
+  });
+
+  // Twins become adjacent once sorted (stable, so face order is kept within an edge)
+  Karma::radixSort(keys, edgeSlots);
+
+  // Count the unique edges each chunk starts, so chunks know their output offset
+  size_t chunks = Karma::parallelChunkCount(numDirected);
+  std::vector<size_t> edgeOffsets(chunks + 1, 0);
+  Karma::parallelChunks(numDirected, chunks, [&](size_t chunk, size_t begin, size_t end)
+  {
+    size_t heads = 0;
+    for (size_t i = begin; i < end; ++i)
+    {
+      if (i == 0 || keys[i] != keys[i - 1]) ++heads;
+    }
+    edgeOffsets[chunk + 1] = heads;
+  });
+  for (size_t chunk = 0; chunk < chunks; ++chunk)
+  {
+    edgeOffsets[chunk + 1] += edgeOffsets[chunk];
+  }
+
+  // Pair twins by scanning adjacent keys, and map each directed slot to its half edge
+  std::vector<index_type> directed(numDirected);
+  m_halfEdges.assign(2 * edgeOffsets[chunks], HalfEdge(0));
+  Karma::parallelChunks(numDirected, chunks, [&](size_t chunk, size_t begin, size_t end)
+  {
+    size_t edge = edgeOffsets[chunk];
+    for (size_t i = begin; i < end; ++i)
+    {
+      if (i == 0 || keys[i] != keys[i - 1])
+      {
+        m_halfEdges[2 * edge].to = edgeKeyLow(keys[i]);
+        m_halfEdges[2 * edge + 1].to = edgeKeyHigh(keys[i]);
+        ++edge;
+      }
+
+      // Matches addHalfEdge(): descending edges point to the low vertex.
+      index_type slot = edgeSlots[i];
+      PendingFace const &face = m_pendingFaces[slot / 3];
+      index_type from = face[slot % 3];
+      index_type to = face[(slot % 3 + 1) % 3];
+      index_type offset = static_cast<index_type>(2 * (edge - 1) + 1);
+      directed[slot] = (from > to) ? offset : offset + 1;
+    }
+  });
+
+  // Faces are linked in order, so non-manifold edges resolve like addFace().
+  m_faces.reserve(m_faces.size() + numFaces);
+  for (size_t f = 0; f < numFaces; ++f)
+  {
+    HalfEdgeIndex edgeA = directed[3 * f + 0];
+    HalfEdgeIndex edgeB = directed[3 * f + 1];
+    HalfEdgeIndex edgeC = directed[3 * f + 2];
+
+    m_faces.emplace_back(edgeA);
+    FaceIndex faceIdx = FaceIndex(static_cast<index_type>(m_faces.size()));
+
+    initializeInnerHalfEdge(edgeA, faceIdx, edgeB);
+    initializeInnerHalfEdge(edgeB, faceIdx, edgeC);
+    initializeInnerHalfEdge(edgeC, faceIdx, edgeA);
+
+    PendingFace const &face = m_pendingFaces[f];
+    if (vertex(face[0])->to == 0) vertex(face[0])->to = edgeA;
+    if (vertex(face[1])->to == 0) vertex(face[1])->to = edgeB;
+    if (vertex(face[2])->to == 0) vertex(face[2])->to = edgeC;
+  }
+}
+
+void KHalfEdgeMeshPrivate::rebuildHalfEdgeLookup()
+{
+  m_halfEdgeLookup.reserve(m_halfEdges.size() / 2);
+  for (size_t i = 0; i < m_halfEdges.size(); i += 2)
+  {
+    Indices idx(m_halfEdges[i].to, m_halfEdges[i + 1].to);
+    m_halfEdgeLookup.emplace(idx, HalfEdgeIndex(static_cast<index_type>(i + 1)));
+  }
+}
+
 inline void KHalfEdgeMeshPrivate::initializeInnerHalfEdge(const KHalfEdgeMeshPrivate::HalfEdgeIndex &he, const KHalfEdgeMeshPrivate::FaceIndex &f, const KHalfEdgeMeshPrivate::HalfEdgeIndex &next)
 {
   HalfEdge *edge = halfEdge(he);
@@ -513,24 +886,28 @@ KVector3D KHalfEdgeMeshPrivate::calculateVertexNormal(const Vertex *vertex, std:
 
 void KHalfEdgeMeshPrivate::connectBoundaries()
 {
-  for (HalfEdge &edge : m_halfEdges)
+  // A boundary edge into a vertex continues with the boundary edge out of it.
+  // Note: Non-manifold vertices with several boundary fans keep only one.
+  std::vector<index_type> boundaryOut(m_vertices.size() + 1, 0);
+  for (HalfEdge const &edge : m_halfEdges)
   {
-    if (edge.face == 0 && edge.next == 0)
+    if (edge.face == 0)
     {
-      connectEdges(&edge);
+      boundaryOut[twin(&edge)->to] = index(&edge);
     }
   }
-}
 
-void KHalfEdgeMeshPrivate::connectEdges(KHalfEdgeMeshPrivate::HalfEdge *edge)
-{
-  HalfEdge *prev = twin(cwBounds(edge));
-  do
+  Karma::parallelFor(m_halfEdges.size(), [&](size_t begin, size_t end)
   {
-    prev->next = index(edge);
-    edge = prev;
-    prev = twin(cwBounds(edge));
-  } while (prev->next == 0);
+    for (size_t i = begin; i < end; ++i)
+    {
+      HalfEdge &edge = m_halfEdges[i];
+      if (edge.face == 0 && edge.next == 0)
+      {
+        edge.next = boundaryOut[edge.to];
+      }
+    }
+  });
 }
 
 void KHalfEdgeMeshPrivate::calculateFaceNormals()
@@ -603,7 +980,10 @@ bool KHalfEdgeMesh::create(const char *fileName)
   }
   KHalfEdgeObjParser parser(this, &reader);
   parser.initialize();
-  if (parser.parse())
+  p.beginBulkConstruction();
+  bool parsed = parser.parse();
+  p.endBulkConstruction();
+  if (parsed)
   {
     p.connectBoundaries();
     return true;
@@ -623,6 +1003,30 @@ KHalfEdgeMesh::FaceIndex KHalfEdgeMesh::addFace(index_array &a, index_array &b,
   return p.addFace(a, b, c);
 }
 
+void KHalfEdgeMesh::beginBulkConstruction()
+{
+  P(KHalfEdgeMeshPrivate);
+  p.beginBulkConstruction();
+}
+
+void KHalfEdgeMesh::endBulkConstruction()
+{
+  P(KHalfEdgeMeshPrivate);
+  p.endBulkConstruction();
+}
+
+void KHalfEdgeMesh::setWeldTolerance(float tolerance)
+{
+  P(KHalfEdgeMeshPrivate);
+  p.setWeldTolerance(tolerance);
+}
+
+float KHalfEdgeMesh::weldTolerance() const
+{
+  P(const KHalfEdgeMeshPrivate);
+  return p.weldTolerance();
+}
+
 // Query Commands (start from 1)
 KHalfEdgeMesh::Vertex const *KHalfEdgeMesh::vertex(VertexIndex idx) const
 {
@@ -694,6 +1098,18 @@ KHalfEdgeMesh::SizeType KHalfEdgeMesh::numFaces() const
   return p.faces().size();
 }
 
+KHalfEdgeMesh::SizeType KHalfEdgeMesh::numWeldedVertices() const
+{
+  P(const KHalfEdgeMeshPrivate);
+  return p.numWeldedVertices();
+}
+
+KHalfEdgeMesh::SizeType KHalfEdgeMesh::numDegenerateFaces() const
+{
+  P(const KHalfEdgeMeshPrivate);
+  return p.numDegenerateFaces();
+}
+
 KHalfEdgeMesh::VertexIndex KHalfEdgeMesh::index(Vertex const *v) const
 {
   P(const KHalfEdgeMeshPrivate);
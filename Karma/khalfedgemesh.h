@@ -102,6 +102,15 @@ public:
   VertexIndex addVertex(const KVector3D &v);
   FaceIndex addFace(index_array &a, index_array &b, index_array &c);
 
+  // Bulk Commands (Faces added between these calls build half-edges on end)
+  // Unless the tolerance is negative, ending a bulk construction on an empty mesh
+  // welds vertices within tolerance (relative to the mesh extents) and drops
+  // degenerate faces, so indices returned while constructing may be renumbered.
+  void beginBulkConstruction();
+  void endBulkConstruction();
+  void setWeldTolerance(float tolerance);
+  float weldTolerance() const;
+
   // Query Commands (index -> element)
   Vertex const *vertex(VertexIndex idx) const;
   HalfEdge const *halfEdge(HalfEdgeIndex idx) const;
@@ -115,6 +124,8 @@ public:
   SizeType numVertices() const;
   SizeType numHalfEdges() const;
   SizeType numFaces() const;
+  SizeType numWeldedVertices() const;
+  SizeType numDegenerateFaces() const;
 
   // Query Commands (element -> index)
   VertexIndex index(Vertex const *v) const;
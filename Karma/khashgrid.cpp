@@ -0,0 +1,380 @@
+#include "khashgrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <KMacros>
+#include <KParallel>
+#include <KVector3D>
+
+/*******************************************************************************
+ * KHashGrid Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Keys pack the biased integer coordinates of a cell
+  static const int32_t GridCoordinateBits = 21;
+  static const int32_t GridCoordinateBias = 1 << (GridCoordinateBits - 1);
+  static const uint64_t GridCoordinateMask = (uint64_t(1) << GridCoordinateBits) - 1;
+
+  inline uint64_t cellKey(int32_t const *cell)
+  {
+    return (uint64_t(cell[0] + GridCoordinateBias) << (2 * GridCoordinateBits)) |
+           (uint64_t(cell[1] + GridCoordinateBias) << GridCoordinateBits) |
+            uint64_t(cell[2] + GridCoordinateBias);
+  }
+
+  inline int32_t cellCoordinate(uint64_t key, int axis)
+  {
+    return static_cast<int32_t>((key >> ((2 - axis) * GridCoordinateBits)) & GridCoordinateMask) - GridCoordinateBias;
+  }
+
+  struct KHashGridObject
+  {
+    KVector3D minExtent;
+    KVector3D maxExtent;
+    int32_t cellMin[3];
+    int32_t cellMax[3];
+    bool alive;
+    bool oversized;
+  };
+
+  inline bool overlaps(KVector3D const &minA, KVector3D const &maxA, KVector3D const &minB, KVector3D const &maxB)
+  {
+    return minA.x() <= maxB.x() && maxA.x() >= minB.x() &&
+           minA.y() <= maxB.y() && maxA.y() >= minB.y() &&
+           minA.z() <= maxB.z() && maxA.z() >= minB.z();
+  }
+
+  // Boxes sharing several cells are only reported from the first cell of their overlap
+  inline bool firstSharedCell(int32_t const *minA, int32_t const *minB, int32_t const *cell)
+  {
+    return std::max(minA[0], minB[0]) == cell[0] &&
+           std::max(minA[1], minB[1]) == cell[1] &&
+           std::max(minA[2], minB[2]) == cell[2];
+  }
+
+  inline KHashGrid::HandlePair makePair(KHashGrid::Handle a, KHashGrid::Handle b)
+  {
+    return (a < b) ? KHashGrid::HandlePair(a, b) : KHashGrid::HandlePair(b, a);
+  }
+
+}
+
+/*******************************************************************************
+ * KHashGridPrivate
+ ******************************************************************************/
+class KHashGridPrivate
+{
+public:
+  typedef KHashGrid::Handle Handle;
+  typedef std::vector<Handle> CellContainer;
+  KHashGridPrivate(float cellSize);
+
+  void reset(float cellSize);
+  void clear();
+  void cellRange(KVector3D const &minExtent, KVector3D const &maxExtent, int32_t *cellMin, int32_t *cellMax) const;
+  uint64_t cellsWithin(int32_t const *cellMin, int32_t const *cellMax) const;
+  void attach(Handle handle);
+  void detach(Handle handle);
+
+  float m_invCellSize;
+  std::unordered_map<uint64_t, CellContainer> m_cells;
+  std::vector<KHashGridObject> m_objects;
+  std::vector<Handle> m_oversized;
+  std::vector<Handle> m_freeHandles;
+  size_t m_moveCount;
+};
+
+KHashGridPrivate::KHashGridPrivate(float cellSize) :
+  m_moveCount(0)
+{
+  reset(cellSize);
+}
+
+void KHashGridPrivate::reset(float cellSize)
+{
+  m_invCellSize = 1.0f / cellSize;
+  clear();
+}
+
+void KHashGridPrivate::clear()
+{
+  m_cells.clear();
+  m_objects.clear();
+  m_oversized.clear();
+  m_freeHandles.clear();
+  m_moveCount = 0;
+}
+
+void KHashGridPrivate::cellRange(KVector3D const &minExtent, KVector3D const &maxExtent, int32_t *cellMin, int32_t *cellMax) const
+{
+  float limit = static_cast<float>(GridCoordinateBias - 1);
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    cellMin[axis] = static_cast<int32_t>(std::max(-limit, std::min(limit, std::floor(minExtent[axis] * m_invCellSize))));
+    cellMax[axis] = static_cast<int32_t>(std::max(-limit, std::min(limit, std::floor(maxExtent[axis] * m_invCellSize))));
+  }
+}
+
+uint64_t KHashGridPrivate::cellsWithin(int32_t const *cellMin, int32_t const *cellMax) const
+{
+  return uint64_t(cellMax[0] - cellMin[0] + 1) * uint64_t(cellMax[1] - cellMin[1] + 1) * uint64_t(cellMax[2] - cellMin[2] + 1);
+}
+
+void KHashGridPrivate::attach(Handle handle)
+{
+  KHashGridObject &object = m_objects[handle];
+  object.oversized = cellsWithin(object.cellMin, object.cellMax) > KHashGrid::MaxCellsPerObject;
+  if (object.oversized)
+  {
+    m_oversized.push_back(handle);
+    return;
+  }
+
+  int32_t cell[3];
+  for (cell[0] = object.cellMin[0]; cell[0] <= object.cellMax[0]; ++cell[0])
+  {
+    for (cell[1] = object.cellMin[1]; cell[1] <= object.cellMax[1]; ++cell[1])
+    {
+      for (cell[2] = object.cellMin[2]; cell[2] <= object.cellMax[2]; ++cell[2])
+      {
+        m_cells[cellKey(cell)].push_back(handle);
+      }
+    }
+  }
+}
+
+void KHashGridPrivate::detach(Handle handle)
+{
+  KHashGridObject const &object = m_objects[handle];
+  if (object.oversized)
+  {
+    std::vector<Handle>::iterator it = std::find(m_oversized.begin(), m_oversized.end(), handle);
+    *it = m_oversized.back();
+    m_oversized.pop_back();
+    return;
+  }
+
+  // Cells are unordered, so removal swaps with the last entry
+  int32_t cell[3];
+  for (cell[0] = object.cellMin[0]; cell[0] <= object.cellMax[0]; ++cell[0])
+  {
+    for (cell[1] = object.cellMin[1]; cell[1] <= object.cellMax[1]; ++cell[1])
+    {
+      for (cell[2] = object.cellMin[2]; cell[2] <= object.cellMax[2]; ++cell[2])
+      {
+        auto found = m_cells.find(cellKey(cell));
+        CellContainer &handles = found->second;
+        *std::find(handles.begin(), handles.end(), handle) = handles.back();
+        handles.pop_back();
+        if (handles.empty()) m_cells.erase(found);
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+ * KHashGrid
+ ******************************************************************************/
+KHashGrid::KHashGrid(float cellSize) :
+  m_private(new KHashGridPrivate(cellSize))
+{
+  // Intentionally Empty
+}
+
+KHashGrid::~KHashGrid()
+{
+  // Intentionally Empty
+}
+
+void KHashGrid::reset(float cellSize)
+{
+  P(KHashGridPrivate);
+  p.reset(cellSize);
+}
+
+void KHashGrid::clear()
+{
+  P(KHashGridPrivate);
+  p.clear();
+}
+
+auto KHashGrid::insert(KVector3D const &minExtent, KVector3D const &maxExtent) -> Handle
+{
+  P(KHashGridPrivate);
+  Handle handle;
+  if (p.m_freeHandles.empty())
+  {
+    handle = static_cast<Handle>(p.m_objects.size());
+    p.m_objects.push_back(KHashGridObject());
+  }
+  else
+  {
+    handle = p.m_freeHandles.back();
+    p.m_freeHandles.pop_back();
+  }
+  KHashGridObject &object = p.m_objects[handle];
+  object.minExtent = minExtent;
+  object.maxExtent = maxExtent;
+  object.alive = true;
+  p.cellRange(minExtent, maxExtent, object.cellMin, object.cellMax);
+  p.attach(handle);
+  return handle;
+}
+
+void KHashGrid::update(Handle handle, KVector3D const &minExtent, KVector3D const &maxExtent)
+{
+  P(KHashGridPrivate);
+  KHashGridObject &object = p.m_objects[handle];
+  object.minExtent = minExtent;
+  object.maxExtent = maxExtent;
+
+  // Most updates stay within the same cells
+  int32_t cellMin[3], cellMax[3];
+  p.cellRange(minExtent, maxExtent, cellMin, cellMax);
+  if (std::equal(cellMin, cellMin + 3, object.cellMin) && std::equal(cellMax, cellMax + 3, object.cellMax)) return;
+  p.detach(handle);
+  std::copy(cellMin, cellMin + 3, object.cellMin);
+  std::copy(cellMax, cellMax + 3, object.cellMax);
+  p.attach(handle);
+  ++p.m_moveCount;
+}
+
+void KHashGrid::remove(Handle handle)
+{
+  P(KHashGridPrivate);
+  p.detach(handle);
+  p.m_objects[handle].alive = false;
+  p.m_freeHandles.push_back(handle);
+}
+
+void KHashGrid::pairs(std::vector<HandlePair> &results) const
+{
+  P(const KHashGridPrivate);
+
+  // Cells are independent, so they're split across threads
+  typedef std::pair<uint64_t, KHashGridPrivate::CellContainer const*> CellEntry;
+  std::vector<CellEntry> cells;
+  cells.reserve(p.m_cells.size());
+  for (auto const &cell : p.m_cells)
+  {
+    if (cell.second.size() > 1) cells.emplace_back(cell.first, &cell.second);
+  }
+  size_t chunks = Karma::parallelChunkCount(cells.size());
+  std::vector<std::vector<HandlePair>> found(chunks);
+  Karma::parallelChunks(cells.size(), chunks, [&](size_t chunk, size_t begin, size_t end)
+  {
+    std::vector<HandlePair> &local = found[chunk];
+    for (size_t c = begin; c < end; ++c)
+    {
+      int32_t cell[3] = { cellCoordinate(cells[c].first, 0), cellCoordinate(cells[c].first, 1), cellCoordinate(cells[c].first, 2) };
+      KHashGridPrivate::CellContainer const &handles = *cells[c].second;
+      for (size_t i = 0; i < handles.size(); ++i)
+      {
+        KHashGridObject const &a = p.m_objects[handles[i]];
+        for (size_t j = i + 1; j < handles.size(); ++j)
+        {
+          KHashGridObject const &b = p.m_objects[handles[j]];
+          if (!overlaps(a.minExtent, a.maxExtent, b.minExtent, b.maxExtent)) continue;
+          if (!firstSharedCell(a.cellMin, b.cellMin, cell)) continue;
+          local.push_back(makePair(handles[i], handles[j]));
+        }
+      }
+    }
+  });
+  for (std::vector<HandlePair> const &local : found)
+  {
+    results.insert(results.end(), local.begin(), local.end());
+  }
+
+  // Oversized boxes pair with everything (once amongst themselves)
+  for (Handle handle : p.m_oversized)
+  {
+    KHashGridObject const &a = p.m_objects[handle];
+    for (Handle other = 0; other < p.m_objects.size(); ++other)
+    {
+      KHashGridObject const &b = p.m_objects[other];
+      if (!b.alive || other == handle || (b.oversized && other < handle)) continue;
+      if (overlaps(a.minExtent, a.maxExtent, b.minExtent, b.maxExtent)) results.push_back(makePair(handle, other));
+    }
+  }
+}
+
+void KHashGrid::query(KVector3D const &minExtent, KVector3D const &maxExtent, std::vector<Handle> &results) const
+{
+  P(const KHashGridPrivate);
+  int32_t regionMin[3], regionMax[3];
+  p.cellRange(minExtent, maxExtent, regionMin, regionMax);
+
+  auto visit = [&](int32_t const *cell, KHashGridPrivate::CellContainer const &handles)
+  {
+    for (Handle handle : handles)
+    {
+      KHashGridObject const &object = p.m_objects[handle];
+      if (!overlaps(object.minExtent, object.maxExtent, minExtent, maxExtent)) continue;
+      if (firstSharedCell(object.cellMin, regionMin, cell)) results.push_back(handle);
+    }
+  };
+
+  // Large regions walk the occupied cells instead of every cell they cover
+  int32_t cell[3];
+  if (p.cellsWithin(regionMin, regionMax) <= p.m_cells.size())
+  {
+    for (cell[0] = regionMin[0]; cell[0] <= regionMax[0]; ++cell[0])
+    {
+      for (cell[1] = regionMin[1]; cell[1] <= regionMax[1]; ++cell[1])
+      {
+        for (cell[2] = regionMin[2]; cell[2] <= regionMax[2]; ++cell[2])
+        {
+          auto found = p.m_cells.find(cellKey(cell));
+          if (found != p.m_cells.end()) visit(cell, found->second);
+        }
+      }
+    }
+  }
+  else
+  {
+    for (auto const &entry : p.m_cells)
+    {
+      bool inside = true;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        cell[axis] = cellCoordinate(entry.first, axis);
+        inside = inside && cell[axis] >= regionMin[axis] && cell[axis] <= regionMax[axis];
+      }
+      if (inside) visit(cell, entry.second);
+    }
+  }
+
+  for (Handle handle : p.m_oversized)
+  {
+    KHashGridObject const &object = p.m_objects[handle];
+    if (overlaps(object.minExtent, object.maxExtent, minExtent, maxExtent)) results.push_back(handle);
+  }
+}
+
+size_t KHashGrid::size() const
+{
+  P(const KHashGridPrivate);
+  return p.m_objects.size() - p.m_freeHandles.size();
+}
+
+size_t KHashGrid::cellCount() const
+{
+  P(const KHashGridPrivate);
+  return p.m_cells.size();
+}
+
+size_t KHashGrid::oversizedCount() const
+{
+  P(const KHashGridPrivate);
+  return p.m_oversized.size();
+}
+
+size_t KHashGrid::moveCount() const
+{
+  P(const KHashGridPrivate);
+  return p.m_moveCount;
+}
@@ -0,0 +1,51 @@
+#ifndef KHASHGRID_H
+#define KHASHGRID_H KHashGrid
+
+class KVector3D;
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <KSharedPointer>
+
+// Broadphase over dynamic bounding boxes, addressed by handles.
+// Space is divided into uniform cells which only exist while occupied, every box
+// is listed in all cells it touches. Boxes only move between cells when the range
+// of cells they touch changes, and boxes touching too many cells are kept aside
+// and tested against everything instead.
+class KHashGridPrivate;
+class KHashGrid
+{
+public:
+  typedef uint32_t Handle;
+  typedef std::pair<Handle, Handle> HandlePair;
+  static const Handle InvalidHandle = 0xFFFFFFFF;
+  static const size_t MaxCellsPerObject = 64;
+
+  explicit KHashGrid(float cellSize = 1.0f);
+  ~KHashGrid();
+
+  // Cells should roughly match the size of the typical box
+  void reset(float cellSize);
+  void clear();
+
+  // Modification
+  Handle insert(KVector3D const &minExtent, KVector3D const &maxExtent);
+  void update(Handle handle, KVector3D const &minExtent, KVector3D const &maxExtent);
+  void remove(Handle handle);
+
+  // Queries (Results are appended, pairs are reported once with first < second)
+  void pairs(std::vector<HandlePair> &results) const;
+  void query(KVector3D const &minExtent, KVector3D const &maxExtent, std::vector<Handle> &results) const;
+
+  // Statistics
+  size_t size() const;
+  size_t cellCount() const;
+  size_t oversizedCount() const;
+  size_t moveCount() const;
+
+private:
+  KSharedPointer<KHashGridPrivate> m_private;
+};
+
+#endif // KHASHGRID_H
@@ -9,9 +9,15 @@ class KIndexCloud
 public:
   typedef size_t ElementType;
   typedef std::vector<ElementType> ContainerType;
+  typedef ContainerType::const_iterator ConstIterator;
 
   void reserve(size_t count);
   void emplace_back(ElementType elm);
+  size_t size() const;
+
+  // Iterators
+  ConstIterator begin() const;
+  ConstIterator end() const;
 private:
   ContainerType m_container;
 };
@@ -26,5 +32,20 @@ inline void KIndexCloud::emplace_back(ElementType elm)
   m_container.emplace_back(elm);
 }
 
+inline size_t KIndexCloud::size() const
+{
+  return m_container.size();
+}
+
+inline auto KIndexCloud::begin() const -> ConstIterator
+{
+  return m_container.begin();
+}
+
+inline auto KIndexCloud::end() const -> ConstIterator
+{
+  return m_container.end();
+}
+
 #endif // KINDEXCLOUD_H
 
@@ -0,0 +1,366 @@
+#include "kkdtree.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <KMacros>
+#include <KParallel>
+#include <KPointCloud>
+#include <KVector3D>
+
+/*******************************************************************************
+ * KKdTree Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Ranges this small are scanned instead of split further.
+  static const size_t KdLeafSize = 8;
+
+  struct KKdCandidate
+  {
+    float distanceSquared;
+    uint32_t position;
+    bool operator<(KKdCandidate const &rhs) const { return distanceSquared < rhs.distanceSquared; }
+  };
+
+  inline float distanceSquared(KVector3D const &a, KVector3D const &b)
+  {
+    return (a - b).lengthSquared();
+  }
+
+}
+
+/*******************************************************************************
+ * KKdTreePrivate
+ ******************************************************************************/
+class KKdTreePrivate
+{
+public:
+  void recursiveBuild(size_t depth, uint32_t *order, size_t begin, size_t end, KPointCloud const &cloud);
+  void nearest(KVector3D const &point, size_t begin, size_t end, KKdCandidate *best, std::vector<bool> const *excluded) const;
+  void kNearest(KVector3D const &point, size_t begin, size_t end, size_t k, std::priority_queue<KKdCandidate> &heap) const;
+  void withinRadius(KVector3D const &point, size_t begin, size_t end, float radiusSquared, std::vector<size_t> &results) const;
+
+  std::vector<KVector3D> m_points;  // Tree order
+  std::vector<uint32_t> m_indices;  // Tree order to point cloud index
+  std::vector<uint8_t> m_axes;      // Split axis of the node at every median
+  size_t m_parallelDepth;
+};
+
+void KKdTreePrivate::recursiveBuild(size_t depth, uint32_t *order, size_t begin, size_t end, KPointCloud const &cloud)
+{
+  if (end - begin <= KdLeafSize) return;
+
+  // Split the axis of largest extent at the median
+  KVector3D minExtent(std::numeric_limits<float>::max()), maxExtent(-std::numeric_limits<float>::max());
+  for (size_t i = begin; i < end; ++i)
+  {
+    KVector3D const &p = cloud[order[i]];
+    minExtent = KVector3D(std::min(minExtent.x(), p.x()), std::min(minExtent.y(), p.y()), std::min(minExtent.z(), p.z()));
+    maxExtent = KVector3D(std::max(maxExtent.x(), p.x()), std::max(maxExtent.y(), p.y()), std::max(maxExtent.z(), p.z()));
+  }
+  KVector3D extent = maxExtent - minExtent;
+  int axis = (extent.x() >= extent.y() && extent.x() >= extent.z()) ? 0 : (extent.y() >= extent.z()) ? 1 : 2;
+  size_t middle = begin + (end - begin) / 2;
+  std::nth_element(order + begin, order + middle, order + end, [&cloud, axis](uint32_t a, uint32_t b)
+  {
+    return cloud[a][axis] < cloud[b][axis];
+  });
+  m_axes[middle] = static_cast<uint8_t>(axis);
+
+  // Halves are independent, large ones near the root are built in parallel
+  bool parallel = (end - begin >= Karma::ParallelGrainSize && depth < m_parallelDepth);
+  Karma::parallelInvoke(
+    [&]() { recursiveBuild(depth + 1, order, begin, middle, cloud); },
+    [&]() { recursiveBuild(depth + 1, order, middle + 1, end, cloud); },
+    parallel
+  );
+}
+
+void KKdTreePrivate::nearest(KVector3D const &point, size_t begin, size_t end, KKdCandidate *best, std::vector<bool> const *excluded) const
+{
+  if (end - begin <= KdLeafSize)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      float d = distanceSquared(point, m_points[i]);
+      if (d < best->distanceSquared && !(excluded && (*excluded)[m_indices[i]]))
+      {
+        best->distanceSquared = d;
+        best->position = static_cast<uint32_t>(i);
+      }
+    }
+    return;
+  }
+
+  // Visit the side containing the point first, the other only if it may be closer
+  size_t middle = begin + (end - begin) / 2;
+  float split = point[m_axes[middle]] - m_points[middle][m_axes[middle]];
+  float d = distanceSquared(point, m_points[middle]);
+  if (d < best->distanceSquared && !(excluded && (*excluded)[m_indices[middle]]))
+  {
+    best->distanceSquared = d;
+    best->position = static_cast<uint32_t>(middle);
+  }
+  if (split < 0.0f)
+  {
+    nearest(point, begin, middle, best, excluded);
+    if (split * split < best->distanceSquared) nearest(point, middle + 1, end, best, excluded);
+  }
+  else
+  {
+    nearest(point, middle + 1, end, best, excluded);
+    if (split * split < best->distanceSquared) nearest(point, begin, middle, best, excluded);
+  }
+}
+
+void KKdTreePrivate::kNearest(KVector3D const &point, size_t begin, size_t end, size_t k, std::priority_queue<KKdCandidate> &heap) const
+{
+  auto consider = [&](size_t i)
+  {
+    KKdCandidate candidate = { distanceSquared(point, m_points[i]), static_cast<uint32_t>(i) };
+    if (heap.size() < k)
+    {
+      heap.push(candidate);
+    }
+    else if (candidate < heap.top())
+    {
+      heap.pop();
+      heap.push(candidate);
+    }
+  };
+  auto bound = [&]() -> float
+  {
+    return (heap.size() < k) ? std::numeric_limits<float>::infinity() : heap.top().distanceSquared;
+  };
+
+  if (end - begin <= KdLeafSize)
+  {
+    for (size_t i = begin; i < end; ++i) consider(i);
+    return;
+  }
+
+  size_t middle = begin + (end - begin) / 2;
+  float split = point[m_axes[middle]] - m_points[middle][m_axes[middle]];
+  consider(middle);
+  if (split < 0.0f)
+  {
+    kNearest(point, begin, middle, k, heap);
+    if (split * split < bound()) kNearest(point, middle + 1, end, k, heap);
+  }
+  else
+  {
+    kNearest(point, middle + 1, end, k, heap);
+    if (split * split < bound()) kNearest(point, begin, middle, k, heap);
+  }
+}
+
+void KKdTreePrivate::withinRadius(KVector3D const &point, size_t begin, size_t end, float radiusSquared, std::vector<size_t> &results) const
+{
+  if (end - begin <= KdLeafSize)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      if (distanceSquared(point, m_points[i]) <= radiusSquared) results.push_back(m_indices[i]);
+    }
+    return;
+  }
+
+  size_t middle = begin + (end - begin) / 2;
+  float split = point[m_axes[middle]] - m_points[middle][m_axes[middle]];
+  if (distanceSquared(point, m_points[middle]) <= radiusSquared) results.push_back(m_indices[middle]);
+  if (split <= 0.0f || split * split <= radiusSquared) withinRadius(point, begin, middle, radiusSquared, results);
+  if (split >= 0.0f || split * split <= radiusSquared) withinRadius(point, middle + 1, end, radiusSquared, results);
+}
+
+/*******************************************************************************
+ * KKdTree
+ ******************************************************************************/
+const size_t KKdTree::NoPoint;
+
+KKdTree::KKdTree() :
+  m_private(new KKdTreePrivate)
+{
+  // Intentionally Empty
+}
+
+KKdTree::KKdTree(KPointCloud const &cloud) :
+  m_private(new KKdTreePrivate)
+{
+  build(cloud);
+}
+
+KKdTree::~KKdTree()
+{
+  // Intentionally Empty
+}
+
+void KKdTree::build(KPointCloud const &cloud)
+{
+  P(KKdTreePrivate);
+  size_t count = cloud.size();
+  std::vector<uint32_t> order(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    order[i] = static_cast<uint32_t>(i);
+  }
+
+  // Only fork while there are idle threads to pick up the work
+  p.m_parallelDepth = 0;
+  while ((static_cast<size_t>(1) << p.m_parallelDepth) < Karma::threadCount()) ++p.m_parallelDepth;
+  p.m_axes.assign(count, 0);
+  p.recursiveBuild(0, order.data(), 0, count, cloud);
+
+  // Gather the points in tree order, so queries walk contiguous memory
+  p.m_points.resize(count);
+  Karma::parallelFor(count, [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      p.m_points[i] = cloud[order[i]];
+    }
+  });
+  p.m_indices.swap(order);
+}
+
+void KKdTree::clear()
+{
+  P(KKdTreePrivate);
+  p.m_points.clear();
+  p.m_indices.clear();
+  p.m_axes.clear();
+}
+
+size_t KKdTree::size() const
+{
+  P(const KKdTreePrivate);
+  return p.m_points.size();
+}
+
+bool KKdTree::empty() const
+{
+  P(const KKdTreePrivate);
+  return p.m_points.empty();
+}
+
+size_t KKdTree::nearest(KVector3D const &point, float *distanceSquared, std::vector<bool> const *excluded) const
+{
+  P(const KKdTreePrivate);
+  KKdCandidate best = { std::numeric_limits<float>::infinity(), std::numeric_limits<uint32_t>::max() };
+  p.nearest(point, 0, p.m_points.size(), &best, excluded);
+  if (distanceSquared) *distanceSquared = best.distanceSquared;
+  return (best.position == std::numeric_limits<uint32_t>::max()) ? NoPoint : p.m_indices[best.position];
+}
+
+void KKdTree::kNearest(KVector3D const &point, size_t k, std::vector<size_t> &results) const
+{
+  P(const KKdTreePrivate);
+  results.clear();
+  if (k == 0) return;
+
+  // The heap keeps the farthest of the current candidates on top
+  std::priority_queue<KKdCandidate> heap;
+  p.kNearest(point, 0, p.m_points.size(), k, heap);
+  results.resize(heap.size());
+  for (size_t i = heap.size(); i-- > 0; heap.pop())
+  {
+    results[i] = p.m_indices[heap.top().position];
+  }
+}
+
+void KKdTree::withinRadius(KVector3D const &point, float radius, std::vector<size_t> &results) const
+{
+  P(const KKdTreePrivate);
+  results.clear();
+  p.withinRadius(point, 0, p.m_points.size(), radius * radius, results);
+}
+
+void KKdTree::pairsWithin(float epsilon, std::vector<IndexPair> &results) const
+{
+  P(const KKdTreePrivate);
+
+  // Every point looks up its neighbors, pairs are only reported from the lower index
+  size_t count = p.m_points.size();
+  size_t chunks = Karma::parallelChunkCount(count);
+  std::vector<std::vector<IndexPair>> chunkResults(chunks);
+  float epsilonSquared = epsilon * epsilon;
+  Karma::parallelChunks(count, chunks, [&](size_t chunk, size_t begin, size_t end)
+  {
+    std::vector<size_t> neighbors;
+    for (size_t i = begin; i < end; ++i)
+    {
+      neighbors.clear();
+      p.withinRadius(p.m_points[i], 0, count, epsilonSquared, neighbors);
+      size_t index = p.m_indices[i];
+      for (size_t neighbor : neighbors)
+      {
+        if (index < neighbor) chunkResults[chunk].push_back(IndexPair(index, neighbor));
+      }
+    }
+  });
+
+  results.clear();
+  for (std::vector<IndexPair> const &chunk : chunkResults)
+  {
+    results.insert(results.end(), chunk.begin(), chunk.end());
+  }
+}
+
+void KKdTree::nearest(KVector3D const *points, size_t count, size_t *results) const
+{
+  Karma::parallelFor(count, [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      results[i] = nearest(points[i]);
+    }
+  }, Karma::ParallelGrainSize / 16);
+}
+
+void KKdTree::kNearest(KVector3D const *points, size_t count, size_t k, std::vector<size_t> &results) const
+{
+  // Every query gets `k` slots, missing neighbors are NoPoint
+  results.assign(count * k, NoPoint);
+  Karma::parallelFor(count, [&](size_t begin, size_t end)
+  {
+    std::vector<size_t> neighbors;
+    for (size_t i = begin; i < end; ++i)
+    {
+      kNearest(points[i], k, neighbors);
+      std::copy(neighbors.begin(), neighbors.end(), results.begin() + i * k);
+    }
+  }, Karma::ParallelGrainSize / 16);
+}
+
+void KKdTree::withinRadius(KVector3D const *points, size_t count, float radius, std::vector<size_t> &results, std::vector<size_t> &offsets) const
+{
+  P(const KKdTreePrivate);
+
+  // Chunks gather their results separately, which are then concatenated in order
+  size_t chunks = Karma::parallelChunkCount(count, Karma::ParallelGrainSize / 16);
+  std::vector<std::vector<size_t>> chunkResults(chunks);
+  offsets.resize(count + 1);
+  offsets[0] = 0;
+  float radiusSquared = radius * radius;
+  Karma::parallelChunks(count, chunks, [&](size_t chunk, size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      p.withinRadius(points[i], 0, p.m_points.size(), radiusSquared, chunkResults[chunk]);
+      offsets[i + 1] = chunkResults[chunk].size();
+    }
+  });
+
+  results.clear();
+  for (size_t chunk = 0; chunk < chunks; ++chunk)
+  {
+    size_t base = results.size();
+    for (size_t i = chunk * count / chunks; i < (chunk + 1) * count / chunks; ++i)
+    {
+      offsets[i + 1] += base;
+    }
+    results.insert(results.end(), chunkResults[chunk].begin(), chunkResults[chunk].end());
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef KKDTREE_H
+#define KKDTREE_H KKdTree
+
+class KPointCloud;
+class KVector3D;
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include <KSharedPointer>
+
+// Balanced k-d tree over a point cloud, laid out implicitly.
+// Points are reordered so that every node is the median of its range, with the
+// left and right subtrees stored on either side of it; there are no child links.
+// Results are always indices into the point cloud the tree was built from.
+class KKdTreePrivate;
+class KKdTree
+{
+public:
+  typedef std::pair<size_t, size_t> IndexPair;
+  static const size_t NoPoint = static_cast<size_t>(-1);
+
+  KKdTree();
+  explicit KKdTree(KPointCloud const &cloud);
+  ~KKdTree();
+
+  void build(KPointCloud const &cloud);
+  void clear();
+  size_t size() const;
+  bool empty() const;
+
+  // Queries (`excluded` optionally skips points, indexed like the point cloud)
+  // k-nearest results are sorted nearest first, epsilon pairs are reported once (first < second).
+  size_t nearest(KVector3D const &point, float *distanceSquared = 0, std::vector<bool> const *excluded = 0) const;
+  void kNearest(KVector3D const &point, size_t k, std::vector<size_t> &results) const;
+  void withinRadius(KVector3D const &point, float radius, std::vector<size_t> &results) const;
+  void pairsWithin(float epsilon, std::vector<IndexPair> &results) const;
+
+  // Batched Queries (Split across threads, `results` are replaced)
+  // k-nearest results hold `k` slots per query padded with NoPoint, radius results for
+  // query `i` are found in [offsets[i], offsets[i + 1]).
+  void nearest(KVector3D const *points, size_t count, size_t *results) const;
+  void kNearest(KVector3D const *points, size_t count, size_t k, std::vector<size_t> &results) const;
+  void withinRadius(KVector3D const *points, size_t count, float radius, std::vector<size_t> &results, std::vector<size_t> &offsets) const;
+
+private:
+  KSharedPointer<KKdTreePrivate> m_private;
+};
+
+#endif // KKDTREE_H
@@ -6,14 +6,50 @@
 #include <type_traits>
 #include <cstdio>
 #include <cstdint>
+#include <iterator>
+#include <memory>
+#include <functional>
+#include <KParallel>
+
+// Describes which part of the outermost FROM range a query invocation iterates.
+// Only the first container a pass sees is partitioned, nested FROMs see everything.
+// The first partition decides how many chunks the range is worth once its size is
+// known, and starts the others through `m_launch` (Small ranges stay serial).
+class QueryPartition
+{
+public:
+  typedef std::function<void(size_t)> Launcher;
+  QueryPartition(size_t chunk, size_t chunks, Launcher *launch = nullptr) : m_chunk(chunk), m_chunks(chunks), m_claimed(false), m_launch(launch) {}
+  inline bool reset(bool reenter) { m_claimed = false; return reenter; }
+  size_t m_chunk;
+  size_t m_chunks;
+  bool m_claimed;
+  Launcher *m_launch;
+};
+
+// Owns the results of a single query invocation. The result type is only known
+// within the innermost loop, so storage is created the first time it's requested.
+class QueryStorage
+{
+public:
+  template <typename T>
+  T &get()
+  {
+    if (!m_data) m_data = std::shared_ptr<void>(new T(), [](void *data) { delete static_cast<T*>(data); });
+    return *static_cast<T*>(m_data.get());
+  }
+private:
+  std::shared_ptr<void> m_data;
+};
 
 // Caches the reenter variable so it can be modified
 // if the container is empty. (Fixes `select from` empty container).
 class QueryValidator
 {
 public:
-  QueryValidator(bool &reenter) : m_reenter(reenter) {}
+  QueryValidator(bool &reenter, QueryPartition &partition) : m_reenter(reenter), m_partition(partition) {}
   bool &m_reenter;
+  QueryPartition &m_partition;
 };
 
 // Mimic the base iterator type, but keep track of whether the
@@ -52,55 +88,127 @@ public:
   inline value_type const &operator*() { return (this->m_empty) ? *reinterpret_cast<value_type const*>(this) : *static_cast<Iterator&>(*this); }
 };
 
-// Mimic the container type, it's imperative that we do not
-// add members because we aren't constructing a new QueryContainer.
-// We simply cast the original container to look like a QueryContainer
-// to inject our QueryIterator types into the range-based for loop.
-template <typename Container>
-class QueryContainer : public Container
+// A view over (a partition of) the original container, which injects
+// our QueryIterator types into the range-based for loop.
+template <typename Iterator, typename QueryIteratorType>
+class QueryRange
 {
 public:
-  typedef QueryIterator<typename Container::iterator> iterator;
-  typedef ConstQueryIterator<typename Container::const_iterator> const_iterator;
-  inline bool empty() const { return Container::empty(); }
-  inline iterator begin() { return iterator(Container::begin(),empty()); }
-  inline iterator end() { return iterator(Container::end(),empty()); }
-  inline const_iterator begin() const { return const_iterator(Container::begin(),empty()); }
-  inline const_iterator end() const { return const_iterator(Container::end(),empty()); }
-  inline const_iterator cbegin() const { return const_iterator(Container::cbegin(),empty()); }
-  inline const_iterator cend() const { return const_iterator(Container::cend(),empty()); }
+  typedef QueryIteratorType iterator;
+  typedef QueryIteratorType const_iterator;
+  QueryRange(Iterator begin, Iterator end, bool empty) : m_begin(begin), m_end(end), m_empty(empty) {}
+  inline bool empty() const { return m_empty; }
+  inline iterator begin() const { return iterator(m_begin, m_empty); }
+  inline iterator end() const { return iterator(m_end, m_empty); }
+private:
+  Iterator m_begin;
+  Iterator m_end;
+  bool m_empty;
 };
 
+// Restricts [begin, end) to the validator's partition (if it's still unclaimed).
+template <typename Iterator, typename QueryIteratorType>
+QueryRange<Iterator, QueryIteratorType> makeQueryRange(Iterator begin, Iterator end, QueryValidator const &v)
+{
+  QueryPartition &partition = v.m_partition;
+  if (partition.m_chunks > 1 && !partition.m_claimed)
+  {
+    size_t count = static_cast<size_t>(std::distance(begin, end));
+    if (partition.m_launch)
+    {
+      // Small ranges aren't worth splitting, only start the chunks that get work.
+      partition.m_chunks = std::min(partition.m_chunks, ::Karma::parallelChunkCount(count));
+      (*partition.m_launch)(partition.m_chunks);
+      partition.m_launch = nullptr;
+    }
+    size_t first = partition.m_chunk * count / partition.m_chunks;
+    size_t last = (partition.m_chunk + 1) * count / partition.m_chunks;
+    end = std::next(begin, static_cast<typename std::iterator_traits<Iterator>::difference_type>(last));
+    begin = std::next(begin, static_cast<typename std::iterator_traits<Iterator>::difference_type>(first));
+  }
+  partition.m_claimed = true;
+  bool empty = (begin == end);
+  if (empty) v.m_reenter = true;
+  return QueryRange<Iterator, QueryIteratorType>(begin, end, empty);
+}
+
 // global operator to allow the Container to cast to QueryValidator.
 template <typename Container>
-QueryContainer<Container> &operator<<(Container &c, QueryValidator const &v)
+QueryRange<typename Container::iterator, QueryIterator<typename Container::iterator>> operator<<(Container &c, QueryValidator const &v)
 {
-  if (c.empty()) v.m_reenter = true;
-  return static_cast<QueryContainer<Container>&>(c);
+  return makeQueryRange<typename Container::iterator, QueryIterator<typename Container::iterator>>(c.begin(), c.end(), v);
 }
 
 template <typename Container>
-const QueryContainer<Container> &operator<<(const Container &c, QueryValidator const &v)
+QueryRange<typename Container::const_iterator, ConstQueryIterator<typename Container::const_iterator>> operator<<(const Container &c, QueryValidator const &v)
 {
-  if (c.empty()) v.m_reenter = true;
-  return static_cast<const QueryContainer<Container>&>(c);
+  return makeQueryRange<typename Container::const_iterator, ConstQueryIterator<typename Container::const_iterator>>(c.cbegin(), c.cend(), v);
 }
 
 typedef std::int64_t KCountResult;
 
+// Combines the partial results of each partition, in partition order.
+inline void queryMerge(KCountResult &result, KCountResult &partial)
+{
+  result += partial;
+}
+
+template <typename T>
+inline void queryMerge(std::vector<T> &result, std::vector<T> &partial)
+{
+  result.insert(result.end(), std::make_move_iterator(partial.begin()), std::make_move_iterator(partial.end()));
+}
+
+// Runs func(partition) for every partition, and reduces the partial results.
+// The calling thread runs the first partition, which starts the rest once it knows
+// how many chunks the outermost range is worth (at most `chunks`).
+template <typename Func>
+auto queryReduce(size_t chunks, Func func) -> decltype(func(QueryPartition(0, 1)))
+{
+  typedef decltype(func(QueryPartition(0, 1))) Result;
+  if (chunks <= 1) return func(QueryPartition(0, 1));
+  std::vector<Result> partials(1);
+  Karma::TaskGroup group;
+  QueryPartition::Launcher launch = [&func, &partials, &group](size_t used)
+  {
+    partials.resize(used);
+    for (size_t chunk = 1; chunk < used; ++chunk)
+    {
+      group.run([&func, &partials, chunk, used]()
+      {
+        partials[chunk] = func(QueryPartition(chunk, used));
+      });
+    }
+  };
+  Result result = func(QueryPartition(0, chunks, &launch));
+  group.wait();
+  for (size_t chunk = 1; chunk < partials.size(); ++chunk)
+  {
+    queryMerge(result, partials[chunk]);
+  }
+  return result;
+}
+
 // Note: Multiple from queries are allowed, it acts as a nested for-loop.
 // auto query = select from(variable : container)+ where(condition) [join,exclude](value);
-#define DECLVEC(...) static std::vector<decltype(std::make_tuple(__VA_ARGS__))> _results; if (reenter) goto returnResults
-#define DECLRET( ) continue; returnResults: auto retVal = std::move(_results); _results = decltype(_results)(); return std::move(retVal); }}
-#define SELECT [&]() { bool _where; for (bool reenter = false;;reenter = true
-#define FROM(ain) ) for (auto & ain << ::QueryValidator(reenter)
-#define WHERE(test) ) { _where = (test);
-#define JOIN(...) { DECLVEC(__VA_ARGS__); if (_where) _results.emplace_back(__VA_ARGS__); DECLRET(); }
-#define EXCLUDE(...) { DECLVEC(__VA_ARGS__); if (!_where) _results.emplace_back(__VA_ARGS__); DECLRET(); }
-
-#define COUNT [&]() { bool _where; KCountResult _num = 0; for (bool reenter = false;;reenter = true
-#define INCREMENT(k) if (reenter) return _num; if (_where) _num += k; } return _num; }
-#define DECREMENT(k) if (reenter) return _num; if (_where) _num -= k; } return _num; }
+// PARALLEL_SELECT and PARALLEL_COUNT split the first container across threads, so
+// their conditions and values must be safe to evaluate concurrently. Results keep
+// the order of a serial query.
+#define DECLVEC(...) auto &_results = _storage.get<std::vector<decltype(std::make_tuple(__VA_ARGS__))>>(); if (reenter) goto returnResults
+#define DECLRET( ) continue; returnResults: return std::move(_results); }}
+#define DECLQUERY(chunks) [&]() { return ::queryReduce(chunks, [&](::QueryPartition _partition) { bool _where; ::QueryStorage _storage; for (bool reenter = _partition.reset(false);;reenter = _partition.reset(true)
+#define SELECT DECLQUERY(1)
+#define PARALLEL_SELECT DECLQUERY(::Karma::threadCount())
+#define FROM(ain) ) for (auto & ain << ::QueryValidator(reenter, _partition)
+#define WHERE(test) ) { _where = !reenter && (test);
+#define JOIN(...) { DECLVEC(__VA_ARGS__); if (_where) _results.emplace_back(__VA_ARGS__); DECLRET(); }); }
+#define EXCLUDE(...) { DECLVEC(__VA_ARGS__); if (!_where) _results.emplace_back(__VA_ARGS__); DECLRET(); }); }
+
+#define DECLCOUNT(chunks) [&]() { return ::queryReduce(chunks, [&](::QueryPartition _partition) { bool _where; KCountResult _num = 0; for (bool reenter = _partition.reset(false);;reenter = _partition.reset(true)
+#define COUNT DECLCOUNT(1)
+#define PARALLEL_COUNT DECLCOUNT(::Karma::threadCount())
+#define INCREMENT(k) if (reenter) return _num; if (_where) _num += k; } return _num; }); }
+#define DECREMENT(k) if (reenter) return _num; if (_where) _num -= k; } return _num; }); }
 
 
 #endif // KLINQ_H
@@ -0,0 +1,430 @@
+#include "klooseoctree.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <KFrustum>
+#include <KMacros>
+#include <KVector3D>
+
+/*******************************************************************************
+ * KLooseOctree Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Keys pack the level and the integer coordinates of a cell within that level.
+  static const uint32_t LooseCoordinateBits = 20;
+  static const uint32_t LooseMaxDepth = LooseCoordinateBits;
+  static const uint64_t LooseCoordinateMask = (uint64_t(1) << LooseCoordinateBits) - 1;
+  static const uint64_t LooseRootCell = 0;
+  static const uint64_t LooseNoCell = ~uint64_t(0);
+  static const size_t LooseStackSize = 8 * LooseMaxDepth + 1;
+
+  inline uint64_t cellKey(uint32_t level, uint32_t x, uint32_t y, uint32_t z)
+  {
+    return (uint64_t(level) << (3 * LooseCoordinateBits)) | (uint64_t(x) << (2 * LooseCoordinateBits)) | (uint64_t(y) << LooseCoordinateBits) | uint64_t(z);
+  }
+
+  inline uint32_t cellLevel(uint64_t key)
+  {
+    return static_cast<uint32_t>(key >> (3 * LooseCoordinateBits));
+  }
+
+  inline uint32_t cellCoordinate(uint64_t key, int axis)
+  {
+    return static_cast<uint32_t>((key >> ((2 - axis) * LooseCoordinateBits)) & LooseCoordinateMask);
+  }
+
+  inline uint64_t parentKey(uint64_t key)
+  {
+    return cellKey(cellLevel(key) - 1, cellCoordinate(key, 0) >> 1, cellCoordinate(key, 1) >> 1, cellCoordinate(key, 2) >> 1);
+  }
+
+  inline uint32_t childOctant(uint64_t key)
+  {
+    return ((cellCoordinate(key, 0) & 1) << 2) | ((cellCoordinate(key, 1) & 1) << 1) | (cellCoordinate(key, 2) & 1);
+  }
+
+  inline uint64_t childKey(uint64_t key, uint32_t octant)
+  {
+    return cellKey(cellLevel(key) + 1,
+      (cellCoordinate(key, 0) << 1) | ((octant >> 2) & 1),
+      (cellCoordinate(key, 1) << 1) | ((octant >> 1) & 1),
+      (cellCoordinate(key, 2) << 1) | (octant & 1)
+    );
+  }
+
+  enum KLooseOverlap
+  {
+    LooseOutside,
+    LooseIntersects,
+    LooseContains
+  };
+
+  struct KLooseOctreeObject
+  {
+    KVector3D minExtent;
+    KVector3D maxExtent;
+    uint64_t cell;
+    uint32_t slot;
+  };
+
+  struct KLooseOctreeCell
+  {
+    KLooseOctreeCell() : count(0), children(0) {}
+    std::vector<KLooseOctree::Handle> objects;
+    uint32_t count;    // Objects within this cell and all of its descendants
+    uint8_t children;  // Mask of the octants which exist
+  };
+
+  inline bool overlaps(KVector3D const &minA, KVector3D const &maxA, KVector3D const &minB, KVector3D const &maxB)
+  {
+    return minA.x() <= maxB.x() && maxA.x() >= minB.x() &&
+           minA.y() <= maxB.y() && maxA.y() >= minB.y() &&
+           minA.z() <= maxB.z() && maxA.z() >= minB.z();
+  }
+
+  inline bool encloses(KVector3D const &outerMin, KVector3D const &outerMax, KVector3D const &innerMin, KVector3D const &innerMax)
+  {
+    return outerMin.x() <= innerMin.x() && outerMax.x() >= innerMax.x() &&
+           outerMin.y() <= innerMin.y() && outerMax.y() >= innerMax.y() &&
+           outerMin.z() <= innerMin.z() && outerMax.z() >= innerMax.z();
+  }
+
+  // Squared distance from `center` to the closest (or farthest) point of the box.
+  inline float distanceSquared(KVector3D const &center, KVector3D const &minExtent, KVector3D const &maxExtent, bool farthest)
+  {
+    float result = 0.0f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      float d;
+      if (farthest)
+        d = std::max(center[axis] - minExtent[axis], maxExtent[axis] - center[axis]);
+      else
+        d = std::max(std::max(minExtent[axis] - center[axis], center[axis] - maxExtent[axis]), 0.0f);
+      result += d * d;
+    }
+    return result;
+  }
+
+}
+
+/*******************************************************************************
+ * KLooseOctreePrivate
+ ******************************************************************************/
+class KLooseOctreePrivate
+{
+public:
+  typedef KLooseOctree::Handle Handle;
+  KLooseOctreePrivate();
+
+  void reset(KVector3D const &center, float halfSize, size_t maxDepth);
+  void clear();
+  uint64_t selectCell(KVector3D const &minExtent, KVector3D const &maxExtent) const;
+  bool fits(uint64_t cell, KVector3D const &minExtent, KVector3D const &maxExtent) const;
+  void looseBounds(uint64_t cell, KVector3D *minExtent, KVector3D *maxExtent) const;
+  void attach(Handle handle, uint64_t cell);
+  void detach(Handle handle);
+  template <typename CellTest, typename ObjectTest>
+  void query(int state, CellTest cellTest, ObjectTest objectTest, std::vector<Handle> &results) const;
+
+  KVector3D m_origin;
+  float m_size;
+  uint32_t m_maxDepth;
+  std::unordered_map<uint64_t, KLooseOctreeCell> m_cells;
+  std::vector<KLooseOctreeObject> m_objects;
+  std::vector<Handle> m_freeHandles;
+  size_t m_reinsertCount;
+};
+
+KLooseOctreePrivate::KLooseOctreePrivate() :
+  m_size(0.0f), m_maxDepth(0), m_reinsertCount(0)
+{
+  // Intentionally Empty
+}
+
+void KLooseOctreePrivate::reset(KVector3D const &center, float halfSize, size_t maxDepth)
+{
+  m_origin = center - KVector3D(halfSize, halfSize, halfSize);
+  m_size = 2.0f * halfSize;
+  m_maxDepth = static_cast<uint32_t>(std::min<size_t>(maxDepth, LooseMaxDepth));
+  clear();
+}
+
+void KLooseOctreePrivate::clear()
+{
+  m_cells.clear();
+  m_objects.clear();
+  m_freeHandles.clear();
+  m_reinsertCount = 0;
+}
+
+uint64_t KLooseOctreePrivate::selectCell(KVector3D const &minExtent, KVector3D const &maxExtent) const
+{
+  // Objects centered outside of the world are kept in the root, which is always visited
+  KVector3D center = (minExtent + maxExtent) * 0.5f;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (!(center[axis] >= m_origin[axis] && center[axis] < m_origin[axis] + m_size)) return LooseRootCell;
+  }
+
+  // The deepest level whose (tight) cells are at least as large as the object
+  KVector3D extent = maxExtent - minExtent;
+  float size = std::max(extent.x(), std::max(extent.y(), extent.z()));
+  float cellSize = m_size;
+  uint32_t level = 0;
+  while (level < m_maxDepth && size <= cellSize * 0.5f)
+  {
+    cellSize *= 0.5f;
+    ++level;
+  }
+
+  uint32_t coordinate[3];
+  uint32_t last = (1u << level) - 1;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    coordinate[axis] = std::min(last, static_cast<uint32_t>((center[axis] - m_origin[axis]) / cellSize));
+  }
+  return cellKey(level, coordinate[0], coordinate[1], coordinate[2]);
+}
+
+bool KLooseOctreePrivate::fits(uint64_t cell, KVector3D const &minExtent, KVector3D const &maxExtent) const
+{
+  // Objects in the root would fit forever, so they're moved down once they can be.
+  if (cellLevel(cell) == 0) return selectCell(minExtent, maxExtent) == LooseRootCell;
+  KVector3D looseMin, looseMax;
+  looseBounds(cell, &looseMin, &looseMax);
+  return encloses(looseMin, looseMax, minExtent, maxExtent);
+}
+
+void KLooseOctreePrivate::looseBounds(uint64_t cell, KVector3D *minExtent, KVector3D *maxExtent) const
+{
+  float cellSize = m_size / float(1u << cellLevel(cell));
+  KVector3D tightMin = m_origin + KVector3D(cellCoordinate(cell, 0), cellCoordinate(cell, 1), cellCoordinate(cell, 2)) * cellSize;
+  KVector3D half(cellSize * 0.5f, cellSize * 0.5f, cellSize * 0.5f);
+  *minExtent = tightMin - half;
+  *maxExtent = tightMin + KVector3D(cellSize, cellSize, cellSize) + half;
+}
+
+void KLooseOctreePrivate::attach(Handle handle, uint64_t cell)
+{
+  KLooseOctreeObject &object = m_objects[handle];
+  KLooseOctreeCell &owner = m_cells[cell];
+  object.cell = cell;
+  object.slot = static_cast<uint32_t>(owner.objects.size());
+  owner.objects.push_back(handle);
+
+  // Ancestors are created on demand, and count the objects below them
+  for (uint64_t key = cell;; key = parentKey(key))
+  {
+    ++m_cells[key].count;
+    if (cellLevel(key) == 0) break;
+    m_cells[parentKey(key)].children |= static_cast<uint8_t>(1u << childOctant(key));
+  }
+}
+
+void KLooseOctreePrivate::detach(Handle handle)
+{
+  KLooseOctreeObject &object = m_objects[handle];
+  KLooseOctreeCell &owner = m_cells[object.cell];
+  Handle moved = owner.objects.back();
+  owner.objects[object.slot] = moved;
+  m_objects[moved].slot = object.slot;
+  owner.objects.pop_back();
+
+  // Cells are released as soon as nothing is left below them (except for the root)
+  for (uint64_t key = object.cell;; key = parentKey(key))
+  {
+    auto it = m_cells.find(key);
+    --it->second.count;
+    if (cellLevel(key) == 0) break;
+    if (it->second.count == 0)
+    {
+      m_cells.erase(it);
+      m_cells[parentKey(key)].children &= static_cast<uint8_t>(~(1u << childOctant(key)));
+    }
+  }
+  object.cell = LooseNoCell;
+}
+
+template <typename CellTest, typename ObjectTest>
+void KLooseOctreePrivate::query(int state, CellTest cellTest, ObjectTest objectTest, std::vector<Handle> &results) const
+{
+  struct Entry
+  {
+    uint64_t cell;
+    int state;
+    bool contained;
+  };
+
+  if (m_cells.find(LooseRootCell) == m_cells.end()) return;
+  size_t top = 0;
+  Entry stack[LooseStackSize];
+  stack[top++] = { LooseRootCell, state, false };
+  while (top > 0)
+  {
+    Entry entry = stack[--top];
+    KLooseOctreeCell const &cell = m_cells.find(entry.cell)->second;
+    bool root = (cellLevel(entry.cell) == 0);
+
+    // Objects in the root may be outside of the world, so they're always tested
+    KLooseOverlap overlap = LooseContains;
+    if (!entry.contained)
+    {
+      KVector3D looseMin, looseMax;
+      looseBounds(entry.cell, &looseMin, &looseMax);
+      overlap = cellTest(looseMin, looseMax, &entry.state);
+      if (overlap == LooseOutside && !root) continue;
+    }
+    for (Handle handle : cell.objects)
+    {
+      KLooseOctreeObject const &object = m_objects[handle];
+      if ((overlap == LooseContains && !root) || objectTest(object.minExtent, object.maxExtent, entry.state))
+      {
+        results.push_back(handle);
+      }
+    }
+    if (overlap == LooseOutside) continue;
+
+    for (uint32_t octant = 0; octant < 8; ++octant)
+    {
+      if (!(cell.children & (1u << octant))) continue;
+      stack[top++] = { childKey(entry.cell, octant), entry.state, overlap == LooseContains };
+    }
+  }
+}
+
+/*******************************************************************************
+ * KLooseOctree
+ ******************************************************************************/
+KLooseOctree::KLooseOctree() :
+  m_private(new KLooseOctreePrivate)
+{
+  // Intentionally Empty
+}
+
+KLooseOctree::KLooseOctree(KVector3D const &center, float halfSize, size_t maxDepth) :
+  m_private(new KLooseOctreePrivate)
+{
+  reset(center, halfSize, maxDepth);
+}
+
+KLooseOctree::~KLooseOctree()
+{
+  // Intentionally Empty
+}
+
+void KLooseOctree::reset(KVector3D const &center, float halfSize, size_t maxDepth)
+{
+  P(KLooseOctreePrivate);
+  p.reset(center, halfSize, maxDepth);
+}
+
+void KLooseOctree::clear()
+{
+  P(KLooseOctreePrivate);
+  p.clear();
+}
+
+auto KLooseOctree::insert(KVector3D const &minExtent, KVector3D const &maxExtent) -> Handle
+{
+  P(KLooseOctreePrivate);
+  Handle handle;
+  if (p.m_freeHandles.empty())
+  {
+    handle = static_cast<Handle>(p.m_objects.size());
+    p.m_objects.push_back(KLooseOctreeObject());
+  }
+  else
+  {
+    handle = p.m_freeHandles.back();
+    p.m_freeHandles.pop_back();
+  }
+  p.m_objects[handle].minExtent = minExtent;
+  p.m_objects[handle].maxExtent = maxExtent;
+  p.attach(handle, p.selectCell(minExtent, maxExtent));
+  return handle;
+}
+
+void KLooseOctree::update(Handle handle, KVector3D const &minExtent, KVector3D const &maxExtent)
+{
+  P(KLooseOctreePrivate);
+  KLooseOctreeObject &object = p.m_objects[handle];
+  object.minExtent = minExtent;
+  object.maxExtent = maxExtent;
+  if (p.fits(object.cell, minExtent, maxExtent)) return;
+  p.detach(handle);
+  p.attach(handle, p.selectCell(minExtent, maxExtent));
+  ++p.m_reinsertCount;
+}
+
+void KLooseOctree::remove(Handle handle)
+{
+  P(KLooseOctreePrivate);
+  p.detach(handle);
+  p.m_freeHandles.push_back(handle);
+}
+
+void KLooseOctree::query(KFrustum const &frustum, std::vector<Handle> &results) const
+{
+  P(const KLooseOctreePrivate);
+  auto cellTest = [&frustum](KVector3D const &minExtent, KVector3D const &maxExtent, int *planeMask) -> KLooseOverlap
+  {
+    if (!frustum.intersects(minExtent, maxExtent, planeMask)) return LooseOutside;
+    return (*planeMask == 0) ? LooseContains : LooseIntersects;
+  };
+  auto objectTest = [&frustum](KVector3D const &minExtent, KVector3D const &maxExtent, int planeMask) -> bool
+  {
+    return frustum.intersects(minExtent, maxExtent, &planeMask);
+  };
+  p.query(KFrustum::AllPlanes, cellTest, objectTest, results);
+}
+
+void KLooseOctree::query(KVector3D const &minExtent, KVector3D const &maxExtent, std::vector<Handle> &results) const
+{
+  P(const KLooseOctreePrivate);
+  auto cellTest = [&minExtent, &maxExtent](KVector3D const &cellMin, KVector3D const &cellMax, int*) -> KLooseOverlap
+  {
+    if (!overlaps(cellMin, cellMax, minExtent, maxExtent)) return LooseOutside;
+    return encloses(minExtent, maxExtent, cellMin, cellMax) ? LooseContains : LooseIntersects;
+  };
+  auto objectTest = [&minExtent, &maxExtent](KVector3D const &objectMin, KVector3D const &objectMax, int) -> bool
+  {
+    return overlaps(objectMin, objectMax, minExtent, maxExtent);
+  };
+  p.query(0, cellTest, objectTest, results);
+}
+
+void KLooseOctree::query(KVector3D const &center, float radius, std::vector<Handle> &results) const
+{
+  P(const KLooseOctreePrivate);
+  float radiusSquared = radius * radius;
+  auto cellTest = [&center, radiusSquared](KVector3D const &cellMin, KVector3D const &cellMax, int*) -> KLooseOverlap
+  {
+    if (distanceSquared(center, cellMin, cellMax, false) > radiusSquared) return LooseOutside;
+    return (distanceSquared(center, cellMin, cellMax, true) <= radiusSquared) ? LooseContains : LooseIntersects;
+  };
+  auto objectTest = [&center, radiusSquared](KVector3D const &objectMin, KVector3D const &objectMax, int) -> bool
+  {
+    return distanceSquared(center, objectMin, objectMax, false) <= radiusSquared;
+  };
+  p.query(0, cellTest, objectTest, results);
+}
+
+size_t KLooseOctree::size() const
+{
+  P(const KLooseOctreePrivate);
+  return p.m_objects.size() - p.m_freeHandles.size();
+}
+
+size_t KLooseOctree::cellCount() const
+{
+  P(const KLooseOctreePrivate);
+  return p.m_cells.size();
+}
+
+size_t KLooseOctree::reinsertCount() const
+{
+  P(const KLooseOctreePrivate);
+  return p.m_reinsertCount;
+}
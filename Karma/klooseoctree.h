@@ -0,0 +1,50 @@
+#ifndef KLOOSEOCTREE_H
+#define KLOOSEOCTREE_H KLooseOctree
+
+class KFrustum;
+class KVector3D;
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <KSharedPointer>
+
+// Octree of dynamic bounding boxes, addressed by handles.
+// Cells are twice the size of a regular octree cell (looseness factor 2), so an
+// object is placed directly by its size and center, and only moves to another
+// cell once it leaves the loose bounds of its current one.
+class KLooseOctreePrivate;
+class KLooseOctree
+{
+public:
+  typedef uint32_t Handle;
+  static const Handle InvalidHandle = 0xFFFFFFFF;
+  static const size_t DefaultMaxDepth = 8;
+
+  KLooseOctree();
+  KLooseOctree(KVector3D const &center, float halfSize, size_t maxDepth = DefaultMaxDepth);
+  ~KLooseOctree();
+
+  // Objects outside of the world bounds are still valid, but aren't culled hierarchically.
+  void reset(KVector3D const &center, float halfSize, size_t maxDepth = DefaultMaxDepth);
+  void clear();
+
+  // Modification
+  Handle insert(KVector3D const &minExtent, KVector3D const &maxExtent);
+  void update(Handle handle, KVector3D const &minExtent, KVector3D const &maxExtent);
+  void remove(Handle handle);
+
+  // Queries (Results are appended)
+  void query(KFrustum const &frustum, std::vector<Handle> &results) const;
+  void query(KVector3D const &minExtent, KVector3D const &maxExtent, std::vector<Handle> &results) const;
+  void query(KVector3D const &center, float radius, std::vector<Handle> &results) const;
+
+  // Statistics
+  size_t size() const;
+  size_t cellCount() const;
+  size_t reinsertCount() const;
+
+private:
+  KSharedPointer<KLooseOctreePrivate> m_private;
+};
+
+#endif // KLOOSEOCTREE_H
@@ -0,0 +1,131 @@
+#include "kmeshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/*******************************************************************************
+ * Meshlet Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Cones wider than this are never backfacing as a whole, don't bother testing them.
+  static const float MeshletMinConeDot = 0.1f;
+  static const float MeshletDisabledCone = 2.0f;
+
+  inline KVector3D const &positionAt(KVector3D const *positions, size_t stride, uint32_t v)
+  {
+    return *reinterpret_cast<KVector3D const*>(reinterpret_cast<char const*>(positions) + stride * v);
+  }
+
+  void calculateBounds(KMeshlet &meshlet, uint32_t const *indices, KVector3D const *positions, size_t stride)
+  {
+    uint32_t const *begin = &indices[meshlet.indexOffset];
+    uint32_t const *end = begin + 3 * meshlet.triangleCount;
+
+    // Bounding sphere (around the center of the bounding box)
+    KVector3D minExtent(std::numeric_limits<float>::max()), maxExtent(-std::numeric_limits<float>::max());
+    for (uint32_t const *it = begin; it != end; ++it)
+    {
+      KVector3D const &p = positionAt(positions, stride, *it);
+      minExtent = KVector3D(std::min(minExtent.x(), p.x()), std::min(minExtent.y(), p.y()), std::min(minExtent.z(), p.z()));
+      maxExtent = KVector3D(std::max(maxExtent.x(), p.x()), std::max(maxExtent.y(), p.y()), std::max(maxExtent.z(), p.z()));
+    }
+    meshlet.center = (minExtent + maxExtent) * 0.5f;
+    float radiusSq = 0.0f;
+    for (uint32_t const *it = begin; it != end; ++it)
+    {
+      radiusSq = std::max(radiusSq, (positionAt(positions, stride, *it) - meshlet.center).lengthSquared());
+    }
+    meshlet.radius = std::sqrt(radiusSq);
+
+    // Normal cone axis
+    std::vector<KVector3D> normals;
+    normals.reserve(meshlet.triangleCount);
+    KVector3D axis;
+    for (uint32_t const *it = begin; it != end; it += 3)
+    {
+      KVector3D const &p0 = positionAt(positions, stride, it[0]);
+      KVector3D normal = KVector3D::crossProduct(positionAt(positions, stride, it[1]) - p0, positionAt(positions, stride, it[2]) - p0);
+      float length = normal.length();
+      normals.push_back((length > 0.0f) ? normal / length : KVector3D());
+      axis += normals.back();
+    }
+    meshlet.coneApex = meshlet.center;
+    meshlet.coneAxis = axis.normalized();
+    meshlet.coneCutoff = MeshletDisabledCone;
+    if (axis.lengthSquared() == 0.0f) return;
+
+    // Normal cone spread
+    float minDot = 1.0f;
+    for (KVector3D const &normal : normals)
+    {
+      minDot = std::min(minDot, KVector3D::dotProduct(meshlet.coneAxis, normal));
+    }
+    if (minDot <= MeshletMinConeDot) return;
+
+    // Move the apex back along the axis until it's behind every triangle
+    float maxT = 0.0f;
+    for (size_t t = 0; t < normals.size(); ++t)
+    {
+      float dn = KVector3D::dotProduct(meshlet.coneAxis, normals[t]);
+      if (dn <= 0.0f) continue;
+      float dc = KVector3D::dotProduct(meshlet.center - positionAt(positions, stride, begin[3 * t]), normals[t]);
+      maxT = std::max(maxT, dc / dn);
+    }
+    meshlet.coneApex = meshlet.center - meshlet.coneAxis * maxT;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+  }
+
+}
+
+/*******************************************************************************
+ * Karma (Meshlets)
+ ******************************************************************************/
+void Karma::buildMeshlets(std::vector<KMeshlet> &meshlets, uint32_t const *indices, size_t indexCount, KVector3D const *positions, size_t positionStride, size_t vertexCount, size_t maxVertices, size_t maxTriangles)
+{
+  static const uint32_t NoMeshlet = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> owner(vertexCount, NoMeshlet);
+  meshlets.clear();
+
+  KMeshlet current = KMeshlet();
+  uint32_t currentId = 0;
+  auto newVertices = [&owner, &currentId](uint32_t const *tri) -> size_t
+  {
+    size_t added = 0;
+    if (owner[tri[0]] != currentId) ++added;
+    if (owner[tri[1]] != currentId && tri[1] != tri[0]) ++added;
+    if (owner[tri[2]] != currentId && tri[2] != tri[0] && tri[2] != tri[1]) ++added;
+    return added;
+  };
+
+  for (size_t i = 0; i < indexCount; i += 3)
+  {
+    uint32_t const *tri = &indices[i];
+    size_t added = newVertices(tri);
+
+    // Flush the meshlet once it's full
+    if (current.triangleCount == maxTriangles || current.vertexCount + added > maxVertices)
+    {
+      meshlets.push_back(current);
+      current = KMeshlet();
+      current.indexOffset = static_cast<uint32_t>(i);
+      ++currentId;
+      added = newVertices(tri);
+    }
+
+    owner[tri[0]] = owner[tri[1]] = owner[tri[2]] = currentId;
+    current.vertexCount += static_cast<uint32_t>(added);
+    ++current.triangleCount;
+  }
+  if (current.triangleCount > 0)
+  {
+    meshlets.push_back(current);
+  }
+
+  for (KMeshlet &meshlet : meshlets)
+  {
+    calculateBounds(meshlet, indices, positions, positionStride);
+  }
+}
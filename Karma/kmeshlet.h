@@ -0,0 +1,40 @@
+#ifndef KMESHLET_H
+#define KMESHLET_H KMeshlet
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <KVector3D>
+
+// A small cluster of triangles which is culled as a unit.
+// Triangles of a meshlet are contiguous within the source index buffer.
+struct KMeshlet
+{
+  uint32_t indexOffset;
+  uint32_t triangleCount;
+  uint32_t vertexCount;
+  KVector3D center;
+  float radius;
+  KVector3D coneApex;
+  KVector3D coneAxis;
+  float coneCutoff;
+};
+
+namespace Karma
+{
+
+  static const size_t MeshletMaxVertices = 64;
+  static const size_t MeshletMaxTriangles = 124;
+
+  // Partitions the triangles in input order, so the input should be cache optimized first.
+  void buildMeshlets(std::vector<KMeshlet> &meshlets, uint32_t const *indices, size_t indexCount, KVector3D const *positions, size_t positionStride, size_t vertexCount, size_t maxVertices = MeshletMaxVertices, size_t maxTriangles = MeshletMaxTriangles);
+
+  // True if every triangle of the meshlet faces away from `eye`.
+  inline bool meshletBackfacing(KVector3D const &apex, KVector3D const &axis, float cutoff, KVector3D const &eye)
+  {
+    return KVector3D::dotProduct((apex - eye).normalized(), axis) >= cutoff;
+  }
+
+}
+
+#endif // KMESHLET_H
@@ -0,0 +1,611 @@
+#include "kmeshoptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <KVector3D>
+
+/*******************************************************************************
+ * Vertex Cache Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Forsyth scoring constants (cache is larger than the simulated FIFO on purpose)
+  static const size_t ForsythCacheSize = 32;
+  static const float ForsythCacheDecayPower = 1.5f;
+  static const float ForsythLastTriangleScore = 0.75f;
+  static const float ForsythValenceBoostScale = 2.0f;
+  static const float ForsythValenceBoostPower = 0.5f;
+  static const uint32_t InvalidTriangle = std::numeric_limits<uint32_t>::max();
+
+  float forsythScore(int cachePosition, uint32_t remaining)
+  {
+    // No triangles left, the vertex is of no use
+    if (remaining == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+      // The last triangle's vertices get a fixed score, so it isn't re-used immediately
+      if (cachePosition < 3)
+      {
+        score = ForsythLastTriangleScore;
+      }
+      else
+      {
+        float scaler = 1.0f / (ForsythCacheSize - 3);
+        score = std::pow(1.0f - (cachePosition - 3) * scaler, ForsythCacheDecayPower);
+      }
+    }
+
+    // Boost vertices with few triangles left, so we don't leave lone triangles behind
+    return score + ForsythValenceBoostScale * std::pow(static_cast<float>(remaining), -ForsythValenceBoostPower);
+  }
+
+  // Timestamped FIFO cache, resetting is done by advancing the timestamp.
+  class FifoCache
+  {
+  public:
+    FifoCache(size_t vertexCount, size_t cacheSize) :
+      m_times(vertexCount, 0), m_timestamp(static_cast<uint32_t>(cacheSize) + 1), m_size(static_cast<uint32_t>(cacheSize))
+    {
+      // Intentionally Empty
+    }
+    inline unsigned touch(uint32_t v)
+    {
+      if (m_timestamp - m_times[v] > m_size)
+      {
+        m_times[v] = m_timestamp++;
+        return 1;
+      }
+      return 0;
+    }
+    inline unsigned touch(uint32_t const *triangle)
+    {
+      return touch(triangle[0]) + touch(triangle[1]) + touch(triangle[2]);
+    }
+    inline void reset()
+    {
+      m_timestamp += m_size + 1;
+    }
+  private:
+    std::vector<uint32_t> m_times;
+    uint32_t m_timestamp;
+    uint32_t m_size;
+  };
+
+  // Symmetric 4x4 error quadric (Garland & Heckbert), normalized by its accumulated weight.
+  struct Quadric
+  {
+    Quadric() :
+      a00(0), a01(0), a02(0), a11(0), a12(0), a22(0), b0(0), b1(0), b2(0), c(0), w(0)
+    {
+      // Intentionally Empty
+    }
+    Quadric(KVector3D const &n, float d, float weight) :
+      a00(weight * n.x() * n.x()), a01(weight * n.x() * n.y()), a02(weight * n.x() * n.z()),
+      a11(weight * n.y() * n.y()), a12(weight * n.y() * n.z()), a22(weight * n.z() * n.z()),
+      b0(weight * d * n.x()), b1(weight * d * n.y()), b2(weight * d * n.z()),
+      c(weight * d * d), w(weight)
+    {
+      // Intentionally Empty
+    }
+    Quadric &operator+=(Quadric const &rhs)
+    {
+      a00 += rhs.a00; a01 += rhs.a01; a02 += rhs.a02;
+      a11 += rhs.a11; a12 += rhs.a12; a22 += rhs.a22;
+      b0 += rhs.b0; b1 += rhs.b1; b2 += rhs.b2;
+      c += rhs.c; w += rhs.w;
+      return *this;
+    }
+    Quadric operator+(Quadric const &rhs) const
+    {
+      Quadric result(*this);
+      return result += rhs;
+    }
+    double error(KVector3D const &p) const
+    {
+      double x = p.x(), y = p.y(), z = p.z();
+      double e =
+          a00 * x * x + a11 * y * y + a22 * z * z
+        + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+        + 2.0 * (b0 * x + b1 * y + b2 * z)
+        + c;
+      return (w > 0.0) ? std::abs(e) / w : 0.0;
+    }
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c, w;
+  };
+
+  // Boundary edges are weighted heavier than faces so borders don't shrink.
+  static const float SimplifyBoundaryWeight = 10.0f;
+
+  enum SimplifyVertexKind
+  {
+    InteriorVertex,
+    BoundaryVertex,
+    LockedVertex
+  };
+
+  struct SimplifyEdge
+  {
+    uint64_t key;
+    uint32_t from, to, triangle;
+    bool operator<(SimplifyEdge const &rhs) const { return key < rhs.key; }
+  };
+
+  struct SimplifyCollapse
+  {
+    double cost;
+    uint32_t from, to;
+    bool operator<(SimplifyCollapse const &rhs) const { return cost < rhs.cost; }
+  };
+
+  void collectSimplifyEdges(std::vector<uint32_t> const &indices, std::vector<SimplifyEdge> &edges)
+  {
+    edges.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+      SimplifyEdge &edge = edges[i];
+      edge.from = indices[i];
+      edge.to = indices[(i % 3 == 2) ? i - 2 : i + 1];
+      edge.triangle = static_cast<uint32_t>(i / 3);
+      edge.key = (static_cast<uint64_t>(std::max(edge.from, edge.to)) << 32) | std::min(edge.from, edge.to);
+    }
+    std::sort(edges.begin(), edges.end());
+  }
+
+  inline KVector3D const &positionAt(KVector3D const *positions, size_t stride, uint32_t v)
+  {
+    return *reinterpret_cast<KVector3D const*>(reinterpret_cast<char const*>(positions) + stride * v);
+  }
+
+}
+
+/*******************************************************************************
+ * KVertexCacheStatistics
+ ******************************************************************************/
+KVertexCacheStatistics::KVertexCacheStatistics() :
+  transforms(0), acmr(0.0f), atvr(0.0f)
+{
+  // Intentionally Empty
+}
+
+/*******************************************************************************
+ * Karma (Mesh Optimization)
+ ******************************************************************************/
+KVertexCacheStatistics Karma::analyzeVertexCache(uint32_t const *indices, size_t indexCount, size_t vertexCount, size_t cacheSize)
+{
+  KVertexCacheStatistics stats;
+  size_t faceCount = indexCount / 3;
+  if (faceCount == 0) return stats;
+
+  FifoCache cache(vertexCount, cacheSize);
+  std::vector<bool> referenced(vertexCount, false);
+  size_t uniqueVertices = 0;
+  for (size_t i = 0; i < indexCount; ++i)
+  {
+    stats.transforms += cache.touch(indices[i]);
+    if (!referenced[indices[i]])
+    {
+      referenced[indices[i]] = true;
+      ++uniqueVertices;
+    }
+  }
+
+  stats.acmr = static_cast<float>(stats.transforms) / faceCount;
+  stats.atvr = static_cast<float>(stats.transforms) / uniqueVertices;
+  return stats;
+}
+
+void Karma::optimizeVertexCache(uint32_t *destination, uint32_t const *indices, size_t indexCount, size_t vertexCount)
+{
+  size_t faceCount = indexCount / 3;
+  if (faceCount == 0) return;
+
+  // Vertex => Triangle adjacency (the first `remaining` entries are unemitted)
+  std::vector<uint32_t> remaining(vertexCount, 0);
+  std::vector<uint32_t> offsets(vertexCount + 1, 0);
+  std::vector<uint32_t> adjacency(indexCount);
+  for (size_t i = 0; i < indexCount; ++i)
+  {
+    ++remaining[indices[i]];
+  }
+  for (size_t v = 0; v < vertexCount; ++v)
+  {
+    offsets[v + 1] = offsets[v] + remaining[v];
+  }
+  {
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+      adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+
+  // Initial scores
+  std::vector<int> cachePosition(vertexCount, -1);
+  std::vector<float> vertexScores(vertexCount);
+  std::vector<float> triangleScores(faceCount);
+  std::vector<bool> emitted(faceCount, false);
+  for (size_t v = 0; v < vertexCount; ++v)
+  {
+    vertexScores[v] = forsythScore(-1, remaining[v]);
+  }
+  uint32_t best = 0;
+  for (size_t f = 0; f < faceCount; ++f)
+  {
+    uint32_t const *tri = &indices[3 * f];
+    triangleScores[f] = vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+    if (triangleScores[f] > triangleScores[best]) best = static_cast<uint32_t>(f);
+  }
+
+  std::vector<uint32_t> cache, nextCache;
+  cache.reserve(ForsythCacheSize + 3);
+  nextCache.reserve(ForsythCacheSize + 3);
+  size_t cursor = 0;
+  for (size_t out = 0; out < faceCount; ++out)
+  {
+    // Dead end, continue with the next triangle in input order
+    if (best == InvalidTriangle)
+    {
+      while (emitted[cursor]) ++cursor;
+      best = static_cast<uint32_t>(cursor);
+    }
+
+    // Emit the triangle
+    uint32_t const *tri = &indices[3 * best];
+    std::copy(tri, tri + 3, &destination[3 * out]);
+    emitted[best] = true;
+
+    // Remove the triangle from the adjacency of its vertices
+    for (size_t k = 0; k < 3; ++k)
+    {
+      uint32_t *list = &adjacency[offsets[tri[k]]];
+      uint32_t *last = list + remaining[tri[k]] - 1;
+      std::iter_swap(std::find(list, last, best), last);
+      --remaining[tri[k]];
+    }
+
+    // Move the triangle's vertices to the front of the LRU cache
+    nextCache.clear();
+    for (size_t k = 0; k < 3; ++k)
+    {
+      if (std::find(nextCache.begin(), nextCache.end(), tri[k]) == nextCache.end())
+      {
+        nextCache.push_back(tri[k]);
+      }
+    }
+    for (uint32_t v : cache)
+    {
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+      {
+        nextCache.push_back(v);
+      }
+    }
+
+    // Update the scores of everything touched (evicted vertices included)
+    for (size_t i = 0; i < nextCache.size(); ++i)
+    {
+      uint32_t v = nextCache[i];
+      cachePosition[v] = (i < ForsythCacheSize) ? static_cast<int>(i) : -1;
+      vertexScores[v] = forsythScore(cachePosition[v], remaining[v]);
+    }
+
+    // Pick the best triangle which has a vertex in the cache
+    best = InvalidTriangle;
+    float bestScore = -std::numeric_limits<float>::max();
+    for (uint32_t v : nextCache)
+    {
+      uint32_t const *list = &adjacency[offsets[v]];
+      for (uint32_t t = 0; t < remaining[v]; ++t)
+      {
+        uint32_t const *adjTri = &indices[3 * list[t]];
+        float score = vertexScores[adjTri[0]] + vertexScores[adjTri[1]] + vertexScores[adjTri[2]];
+        triangleScores[list[t]] = score;
+        if (cachePosition[v] >= 0 && score > bestScore)
+        {
+          best = list[t];
+          bestScore = score;
+        }
+      }
+    }
+
+    if (nextCache.size() > ForsythCacheSize) nextCache.resize(ForsythCacheSize);
+    cache.swap(nextCache);
+  }
+}
+
+void Karma::optimizeOverdraw(uint32_t *destination, uint32_t const *indices, size_t indexCount, KVector3D const *positions, size_t positionStride, size_t vertexCount, float threshold)
+{
+  size_t faceCount = indexCount / 3;
+  if (faceCount == 0) return;
+
+  // Hard boundaries: triangles that miss on every vertex start a new patch
+  FifoCache cache(vertexCount, DefaultVertexCacheSize);
+  std::vector<size_t> patches;
+  for (size_t f = 0; f < faceCount; ++f)
+  {
+    if (cache.touch(&indices[3 * f]) == 3 || f == 0) patches.push_back(f);
+  }
+  patches.push_back(faceCount);
+
+  // Soft boundaries: split patches once the running ACMR is within threshold
+  std::vector<size_t> clusters;
+  for (size_t p = 0; p + 1 < patches.size(); ++p)
+  {
+    size_t begin = patches[p], end = patches[p + 1];
+    size_t misses = 0;
+    cache.reset();
+    for (size_t f = begin; f < end; ++f)
+    {
+      misses += cache.touch(&indices[3 * f]);
+    }
+    float clusterThreshold = threshold * static_cast<float>(misses) / (end - begin);
+
+    size_t start = begin;
+    misses = 0;
+    cache.reset();
+    clusters.push_back(begin);
+    for (size_t f = begin; f + 1 < end; ++f)
+    {
+      misses += cache.touch(&indices[3 * f]);
+      if (static_cast<float>(misses) / (f + 1 - start) <= clusterThreshold)
+      {
+        start = f + 1;
+        misses = 0;
+        cache.reset();
+        clusters.push_back(start);
+      }
+    }
+  }
+  clusters.push_back(faceCount);
+
+  // Mesh centroid
+  KVector3D meshCentroid;
+  for (size_t i = 0; i < indexCount; ++i)
+  {
+    meshCentroid += positionAt(positions, positionStride, indices[i]);
+  }
+  meshCentroid /= static_cast<float>(indexCount);
+
+  // Sort clusters by how much they face away from the centroid (outside-in)
+  size_t clusterCount = clusters.size() - 1;
+  std::vector<float> sortKeys(clusterCount);
+  std::vector<uint32_t> order(clusterCount);
+  for (size_t c = 0; c < clusterCount; ++c)
+  {
+    KVector3D centroid, normal;
+    float area = 0.0f;
+    for (size_t f = clusters[c]; f < clusters[c + 1]; ++f)
+    {
+      KVector3D const &p0 = positionAt(positions, positionStride, indices[3 * f + 0]);
+      KVector3D const &p1 = positionAt(positions, positionStride, indices[3 * f + 1]);
+      KVector3D const &p2 = positionAt(positions, positionStride, indices[3 * f + 2]);
+      KVector3D weightedNormal = KVector3D::crossProduct(p1 - p0, p2 - p0);
+      float weight = weightedNormal.length();
+      centroid += (p0 + p1 + p2) * (weight / 3.0f);
+      normal += weightedNormal;
+      area += weight;
+    }
+    if (area > 0.0f) centroid /= area;
+
+    // Degenerate (or cancelling) clusters face no direction, they keep a neutral key
+    float length = normal.length();
+    sortKeys[c] = (length > area * 1e-6f) ? KVector3D::dotProduct(centroid - meshCentroid, normal) / length : 0.0f;
+    order[c] = static_cast<uint32_t>(c);
+  }
+  std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t lhs, uint32_t rhs)
+  {
+    return sortKeys[lhs] > sortKeys[rhs];
+  });
+
+  // Emit clusters
+  uint32_t *dest = destination;
+  for (uint32_t c : order)
+  {
+    dest = std::copy(&indices[3 * clusters[c]], &indices[3 * clusters[c + 1]], dest);
+  }
+}
+
+size_t Karma::simplify(uint32_t *destination, uint32_t const *indices, size_t indexCount, KVector3D const *positions, size_t positionStride, size_t vertexCount, size_t targetIndexCount, float targetError, float *resultError)
+{
+  std::vector<uint32_t> triangles(indices, indices + indexCount);
+  double maxCost = 0.0;
+
+  // Work in unit space, so errors are relative to the mesh extents
+  std::vector<KVector3D> points(vertexCount);
+  KVector3D minExtent(std::numeric_limits<float>::max()), maxExtent(-std::numeric_limits<float>::max());
+  for (size_t v = 0; v < vertexCount; ++v)
+  {
+    KVector3D const &p = positionAt(positions, positionStride, static_cast<uint32_t>(v));
+    minExtent = KVector3D(std::min(minExtent.x(), p.x()), std::min(minExtent.y(), p.y()), std::min(minExtent.z(), p.z()));
+    maxExtent = KVector3D(std::max(maxExtent.x(), p.x()), std::max(maxExtent.y(), p.y()), std::max(maxExtent.z(), p.z()));
+  }
+  KVector3D size = maxExtent - minExtent;
+  float extent = std::max(size.x(), std::max(size.y(), size.z()));
+  float scale = (extent > 0.0f) ? 1.0f / extent : 1.0f;
+  for (size_t v = 0; v < vertexCount; ++v)
+  {
+    points[v] = (positionAt(positions, positionStride, static_cast<uint32_t>(v)) - minExtent) * scale;
+  }
+
+  // Face quadrics
+  std::vector<Quadric> quadrics(vertexCount);
+  for (size_t i = 0; i < triangles.size(); i += 3)
+  {
+    KVector3D const &p0 = points[triangles[i]];
+    KVector3D normal = KVector3D::crossProduct(points[triangles[i + 1]] - p0, points[triangles[i + 2]] - p0);
+    float area = normal.length();
+    if (area <= 0.0f) continue;
+    normal /= area;
+    Quadric q(normal, -KVector3D::dotProduct(normal, p0), area);
+    quadrics[triangles[i + 0]] += q;
+    quadrics[triangles[i + 1]] += q;
+    quadrics[triangles[i + 2]] += q;
+  }
+
+  // Boundary quadrics (planes through the edge, perpendicular to its face)
+  std::vector<SimplifyEdge> edges;
+  collectSimplifyEdges(triangles, edges);
+  for (size_t i = 0; i < edges.size(); ++i)
+  {
+    bool single = (i == 0 || edges[i - 1].key != edges[i].key) && (i + 1 == edges.size() || edges[i + 1].key != edges[i].key);
+    if (!single) continue;
+    uint32_t const *tri = &triangles[3 * edges[i].triangle];
+    KVector3D const &p0 = points[tri[0]];
+    KVector3D faceNormal = KVector3D::crossProduct(points[tri[1]] - p0, points[tri[2]] - p0);
+    KVector3D edge = points[edges[i].to] - points[edges[i].from];
+    KVector3D normal = KVector3D::crossProduct(edge, faceNormal).normalized();
+    Quadric q(normal, -KVector3D::dotProduct(normal, points[edges[i].from]), edge.lengthSquared() * SimplifyBoundaryWeight);
+    quadrics[edges[i].from] += q;
+    quadrics[edges[i].to] += q;
+  }
+
+  // Collapse passes: each pass collapses independent edges in order of cost
+  size_t targetTriangles = targetIndexCount / 3;
+  size_t triangleCount = triangles.size() / 3;
+  double maxErrorSq = static_cast<double>(targetError) * targetError;
+  std::vector<uint8_t> kinds(vertexCount);
+  std::vector<uint8_t> locked(vertexCount);
+  std::vector<uint32_t> remap(vertexCount);
+  std::vector<uint32_t> offsets(vertexCount + 1);
+  std::vector<uint32_t> adjacency;
+  std::vector<SimplifyCollapse> collapses;
+  while (triangleCount > targetTriangles)
+  {
+    if (edges.empty()) collectSimplifyEdges(triangles, edges);
+
+    // Classify vertices by the edges touching them
+    std::fill(kinds.begin(), kinds.end(), static_cast<uint8_t>(InteriorVertex));
+    for (size_t begin = 0, end = 0; begin < edges.size(); begin = end)
+    {
+      while (end < edges.size() && edges[end].key == edges[begin].key) ++end;
+      uint8_t kind = (end - begin == 1) ? BoundaryVertex : (end - begin > 2) ? LockedVertex : InteriorVertex;
+      kinds[edges[begin].from] = std::max(kinds[edges[begin].from], kind);
+      kinds[edges[begin].to] = std::max(kinds[edges[begin].to], kind);
+    }
+
+    // Gather the cheapest valid direction of every edge
+    collapses.clear();
+    for (size_t begin = 0, end = 0; begin < edges.size(); begin = end)
+    {
+      while (end < edges.size() && edges[end].key == edges[begin].key) ++end;
+      if (end - begin > 2) continue;
+      bool boundaryEdge = (end - begin == 1);
+      uint32_t a = edges[begin].from, b = edges[begin].to;
+      bool canA = kinds[a] == InteriorVertex || (kinds[a] == BoundaryVertex && boundaryEdge);
+      bool canB = kinds[b] == InteriorVertex || (kinds[b] == BoundaryVertex && boundaryEdge);
+      if (!canA && !canB) continue;
+      Quadric q = quadrics[a] + quadrics[b];
+      double costA = canA ? q.error(points[b]) : std::numeric_limits<double>::max();
+      double costB = canB ? q.error(points[a]) : std::numeric_limits<double>::max();
+      SimplifyCollapse collapse;
+      collapse.cost = std::min(costA, costB);
+      collapse.from = (costA <= costB) ? a : b;
+      collapse.to = (costA <= costB) ? b : a;
+      collapses.push_back(collapse);
+    }
+    std::sort(collapses.begin(), collapses.end());
+
+    // Only the cheapest share of edges are considered per pass, so expensive
+    // collapses don't win just because their cheaper neighbors got locked.
+    double passErrorSq = maxErrorSq;
+    if (!collapses.empty())
+    {
+      passErrorSq = std::min(passErrorSq, collapses[collapses.size() / 3].cost);
+    }
+
+    // Vertex => Triangle adjacency
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (uint32_t v : triangles) ++offsets[v + 1];
+    for (size_t v = 0; v < vertexCount; ++v) offsets[v + 1] += offsets[v];
+    adjacency.resize(triangles.size());
+    {
+      std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+      for (size_t i = 0; i < triangles.size(); ++i)
+      {
+        adjacency[fill[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+      }
+    }
+
+    // Collapse edges whose neighborhoods haven't been touched this pass
+    size_t collapsed = 0;
+    std::fill(locked.begin(), locked.end(), 0);
+    for (size_t v = 0; v < vertexCount; ++v) remap[v] = static_cast<uint32_t>(v);
+    for (SimplifyCollapse const &collapse : collapses)
+    {
+      if (triangleCount <= targetTriangles || collapse.cost > passErrorSq) break;
+      if (locked[collapse.from] || locked[collapse.to]) continue;
+
+      // Reject collapses which flip a remaining triangle
+      bool flips = false;
+      for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1] && !flips; ++i)
+      {
+        uint32_t const *tri = &triangles[3 * adjacency[i]];
+        if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) continue;
+        KVector3D p[3], q[3];
+        for (size_t k = 0; k < 3; ++k)
+        {
+          p[k] = points[tri[k]];
+          q[k] = points[(tri[k] == collapse.from) ? collapse.to : tri[k]];
+        }
+        KVector3D before = KVector3D::crossProduct(p[1] - p[0], p[2] - p[0]);
+        KVector3D after = KVector3D::crossProduct(q[1] - q[0], q[2] - q[0]);
+        flips = KVector3D::dotProduct(before, after) <= 0.0f;
+      }
+      if (flips) continue;
+
+      // Apply the collapse, and lock the neighborhood
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1]; ++i)
+      {
+        uint32_t const *tri = &triangles[3 * adjacency[i]];
+        locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = 1;
+        if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) --triangleCount;
+      }
+      maxCost = std::max(maxCost, collapse.cost);
+      ++collapsed;
+    }
+    if (collapsed == 0) break;
+
+    // Rewrite the triangles, removing the degenerate ones
+    size_t write = 0;
+    for (size_t i = 0; i < triangles.size(); i += 3)
+    {
+      uint32_t a = remap[triangles[i]], b = remap[triangles[i + 1]], c = remap[triangles[i + 2]];
+      if (a == b || b == c || c == a) continue;
+      triangles[write++] = a;
+      triangles[write++] = b;
+      triangles[write++] = c;
+    }
+    triangles.resize(write);
+    triangleCount = write / 3;
+    edges.clear();
+  }
+
+  if (resultError) *resultError = static_cast<float>(std::sqrt(maxCost));
+  std::copy(triangles.begin(), triangles.end(), destination);
+  return triangles.size();
+}
+
+void Karma::optimizeVertexFetch(uint32_t *indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t> &remap)
+{
+  static const uint32_t Unassigned = std::numeric_limits<uint32_t>::max();
+  remap.assign(vertexCount, Unassigned);
+
+  uint32_t next = 0;
+  for (size_t i = 0; i < indexCount; ++i)
+  {
+    uint32_t &mapped = remap[indices[i]];
+    if (mapped == Unassigned) mapped = next++;
+    indices[i] = mapped;
+  }
+  for (uint32_t &mapped : remap)
+  {
+    if (mapped == Unassigned) mapped = next++;
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef KMESHOPTIMIZER_H
+#define KMESHOPTIMIZER_H KMeshOptimizer
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class KVector3D;
+
+struct KVertexCacheStatistics
+{
+  KVertexCacheStatistics();
+  size_t transforms;  // Vertex shader invocations
+  float acmr;         // Average cache miss ratio (transforms per triangle, 0.5 is ideal)
+  float atvr;         // Average transform to vertex ratio (1.0 is ideal)
+};
+
+namespace Karma
+{
+
+  // Typical post-transform cache size of modern hardware.
+  static const size_t DefaultVertexCacheSize = 16;
+
+  // Simulates a FIFO post-transform cache over a triangle list.
+  KVertexCacheStatistics analyzeVertexCache(uint32_t const *indices, size_t indexCount, size_t vertexCount, size_t cacheSize = DefaultVertexCacheSize);
+
+  // Reorders triangles for the post-transform cache (Forsyth's linear-speed algorithm).
+  // Note: destination and indices may not alias.
+  void optimizeVertexCache(uint32_t *destination, uint32_t const *indices, size_t indexCount, size_t vertexCount);
+
+  // Splits cache-optimized triangles into clusters and sorts them outside-in to reduce overdraw.
+  // Clusters are allowed to grow the ACMR up to `threshold` times the input's ACMR.
+  // Note: destination and indices may not alias, `positionStride` is in bytes.
+  void optimizeOverdraw(uint32_t *destination, uint32_t const *indices, size_t indexCount, KVector3D const *positions, size_t positionStride, size_t vertexCount, float threshold = 1.05f);
+
+  // Quadric error metric simplification, collapsing edges onto existing vertices so that
+  // every level of detail can share one vertex buffer. Stops once `targetIndexCount` is
+  // reached or the next collapse would exceed `targetError` (relative to the mesh extents).
+  // Boundaries are preserved, returns the resulting index count. Note: destination may alias indices.
+  size_t simplify(uint32_t *destination, uint32_t const *indices, size_t indexCount, KVector3D const *positions, size_t positionStride, size_t vertexCount, size_t targetIndexCount, float targetError, float *resultError = nullptr);
+
+  // Renumbers vertices in order of first use so vertex fetches are sequential.
+  // Indices are rewritten in-place; remap[oldVertex] = newVertex (unreferenced vertices are kept at the end).
+  void optimizeVertexFetch(uint32_t *indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t> &remap);
+
+}
+
+#endif // KMESHOPTIMIZER_H
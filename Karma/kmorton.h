@@ -0,0 +1,51 @@
+#ifndef KMORTON_H
+#define KMORTON_H KMorton
+
+#include <algorithm>
+#include <cstdint>
+#include <KVector3D>
+
+namespace Karma
+{
+
+  // 30-bit Morton codes interleave 10 bits per axis, one octree level per 3 bits.
+  static const uint32_t MortonLevels = 10;
+  static const uint32_t MortonResolution = 1 << MortonLevels;
+
+  // Spreads the lower 10 bits of `v` so two zero bits follow each of them.
+  inline uint32_t mortonExpandBits(uint32_t v)
+  {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+  }
+
+  // Interleaves as ..xyzxyz, so the top 3 bits select the octant of the root.
+  inline uint32_t mortonCode(uint32_t x, uint32_t y, uint32_t z)
+  {
+    return (mortonExpandBits(x) << 2) | (mortonExpandBits(y) << 1) | mortonExpandBits(z);
+  }
+
+  // Code of a point, `scale` maps the bounds onto [0, MortonResolution).
+  inline uint32_t mortonCode(KVector3D const &point, KVector3D const &minExtent, float scale)
+  {
+    uint32_t cell[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      float f = (point[axis] - minExtent[axis]) * scale;
+      cell[axis] = static_cast<uint32_t>(std::min(std::max(f, 0.0f), static_cast<float>(MortonResolution - 1)));
+    }
+    return mortonCode(cell[0], cell[1], cell[2]);
+  }
+
+  // Octant (0-7) of the cell containing `code`, at the given depth below the root.
+  inline uint32_t mortonOctant(uint32_t code, uint32_t depth)
+  {
+    return (code >> (3 * (MortonLevels - 1 - depth))) & 7;
+  }
+
+}
+
+#endif // KMORTON_H
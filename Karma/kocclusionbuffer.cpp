@@ -0,0 +1,389 @@
+#include "kocclusionbuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <KMacros>
+#include <KMatrix4x4>
+#include <KParallel>
+#include <KVector3D>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*******************************************************************************
+ * Occlusion Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Anything closer to the eye plane than this is treated as behind the camera
+  static const float OcclusionMinW = 1e-5f;
+
+  // Triangles are kept as three edge functions and a depth plane over pixel
+  // coordinates, the plane is evaluated at pixel centers.
+  struct KOcclusionTriangle
+  {
+    float edgeA[3], edgeB[3], edgeC[3];
+    float depthA, depthB, depthC;
+    int minX, maxX, minY, maxY;
+  };
+
+  struct KOcclusionVertex
+  {
+    float x, y, z;
+    bool valid;
+  };
+
+  struct KOcclusionTransform
+  {
+    KOcclusionTransform(KMatrix4x4 const &m);
+    bool project(float x, float y, float z, int width, int height, KOcclusionVertex &result) const;
+    float row[4][4];
+  };
+
+  inline KOcclusionTransform::KOcclusionTransform(KMatrix4x4 const &m)
+  {
+    for (int r = 0; r < 4; ++r)
+    {
+      for (int c = 0; c < 4; ++c)
+      {
+        row[r][c] = m(r, c);
+      }
+    }
+  }
+
+  // Projects into pixel coordinates (Y up) with depth normalized to [0, 1]
+  inline bool KOcclusionTransform::project(float x, float y, float z, int width, int height, KOcclusionVertex &result) const
+  {
+    float w = row[3][0] * x + row[3][1] * y + row[3][2] * z + row[3][3];
+    result.valid = (w > OcclusionMinW);
+    if (!result.valid) return false;
+    float invW = 1.0f / w;
+    result.x = ((row[0][0] * x + row[0][1] * y + row[0][2] * z + row[0][3]) * invW * 0.5f + 0.5f) * width;
+    result.y = ((row[1][0] * x + row[1][1] * y + row[1][2] * z + row[1][3]) * invW * 0.5f + 0.5f) * height;
+    result.z = ((row[2][0] * x + row[2][1] * y + row[2][2] * z + row[2][3]) * invW * 0.5f + 0.5f);
+    return true;
+  }
+
+  bool setupTriangle(KOcclusionVertex const *v0, KOcclusionVertex const *v1, KOcclusionVertex const *v2, int width, int height, KOcclusionTriangle &tri)
+  {
+    if (!v0->valid || !v1->valid || !v2->valid) return false;
+
+    // Counter-clockwise winding keeps the inside of every edge positive
+    float area = (v1->x - v0->x) * (v2->y - v0->y) - (v2->x - v0->x) * (v1->y - v0->y);
+    if (std::abs(area) < 1e-6f) return false;
+    if (area < 0.0f)
+    {
+      std::swap(v1, v2);
+      area = -area;
+    }
+
+    // Pixel centers sit at (i + 0.5), only those inside the bounds are covered
+    float minX = std::min(v0->x, std::min(v1->x, v2->x));
+    float maxX = std::max(v0->x, std::max(v1->x, v2->x));
+    float minY = std::min(v0->y, std::min(v1->y, v2->y));
+    float maxY = std::max(v0->y, std::max(v1->y, v2->y));
+    if (maxX < 0.0f || maxY < 0.0f || minX > width || minY > height) return false;
+    tri.minX = std::max(0, static_cast<int>(std::ceil(minX - 0.5f)));
+    tri.maxX = std::min(width - 1, static_cast<int>(std::floor(maxX - 0.5f)));
+    tri.minY = std::max(0, static_cast<int>(std::ceil(minY - 0.5f)));
+    tri.maxY = std::min(height - 1, static_cast<int>(std::floor(maxY - 0.5f)));
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY) return false;
+
+    KOcclusionVertex const *v[3] = { v0, v1, v2 };
+    for (int e = 0; e < 3; ++e)
+    {
+      KOcclusionVertex const *a = v[e];
+      KOcclusionVertex const *b = v[(e + 1) % 3];
+      tri.edgeA[e] = a->y - b->y;
+      tri.edgeB[e] = b->x - a->x;
+      tri.edgeC[e] = -(tri.edgeA[e] * a->x + tri.edgeB[e] * a->y);
+    }
+
+    float invArea = 1.0f / area;
+    tri.depthA = ((v1->z - v0->z) * (v2->y - v0->y) - (v2->z - v0->z) * (v1->y - v0->y)) * invArea;
+    tri.depthB = ((v2->z - v0->z) * (v1->x - v0->x) - (v1->z - v0->z) * (v2->x - v0->x)) * invArea;
+    tri.depthC = v0->z - tri.depthA * v0->x - tri.depthB * v0->y;
+    return true;
+  }
+
+  // Keeps the nearest depth of `tri` over the rows [minY, maxY] of the buffer.
+  // Rows are a multiple of four pixels wide, so whole quads can be processed.
+  void rasterizeTriangle(KOcclusionTriangle const &tri, float *depth, int width, int minY, int maxY)
+  {
+    int rowBegin = std::max(minY, tri.minY);
+    int rowEnd = std::min(maxY, tri.maxY);
+#ifdef __SSE2__
+    int quadBegin = tri.minX & ~3;
+    int quadEnd = tri.maxX + 1;
+    __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 edgeA0 = _mm_set1_ps(tri.edgeA[0]);
+    __m128 edgeA1 = _mm_set1_ps(tri.edgeA[1]);
+    __m128 edgeA2 = _mm_set1_ps(tri.edgeA[2]);
+    __m128 depthA = _mm_set1_ps(tri.depthA);
+    for (int y = rowBegin; y <= rowEnd; ++y)
+    {
+      float py = y + 0.5f;
+      __m128 row0 = _mm_set1_ps(tri.edgeB[0] * py + tri.edgeC[0]);
+      __m128 row1 = _mm_set1_ps(tri.edgeB[1] * py + tri.edgeC[1]);
+      __m128 row2 = _mm_set1_ps(tri.edgeB[2] * py + tri.edgeC[2]);
+      __m128 rowZ = _mm_set1_ps(tri.depthB * py + tri.depthC);
+      float *scanline = depth + y * width;
+      for (int x = quadBegin; x < quadEnd; x += 4)
+      {
+        __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+        __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, px), row0), zero);
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, px), row1), zero));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, px), row2), zero));
+        if (_mm_movemask_ps(inside) == 0) continue;
+        __m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), rowZ);
+        __m128 current = _mm_loadu_ps(scanline + x);
+        __m128 nearest = _mm_min_ps(current, z);
+        _mm_storeu_ps(scanline + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+      }
+    }
+#else
+    for (int y = rowBegin; y <= rowEnd; ++y)
+    {
+      float py = y + 0.5f;
+      float *scanline = depth + y * width;
+      for (int x = tri.minX; x <= tri.maxX; ++x)
+      {
+        float px = x + 0.5f;
+        if (tri.edgeA[0] * px + tri.edgeB[0] * py + tri.edgeC[0] < 0.0f) continue;
+        if (tri.edgeA[1] * px + tri.edgeB[1] * py + tri.edgeC[1] < 0.0f) continue;
+        if (tri.edgeA[2] * px + tri.edgeB[2] * py + tri.edgeC[2] < 0.0f) continue;
+        float z = tri.depthA * px + tri.depthB * py + tri.depthC;
+        scanline[x] = std::min(scanline[x], z);
+      }
+    }
+#endif
+  }
+
+}
+
+/*******************************************************************************
+ * KOcclusionBufferPrivate
+ ******************************************************************************/
+class KOcclusionBufferPrivate
+{
+public:
+  KOcclusionBufferPrivate();
+  void resize(int width, int height);
+  void rasterizeBand(int firstTileRow, int lastTileRow);
+  bool tileOccludes(int tx, int ty, int minX, int maxX, int minY, int maxY, float depth) const;
+
+  int m_width, m_height;
+  int m_tilesX, m_tilesY;
+  KMatrix4x4 m_viewProjection;
+  std::vector<float> m_depth;
+  std::vector<float> m_tileMax;
+  std::vector<KOcclusionTriangle> m_triangles;
+  std::vector<KOcclusionVertex> m_vertices;
+};
+
+KOcclusionBufferPrivate::KOcclusionBufferPrivate() :
+  m_width(0), m_height(0), m_tilesX(0), m_tilesY(0)
+{
+  // Intentionally Empty
+}
+
+void KOcclusionBufferPrivate::resize(int width, int height)
+{
+  m_tilesX = std::max(1, (width + KOcclusionBuffer::TileSize - 1) / KOcclusionBuffer::TileSize);
+  m_tilesY = std::max(1, (height + KOcclusionBuffer::TileSize - 1) / KOcclusionBuffer::TileSize);
+  m_width = m_tilesX * KOcclusionBuffer::TileSize;
+  m_height = m_tilesY * KOcclusionBuffer::TileSize;
+  m_depth.assign(static_cast<size_t>(m_width) * m_height, 1.0f);
+  m_tileMax.assign(static_cast<size_t>(m_tilesX) * m_tilesY, 1.0f);
+}
+
+// Every band owns whole tile rows, so it can clear, rasterize and reduce them alone.
+void KOcclusionBufferPrivate::rasterizeBand(int firstTileRow, int lastTileRow)
+{
+  int minY = firstTileRow * KOcclusionBuffer::TileSize;
+  int maxY = lastTileRow * KOcclusionBuffer::TileSize - 1;
+  std::fill(m_depth.begin() + minY * m_width, m_depth.begin() + (maxY + 1) * m_width, 1.0f);
+
+  for (KOcclusionTriangle const &tri : m_triangles)
+  {
+    if (tri.maxY < minY || tri.minY > maxY) continue;
+    rasterizeTriangle(tri, m_depth.data(), m_width, minY, maxY);
+  }
+
+  for (int ty = firstTileRow; ty < lastTileRow; ++ty)
+  {
+    for (int tx = 0; tx < m_tilesX; ++tx)
+    {
+      float farthest = 0.0f;
+      for (int y = ty * KOcclusionBuffer::TileSize, yEnd = y + KOcclusionBuffer::TileSize; y < yEnd; ++y)
+      {
+        float const *scanline = m_depth.data() + y * m_width + tx * KOcclusionBuffer::TileSize;
+        farthest = std::max(farthest, *std::max_element(scanline, scanline + KOcclusionBuffer::TileSize));
+      }
+      m_tileMax[ty * m_tilesX + tx] = farthest;
+    }
+  }
+}
+
+// Tests the pixels of a tile which overlap the query rectangle
+bool KOcclusionBufferPrivate::tileOccludes(int tx, int ty, int minX, int maxX, int minY, int maxY, float depth) const
+{
+  if (m_tileMax[ty * m_tilesX + tx] < depth) return true;
+  int xBegin = std::max(minX, tx * KOcclusionBuffer::TileSize);
+  int xEnd = std::min(maxX, (tx + 1) * KOcclusionBuffer::TileSize - 1);
+  int yBegin = std::max(minY, ty * KOcclusionBuffer::TileSize);
+  int yEnd = std::min(maxY, (ty + 1) * KOcclusionBuffer::TileSize - 1);
+  for (int y = yBegin; y <= yEnd; ++y)
+  {
+    float const *scanline = m_depth.data() + y * m_width;
+    for (int x = xBegin; x <= xEnd; ++x)
+    {
+      if (scanline[x] >= depth) return false;
+    }
+  }
+  return true;
+}
+
+/*******************************************************************************
+ * KOcclusionBuffer
+ ******************************************************************************/
+KOcclusionBuffer::KOcclusionBuffer() :
+  m_private(new KOcclusionBufferPrivate)
+{
+  P(KOcclusionBufferPrivate);
+  p.resize(DefaultWidth, DefaultHeight);
+}
+
+KOcclusionBuffer::KOcclusionBuffer(int width, int height) :
+  m_private(new KOcclusionBufferPrivate)
+{
+  P(KOcclusionBufferPrivate);
+  p.resize(width, height);
+}
+
+KOcclusionBuffer::~KOcclusionBuffer()
+{
+  // Intentionally Empty
+}
+
+void KOcclusionBuffer::resize(int width, int height)
+{
+  P(KOcclusionBufferPrivate);
+  p.resize(width, height);
+}
+
+int KOcclusionBuffer::width() const
+{
+  P(const KOcclusionBufferPrivate);
+  return p.m_width;
+}
+
+int KOcclusionBuffer::height() const
+{
+  P(const KOcclusionBufferPrivate);
+  return p.m_height;
+}
+
+void KOcclusionBuffer::begin(const KMatrix4x4 &viewProjection)
+{
+  P(KOcclusionBufferPrivate);
+  p.m_viewProjection = viewProjection;
+  p.m_triangles.clear();
+}
+
+void KOcclusionBuffer::addOccluder(const KVector3D *positions, size_t positionCount, const uint32_t *indices, size_t indexCount, const KMatrix4x4 &toWorld)
+{
+  P(KOcclusionBufferPrivate);
+
+  // Project every vertex once, triangles share most of them
+  KOcclusionTransform transform(p.m_viewProjection * toWorld);
+  p.m_vertices.resize(positionCount);
+  int width = p.m_width, height = p.m_height;
+  KOcclusionVertex *vertices = p.m_vertices.data();
+  Karma::parallelFor(positionCount, [=, &transform](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      transform.project(positions[i].x(), positions[i].y(), positions[i].z(), width, height, vertices[i]);
+    }
+  });
+
+  KOcclusionTriangle tri;
+  for (size_t i = 0; i + 2 < indexCount; i += 3)
+  {
+    if (setupTriangle(&vertices[indices[i]], &vertices[indices[i + 1]], &vertices[indices[i + 2]], width, height, tri))
+    {
+      p.m_triangles.push_back(tri);
+    }
+  }
+}
+
+void KOcclusionBuffer::rasterize()
+{
+  P(KOcclusionBufferPrivate);
+
+  // Small frames are not worth the threads, every band walks all triangles.
+  size_t bands = std::min<size_t>(p.m_tilesY, Karma::threadCount());
+  if (p.m_triangles.size() < 64) bands = 1;
+  Karma::parallelChunks(p.m_tilesY, bands, [&p](size_t, size_t begin, size_t end)
+  {
+    p.rasterizeBand(static_cast<int>(begin), static_cast<int>(end));
+  });
+}
+
+bool KOcclusionBuffer::visible(const KVector3D &minExtent, const KVector3D &maxExtent) const
+{
+  P(const KOcclusionBufferPrivate);
+
+  // Screen rectangle and nearest depth of the corners, anything reaching
+  // behind the camera can't be decided and is always visible.
+  KOcclusionTransform transform(p.m_viewProjection);
+  float minX = std::numeric_limits<float>::max(), maxX = -minX;
+  float minY = minX, maxY = -minX;
+  float nearest = minX;
+  KOcclusionVertex corner;
+  for (int i = 0; i < 8; ++i)
+  {
+    float x = (i & 1) ? maxExtent.x() : minExtent.x();
+    float y = (i & 2) ? maxExtent.y() : minExtent.y();
+    float z = (i & 4) ? maxExtent.z() : minExtent.z();
+    if (!transform.project(x, y, z, p.m_width, p.m_height, corner)) return true;
+    minX = std::min(minX, corner.x);
+    maxX = std::max(maxX, corner.x);
+    minY = std::min(minY, corner.y);
+    maxY = std::max(maxY, corner.y);
+    nearest = std::min(nearest, corner.z);
+  }
+
+  // Every pixel the rectangle touches has to be nearer than the box
+  int x0 = std::max(0, static_cast<int>(std::floor(minX)));
+  int x1 = std::min(p.m_width - 1, static_cast<int>(std::floor(maxX)));
+  int y0 = std::max(0, static_cast<int>(std::floor(minY)));
+  int y1 = std::min(p.m_height - 1, static_cast<int>(std::floor(maxY)));
+  if (x0 > x1 || y0 > y1) return true;
+  for (int ty = y0 / TileSize; ty <= y1 / TileSize; ++ty)
+  {
+    for (int tx = x0 / TileSize; tx <= x1 / TileSize; ++tx)
+    {
+      if (!p.tileOccludes(tx, ty, x0, x1, y0, y1, nearest)) return true;
+    }
+  }
+  return false;
+}
+
+float KOcclusionBuffer::depth(int x, int y) const
+{
+  P(const KOcclusionBufferPrivate);
+  return p.m_depth[y * p.m_width + x];
+}
+
+size_t KOcclusionBuffer::triangleCount() const
+{
+  P(const KOcclusionBufferPrivate);
+  return p.m_triangles.size();
+}
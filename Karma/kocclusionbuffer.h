@@ -0,0 +1,47 @@
+#ifndef KOCCLUSIONBUFFER_H
+#define KOCCLUSIONBUFFER_H KOcclusionBuffer
+
+class KMatrix4x4;
+class KVector3D;
+#include <cstddef>
+#include <cstdint>
+#include <KSharedPointer>
+
+// Low resolution depth buffer rasterized on the CPU, for occlusion culling.
+// Occluders are queued for a frame and rasterized together (split into bands of
+// rows across threads), afterwards bounding boxes are tested against the
+// per-tile maximum depth, and only down to pixels where tiles are inconclusive.
+// Note: Occluder triangles crossing the near plane are skipped, they would only
+//       ever make the buffer hide less.
+class KOcclusionBufferPrivate;
+class KOcclusionBuffer
+{
+public:
+  static const int DefaultWidth = 256;
+  static const int DefaultHeight = 128;
+  static const int TileSize = 8;
+
+  KOcclusionBuffer();
+  KOcclusionBuffer(int width, int height);
+  ~KOcclusionBuffer();
+
+  // Dimensions are rounded up to whole tiles
+  void resize(int width, int height);
+  int width() const;
+  int height() const;
+
+  // Frame (Positions are in model space, indices describe triangles)
+  void begin(KMatrix4x4 const &viewProjection);
+  void addOccluder(KVector3D const *positions, size_t positionCount, uint32_t const *indices, size_t indexCount, KMatrix4x4 const &toWorld);
+  void rasterize();
+
+  // Queries (Depth is normalized to [0, 1], with 1 being the far plane)
+  bool visible(KVector3D const &minExtent, KVector3D const &maxExtent) const;
+  float depth(int x, int y) const;
+  size_t triangleCount() const;
+
+private:
+  KSharedPointer<KOcclusionBufferPrivate> m_private;
+};
+
+#endif // KOCCLUSIONBUFFER_H
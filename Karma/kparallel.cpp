@@ -0,0 +1,151 @@
+#include "kparallel.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/*******************************************************************************
+ * TaskPool
+ ******************************************************************************/
+namespace Karma
+{
+  class TaskPool
+  {
+  public:
+    struct Task
+    {
+      std::function<void()> func;
+      TaskGroup *group;
+    };
+
+    static TaskPool &instance();
+    TaskPool();
+    ~TaskPool();
+    void push(TaskGroup *group, std::function<void()> &&func);
+    void wait(TaskGroup *group);
+
+  private:
+    void work();
+    void execute(std::unique_lock<std::mutex> &lock);
+
+    std::mutex m_mutex;
+    std::condition_variable m_queued;   // Workers sleep until there is a task
+    std::condition_variable m_finished; // Groups sleep until one of their tasks ends
+    std::deque<Task> m_tasks;
+    std::vector<std::thread> m_workers;
+    bool m_stop;
+  };
+}
+
+Karma::TaskPool &Karma::TaskPool::instance()
+{
+  static TaskPool pool;
+  return pool;
+}
+
+Karma::TaskPool::TaskPool() :
+  m_stop(false)
+{
+  for (size_t i = 1; i < threadCount(); ++i)
+  {
+    m_workers.emplace_back(&TaskPool::work, this);
+  }
+}
+
+Karma::TaskPool::~TaskPool()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_queued.notify_all();
+  for (std::thread &worker : m_workers)
+  {
+    worker.join();
+  }
+}
+
+void Karma::TaskPool::push(TaskGroup *group, std::function<void()> &&func)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++group->m_pending;
+    m_tasks.push_back(Task());
+    m_tasks.back().func = std::move(func);
+    m_tasks.back().group = group;
+  }
+  m_queued.notify_one();
+}
+
+// Helps with queued tasks instead of sleeping, a group waited on from
+// within a task would otherwise hold a worker its own tasks may need.
+void Karma::TaskPool::wait(TaskGroup *group)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (group->m_pending > 0)
+  {
+    if (m_tasks.empty())
+    {
+      m_finished.wait(lock);
+    }
+    else
+    {
+      execute(lock);
+    }
+  }
+}
+
+void Karma::TaskPool::work()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;)
+  {
+    m_queued.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+    if (m_tasks.empty()) return;
+    execute(lock);
+  }
+}
+
+// Runs the oldest task with the lock released (Expects the lock to be held).
+void Karma::TaskPool::execute(std::unique_lock<std::mutex> &lock)
+{
+  Task task = std::move(m_tasks.front());
+  m_tasks.pop_front();
+  lock.unlock();
+  task.func();
+  lock.lock();
+  if (--task.group->m_pending == 0)
+  {
+    m_finished.notify_all();
+  }
+}
+
+/*******************************************************************************
+ * TaskGroup
+ ******************************************************************************/
+Karma::TaskGroup::TaskGroup() :
+  m_pending(0)
+{
+  // Intentionally Empty
+}
+
+Karma::TaskGroup::~TaskGroup()
+{
+  wait();
+}
+
+void Karma::TaskGroup::run(std::function<void()> task)
+{
+  if (threadCount() == 1)
+  {
+    task();
+    return;
+  }
+  TaskPool::instance().push(this, std::move(task));
+}
+
+void Karma::TaskGroup::wait()
+{
+  if (threadCount() == 1) return;
+  TaskPool::instance().wait(this);
+}
@@ -0,0 +1,100 @@
+#ifndef KPARALLEL_H
+#define KPARALLEL_H KParallel
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace Karma
+{
+
+  // Minimum amount of work items handed to a single thread.
+  // Anything smaller isn't worth the cost of handing it to another thread.
+  static const size_t ParallelGrainSize = 4096;
+
+  inline size_t threadCount()
+  {
+    static const size_t count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    return count;
+  }
+
+  // Number of chunks `count` items will be split into.
+  // Callers may use this to preallocate per-chunk accumulators.
+  inline size_t parallelChunkCount(size_t count, size_t grain = ParallelGrainSize)
+  {
+    size_t chunks = (count + grain - 1) / std::max<size_t>(1, grain);
+    return std::max<size_t>(1, std::min(chunks, threadCount()));
+  }
+
+  // Tasks handed to a pool of worker threads which live as long as the program.
+  // The pool starts on first use, with one worker less than threadCount().
+  // wait() runs queued tasks while it blocks, so groups may nest within tasks.
+  class TaskGroup
+  {
+  public:
+    TaskGroup();
+    ~TaskGroup();
+    void run(std::function<void()> task);
+    void wait();
+  private:
+    TaskGroup(TaskGroup const &);
+    TaskGroup &operator=(TaskGroup const &);
+    size_t m_pending;
+    friend class TaskPool;
+  };
+
+  // Invokes func(chunk, begin, end) for `chunks` contiguous ranges of [0, count).
+  // The calling thread executes the first chunk, and blocks until all are done.
+  // The partitioning is deterministic for a given (count, chunks) pair.
+  template <typename Func>
+  void parallelChunks(size_t count, size_t chunks, Func func)
+  {
+    if (chunks <= 1)
+    {
+      func(static_cast<size_t>(0), static_cast<size_t>(0), count);
+      return;
+    }
+
+    TaskGroup group;
+    for (size_t chunk = 1; chunk < chunks; ++chunk)
+    {
+      group.run([&func, chunk, count, chunks]()
+      {
+        func(chunk, chunk * count / chunks, (chunk + 1) * count / chunks);
+      });
+    }
+    func(static_cast<size_t>(0), static_cast<size_t>(0), count / chunks);
+    group.wait();
+  }
+
+  // Invokes func(begin, end) over [0, count), split across available threads.
+  template <typename Func>
+  void parallelFor(size_t count, Func func, size_t grain = ParallelGrainSize)
+  {
+    parallelChunks(count, parallelChunkCount(count, grain), [&func](size_t, size_t begin, size_t end)
+    {
+      func(begin, end);
+    });
+  }
+
+  // Runs both functors, the second on a separate thread when worthwhile.
+  template <typename FuncA, typename FuncB>
+  void parallelInvoke(FuncA a, FuncB b, bool parallel = true)
+  {
+    if (!parallel || threadCount() == 1)
+    {
+      a();
+      b();
+      return;
+    }
+    TaskGroup group;
+    group.run([&b]() { b(); });
+    a();
+    group.wait();
+  }
+
+}
+
+#endif // KPARALLEL_H
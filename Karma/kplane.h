@@ -12,6 +12,7 @@ public:
   KPlane(KVector3D const &a, KVector3D const &b, KVector3D const &c);
 
   void set(float a, float b, float c, float d);
+  KVector3D const &normal() const;
   float dot(KVector3D const &point) const;
   bool pointInFront(KVector3D const &point) const;
   bool pointInBack(KVector3D const &point) const;
@@ -50,6 +51,11 @@ inline void KPlane::set(float a, float b, float c, float d)
   m_dTerm  = d / length;
 }
 
+inline KVector3D const &KPlane::normal() const
+{
+  return m_normal;
+}
+
 inline float KPlane::dot(KVector3D const &point) const
 {
   return KVector3D::dotProduct(m_normal, point) + m_dTerm;
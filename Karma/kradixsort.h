@@ -0,0 +1,89 @@
+#ifndef KRADIXSORT_H
+#define KRADIXSORT_H KRadixSort
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <type_traits>
+#include <KParallel>
+
+namespace Karma
+{
+
+  /*!
+   * Stable, parallel LSD radix sort of `keys`, carrying `values` along.
+   * Each pass builds per-thread histograms of one byte of the key, then
+   * scatters into a scratch buffer. Passes where every key shares the
+   * same byte are skipped, so small key ranges only pay for what they use.
+   */
+  template <typename Key, typename Value>
+  void radixSort(std::vector<Key> &keys, std::vector<Value> &values)
+  {
+    static_assert(std::is_unsigned<Key>::value, "Radix sort requires unsigned integral keys!");
+    static const size_t RadixBits = 8;
+    static const size_t Radix = 1 << RadixBits;
+    static const size_t RadixMask = Radix - 1;
+
+    size_t count = keys.size();
+    if (count < 2) return;
+
+    size_t chunks = parallelChunkCount(count);
+    std::vector<Key> keyScratch(count);
+    std::vector<Value> valueScratch(count);
+    std::vector<size_t> histograms(chunks * Radix);
+
+    for (size_t shift = 0; shift < sizeof(Key) * 8; shift += RadixBits)
+    {
+      // Count the digits seen by each chunk
+      std::fill(histograms.begin(), histograms.end(), 0);
+      parallelChunks(count, chunks, [&](size_t chunk, size_t begin, size_t end)
+      {
+        size_t *histogram = &histograms[chunk * Radix];
+        for (size_t i = begin; i < end; ++i)
+        {
+          ++histogram[(keys[i] >> shift) & RadixMask];
+        }
+      });
+
+      // Convert counts into scatter offsets (digit-major, chunk-minor keeps it stable)
+      size_t offset = 0;
+      bool trivial = false;
+      for (size_t digit = 0; digit < Radix; ++digit)
+      {
+        size_t digitStart = offset;
+        for (size_t chunk = 0; chunk < chunks; ++chunk)
+        {
+          size_t &bucket = histograms[chunk * Radix + digit];
+          size_t bucketCount = bucket;
+          bucket = offset;
+          offset += bucketCount;
+        }
+        if (offset - digitStart == count)
+        {
+          trivial = true;
+          break;
+        }
+      }
+      if (trivial) continue;
+
+      // Scatter into the scratch buffers
+      parallelChunks(count, chunks, [&](size_t chunk, size_t begin, size_t end)
+      {
+        size_t *histogram = &histograms[chunk * Radix];
+        for (size_t i = begin; i < end; ++i)
+        {
+          size_t &dest = histogram[(keys[i] >> shift) & RadixMask];
+          keyScratch[dest] = keys[i];
+          valueScratch[dest] = values[i];
+          ++dest;
+        }
+      });
+
+      keys.swap(keyScratch);
+      values.swap(valueScratch);
+    }
+  }
+
+}
+
+#endif // KRADIXSORT_H
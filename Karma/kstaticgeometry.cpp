@@ -1,5 +1,8 @@
 #include "kstaticgeometry.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <vector>
 #include <KMath>
 #include <KMacros>
@@ -14,6 +17,10 @@
 #include <KIndexCloud>
 #include <KTrianglePointIterator>
 #include <KTrianglePartition>
+#include <KParallel>
+#include <KFlatTree>
+#include <KKdTree>
+#include <KTriangleIndexIterator>
 
 /*******************************************************************************
  * KStaticGeometryInstance
@@ -38,6 +45,8 @@ KStaticGeometryInstance::KStaticGeometryInstance(KTriangleIndexIterator begin, K
 /*******************************************************************************
  * KStaticGeometryNode
  ******************************************************************************/
+static const size_t NoFlatIndex = static_cast<size_t>(-1);
+
 class KStaticGeometryNode
 {
 public:
@@ -45,6 +54,7 @@ public:
 
   KStaticGeometryNode(size_t depth, ConstIterator begin, ConstIterator end, KPointCloud const &pointCloud);
   KStaticGeometryNode(size_t depth, KStaticGeometryNode *left, KStaticGeometryNode *right);
+  KStaticGeometryNode(size_t depth, Karma::MinMaxKVector3D const &bounds);
   bool isLeaf() const;
   void drawAabb(KTransform3D &trans, KColor const &color, size_t min, size_t max) const;
   void correctDepth(size_t depth);
@@ -58,23 +68,34 @@ public:
   size_t from, to;
   size_t depth;
   KStaticGeometryInstance *instance;
+
+  // For refitting
+  size_t flatIndex;
+  float cost;       // SAH cost of the subtree (Not normalized)
+  float builtCost;  // SAH cost relative to the node's area, when it was built
 };
 
 KStaticGeometryNode::KStaticGeometryNode(size_t d, ConstIterator begin, ConstIterator end, KPointCloud const &pointCloud) :
   aabb(KTrianglePointIterator(begin, pointCloud), KTrianglePointIterator(end, pointCloud)),
-  left(0), right(0), depth(d), instance(0)
+  left(0), right(0), depth(d), instance(0), flatIndex(NoFlatIndex), cost(0.0f), builtCost(0.0f)
 {
   // Intentionally Empty
 }
 
 KStaticGeometryNode::KStaticGeometryNode(size_t d, KStaticGeometryNode *left, KStaticGeometryNode *right) :
   aabb(left->aabb, right->aabb),
-  left(left), right(right), depth(d), instance(0)
+  left(left), right(right), depth(d), instance(0), flatIndex(NoFlatIndex), cost(0.0f), builtCost(0.0f)
 {
   left->depth = depth + 1;
   right->depth = depth + 1;
 }
 
+KStaticGeometryNode::KStaticGeometryNode(size_t d, Karma::MinMaxKVector3D const &bounds) :
+  left(0), right(0), depth(d), instance(0), flatIndex(NoFlatIndex), cost(0.0f), builtCost(0.0f)
+{
+  aabb.setMinMaxBounds(bounds);
+}
+
 bool KStaticGeometryNode::isLeaf() const
 {
   return (left == 0);
@@ -108,6 +129,82 @@ size_t KStaticGeometryNode::getMaxDepth()
   return std::max(depth, std::max(left ? left->getMaxDepth() : 0, right ? right->getMaxDepth() : 0));
 }
 
+/*******************************************************************************
+ * KStaticGeometrySah (Binned Surface Area Heuristic)
+ ******************************************************************************/
+static const size_t SahBinCount = 16;
+static const size_t SahMaxLeafSize = 16;
+static const size_t SahParallelThreshold = 4096;
+static const float SahTraversalCost = 1.0f;
+static const float SahIntersectionCost = 1.0f;
+
+struct KSahBounds
+{
+  inline KSahBounds();
+  inline void grow(KVector3D const &p);
+  inline void grow(KSahBounds const &b);
+  inline float area() const;
+  KVector3D min, max;
+};
+
+inline KSahBounds::KSahBounds() :
+  min(std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()),
+  max(-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity())
+{
+  // Intentionally Empty
+}
+
+inline void KSahBounds::grow(KVector3D const &p)
+{
+  min = KVector3D(std::min(min.x(), p.x()), std::min(min.y(), p.y()), std::min(min.z(), p.z()));
+  max = KVector3D(std::max(max.x(), p.x()), std::max(max.y(), p.y()), std::max(max.z(), p.z()));
+}
+
+inline void KSahBounds::grow(KSahBounds const &b)
+{
+  if (b.min.x() > b.max.x()) return;
+  grow(b.min);
+  grow(b.max);
+}
+
+inline float KSahBounds::area() const
+{
+  if (min.x() > max.x()) return 0.0f;
+  KVector3D d = max - min;
+  return 2.0f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+struct KSahReference
+{
+  KSahBounds bounds;
+  KVector3D centroid;
+  KTriangleIndexCloud::ElementType triangle;
+};
+
+struct KSahBin
+{
+  KSahBin() : count(0) {}
+  KSahBounds bounds;
+  size_t count;
+};
+
+// Bins for every axis, filled in one pass over the references.
+struct KSahBins
+{
+  KSahBin bins[3][SahBinCount];
+};
+
+inline size_t sahBinIndex(float centroid, float min, float scale)
+{
+  return std::min(SahBinCount - 1, static_cast<size_t>(std::max(0.0f, (centroid - min) * scale)));
+}
+
+inline float aabbArea(KAabbBoundingVolume const &aabb)
+{
+  KVector3D d = aabb.maxExtent() - aabb.minExtent();
+  return 2.0f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
 /*******************************************************************************
  * KStaticGeometryPrivate
  ******************************************************************************/
@@ -119,34 +216,36 @@ public:
   KStaticGeometryPrivate(KGeometryCloud &parent);
   void buildBottomUp(TerminationPred pred);
   void buildTopDown(TerminationPred pred);
+  void buildSah(TerminationPred pred);
+  float sahCost(KStaticGeometryNode *node);
+  void flatten();
+  void refitBounds(KStaticGeometryNode *node);
+  void markBuilt(KStaticGeometryNode *node);
+  size_t rebuildDegraded(KStaticGeometryNode **node, float threshold);
 
   KStaticGeometryNode *m_root;
   size_t m_maxDepth;
   KGeometryCloud m_parent;
+  KFlatTree m_flatTree;
+  TerminationPred m_pred;
+  uint32_t m_buildMethod;
+  uint64_t m_sourceHash;  // Hash of the geometry the tree was built from (It is consumed by the build)
+  float m_loadedCost;
 
 private:
   KStaticGeometryNode *recursiveTopDown(size_t depth, TriangleIterator begin, TriangleIterator end, TerminationPred pred);
-};
-
-// Helper functor
-struct KAabbMinCentroidDistance : public std::binary_function<bool, KStaticGeometryNode*, KStaticGeometryNode*>
-{
-  KAabbMinCentroidDistance(KStaticGeometryNode const *geom) :
-    m_geom(geom)
-  {
-    // Intentionally Empty
-  }
-
-  bool operator()(const KStaticGeometryNode *lhs, const KStaticGeometryNode *rhs) const
-  {
-    return (lhs->aabb.center() - m_geom->aabb.center()).lengthSquared() < (rhs->aabb.center() - m_geom->aabb.center()).lengthSquared();
-  }
-
-  KStaticGeometryNode const *m_geom;
+  KStaticGeometryNode *recursiveSah(size_t depth, KSahReference *begin, KSahReference *end, TriangleIterator triangles, TerminationPred pred);
+  KStaticGeometryNode *rebuildSubtree(KStaticGeometryNode *node);
+  void prepareReferences(TriangleIterator triangles, std::vector<KSahReference> &references) const;
+  void collectTriangles(KStaticGeometryNode const *node, KTriangleIndexCloud &triangles) const;
+  void destroy(KStaticGeometryNode *node);
+  void recursiveFlatten(KStaticGeometryNode *node);
+  KSahReference *m_sahReferences;
+  size_t m_parallelDepth;
 };
 
 KStaticGeometryPrivate::KStaticGeometryPrivate(KGeometryCloud &parent) :
-  m_parent(parent)
+  m_root(0), m_maxDepth(0), m_parent(parent), m_pred(0), m_buildMethod(0), m_sourceHash(0), m_loadedCost(0.0f), m_sahReferences(0), m_parallelDepth(0)
 {
   // Intentionally Empty
 }
@@ -182,29 +281,39 @@ void KStaticGeometryPrivate::buildBottomUp(TerminationPred pred)
     if (remaining > leafCount)
       remaining = leafCount;
     currNode = new KStaticGeometryNode(0, it, it + remaining, pointCloud);
+    currNode->instance = new KStaticGeometryInstance(KTriangleIndexIterator(it), KTriangleIndexIterator(it + remaining));
     nodes.push_back(currNode);
     std::advance(it, remaining);
   }
 
+  // Every node is paired with the closest node which isn't paired yet
   std::vector<KStaticGeometryNode*> working;
+  std::vector<bool> paired;
+  KPointCloud centers;
+  KKdTree tree;
   while (nodes.size() != 1)
   {
     working.reserve(nodes.size() / 2 + 1);
-    KStaticGeometryNodeCloud::iterator it = nodes.begin();
-    while (it != nodes.end())
+    centers.clear();
+    for (KStaticGeometryNode const *node : nodes)
+    {
+      centers.emplace_back(node->aabb.center());
+    }
+    tree.build(centers);
+    paired.assign(nodes.size(), false);
+    for (size_t i = 0; i < nodes.size(); ++i)
     {
-      KAabbMinCentroidDistance distanceCheck(*it);
-      KStaticGeometryNodeCloud::iterator min = std::min_element(it + 1, nodes.end(), distanceCheck);
-      if (min != nodes.end())
+      if (paired[i]) continue;
+      paired[i] = true;
+      size_t closest = tree.nearest(centers[i], 0, &paired);
+      if (closest != KKdTree::NoPoint)
       {
-        std::iter_swap(it + 1, min);
-        working.push_back(new KStaticGeometryNode(0, *it, *(it + 1)));
-        std::advance(it, 2);
+        paired[closest] = true;
+        working.push_back(new KStaticGeometryNode(0, nodes[i], nodes[closest]));
       }
       else
       {
-        working.push_back(*it);
-        std::advance(it, 1);
+        working.push_back(nodes[i]);
       }
     }
 
@@ -256,6 +365,306 @@ void KStaticGeometryPrivate::buildTopDown(TerminationPred pred)
   m_root = recursiveTopDown(0, triangleCloud.begin(), triangleCloud.end(), pred);
 }
 
+KStaticGeometryNode *KStaticGeometryPrivate::recursiveSah(size_t depth, KSahReference *begin, KSahReference *end, TriangleIterator triangles, TerminationPred pred)
+{
+  size_t numTriangles = static_cast<size_t>(end - begin);
+  if (numTriangles == 0) return 0;
+
+  // Gather the node bounds, and the bounds of the centroids (which are binned)
+  size_t chunks = Karma::parallelChunkCount(numTriangles);
+  std::vector<KSahBounds> chunkBounds(chunks), chunkCentroids(chunks);
+  Karma::parallelChunks(numTriangles, chunks, [&](size_t chunk, size_t from, size_t to)
+  {
+    for (KSahReference const *ref = begin + from; ref != begin + to; ++ref)
+    {
+      chunkBounds[chunk].grow(ref->bounds);
+      chunkCentroids[chunk].grow(ref->centroid);
+    }
+  });
+  KSahBounds bounds, centroids;
+  for (size_t chunk = 0; chunk < chunks; ++chunk)
+  {
+    bounds.grow(chunkBounds[chunk]);
+    centroids.grow(chunkCentroids[chunk]);
+  }
+  Karma::MinMaxKVector3D minMax;
+  minMax.min = bounds.min;
+  minMax.max = bounds.max;
+  KStaticGeometryNode *node = new KStaticGeometryNode(depth, minMax);
+
+  // Find the cheapest split among the bin boundaries of every axis
+  int bestAxis = -1;
+  size_t bestSplit = 0;
+  float bestCost = std::numeric_limits<float>::infinity();
+  float scale[3];
+  if (!pred(numTriangles, depth))
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      float extent = centroids.max[axis] - centroids.min[axis];
+      scale[axis] = (extent > 0.0f) ? SahBinCount / extent : 0.0f;
+    }
+
+    std::vector<KSahBins> chunkBins(chunks);
+    Karma::parallelChunks(numTriangles, chunks, [&](size_t chunk, size_t from, size_t to)
+    {
+      KSahBins &bins = chunkBins[chunk];
+      for (KSahReference const *ref = begin + from; ref != begin + to; ++ref)
+      {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+          KSahBin &bin = bins.bins[axis][sahBinIndex(ref->centroid[axis], centroids.min[axis], scale[axis])];
+          bin.bounds.grow(ref->bounds);
+          ++bin.count;
+        }
+      }
+    });
+    for (size_t chunk = 1; chunk < chunks; ++chunk)
+    {
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        for (size_t b = 0; b < SahBinCount; ++b)
+        {
+          chunkBins[0].bins[axis][b].bounds.grow(chunkBins[chunk].bins[axis][b].bounds);
+          chunkBins[0].bins[axis][b].count += chunkBins[chunk].bins[axis][b].count;
+        }
+      }
+    }
+
+    float invArea = 1.0f / std::max(bounds.area(), std::numeric_limits<float>::min());
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (scale[axis] == 0.0f) continue;
+      KSahBin const *bins = chunkBins[0].bins[axis];
+
+      // Sweep from the right to find the area of everything right of a split
+      float rightArea[SahBinCount];
+      size_t rightCount[SahBinCount];
+      KSahBounds accumulated;
+      size_t count = 0;
+      for (size_t b = SahBinCount - 1; b > 0; --b)
+      {
+        accumulated.grow(bins[b].bounds);
+        count += bins[b].count;
+        rightArea[b] = accumulated.area();
+        rightCount[b] = count;
+      }
+
+      // Split `b` puts bins [0, b) left, and [b, SahBinCount) right
+      accumulated = KSahBounds();
+      count = 0;
+      for (size_t b = 1; b < SahBinCount; ++b)
+      {
+        accumulated.grow(bins[b - 1].bounds);
+        count += bins[b - 1].count;
+        if (count == 0 || rightCount[b] == 0) continue;
+        float cost = SahTraversalCost + SahIntersectionCost * invArea * (accumulated.area() * count + rightArea[b] * rightCount[b]);
+        if (cost < bestCost)
+        {
+          bestCost = cost;
+          bestAxis = axis;
+          bestSplit = b;
+        }
+      }
+    }
+  }
+
+  // Small nodes become leaves when splitting doesn't pay off
+  bool leaf = (bestAxis < 0) || (bestCost >= SahIntersectionCost * numTriangles && numTriangles <= SahMaxLeafSize);
+  if (leaf)
+  {
+    TriangleIterator first = triangles + (begin - m_sahReferences);
+    for (KSahReference const *ref = begin; ref != end; ++ref)
+    {
+      triangles[ref - m_sahReferences] = ref->triangle;
+    }
+    node->instance = new KStaticGeometryInstance(first, first + numTriangles);
+    return node;
+  }
+
+  float axisMin = centroids.min[bestAxis];
+  float axisScale = scale[bestAxis];
+  KSahReference *middle = std::partition(begin, end, [bestAxis, bestSplit, axisMin, axisScale](KSahReference const &ref)
+  {
+    return sahBinIndex(ref.centroid[bestAxis], axisMin, axisScale) < bestSplit;
+  });
+
+  // Subtrees are independent, large ones near the root are built in parallel
+  bool parallel = (numTriangles >= SahParallelThreshold && depth < m_parallelDepth);
+  Karma::parallelInvoke(
+    [&]() { node->left  = recursiveSah(depth + 1, begin, middle, triangles, pred); },
+    [&]() { node->right = recursiveSah(depth + 1, middle,   end, triangles, pred); },
+    parallel
+  );
+  return node;
+}
+
+void KStaticGeometryPrivate::prepareReferences(TriangleIterator triangles, std::vector<KSahReference> &references) const
+{
+  // Precalculate the bounds of every triangle (Reminder: FaceIndices start from 1)
+  KPointCloud const & pointCloud = m_parent.pointCloud();
+  Karma::parallelFor(references.size(), [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      KSahReference &ref = references[i];
+      ref.triangle = triangles[i];
+      for (size_t index : ref.triangle.indices)
+      {
+        ref.bounds.grow(pointCloud[index - 1]);
+      }
+      ref.centroid = (ref.bounds.min + ref.bounds.max) * 0.5f;
+    }
+  });
+}
+
+void KStaticGeometryPrivate::buildSah(TerminationPred pred)
+{
+  KTriangleIndexCloud & triangleCloud = m_parent.triangleIndexCloud();
+  size_t numTriangles = triangleCloud.size();
+  std::vector<KSahReference> references(numTriangles);
+  TriangleIterator triangles = triangleCloud.begin();
+  prepareReferences(triangles, references);
+
+  // Only fork while there are idle threads to pick up the work
+  m_parallelDepth = 0;
+  while ((static_cast<size_t>(1) << m_parallelDepth) < Karma::threadCount()) ++m_parallelDepth;
+  m_sahReferences = references.data();
+  m_root = recursiveSah(0, references.data(), references.data() + numTriangles, triangles, pred);
+  m_sahReferences = 0;
+  m_maxDepth = (m_root) ? m_root->getMaxDepth() : 0;
+}
+
+float KStaticGeometryPrivate::sahCost(KStaticGeometryNode *node)
+{
+  // Expected cost of a random ray hitting the node, relative to its surface area
+  if (!node) return 0.0f;
+  float area = aabbArea(node->aabb);
+  if (node->isLeaf())
+  {
+    size_t numTriangles = (node->instance) ? node->instance->m_indexCloud.size() / 3 : 0;
+    node->cost = area * SahIntersectionCost * numTriangles;
+  }
+  else
+  {
+    node->cost = area * SahTraversalCost + sahCost(node->left) + sahCost(node->right);
+  }
+  return node->cost;
+}
+
+void KStaticGeometryPrivate::flatten()
+{
+  m_flatTree.clear();
+  m_flatTree.setPoints(m_parent.pointCloud());
+  recursiveFlatten(m_root);
+}
+
+void KStaticGeometryPrivate::recursiveFlatten(KStaticGeometryNode *node)
+{
+  if (!node) return;
+  node->flatIndex = NoFlatIndex;
+  if (node->isLeaf())
+  {
+    // Reminder: Instances already hold zero-based point indices
+    size_t index = m_flatTree.size();
+    if (node->instance && m_flatTree.addLeaf(node->instance->m_indexCloud.begin(), node->instance->m_indexCloud.end()))
+    {
+      node->flatIndex = index;
+    }
+    return;
+  }
+  size_t index = m_flatTree.beginNode();
+  recursiveFlatten(node->left);
+  recursiveFlatten(node->right);
+  if (m_flatTree.endNode(index)) node->flatIndex = index;
+}
+
+void KStaticGeometryPrivate::refitBounds(KStaticGeometryNode *node)
+{
+  // The flattened tree was refit already, the nodes only mirror its bounds
+  if (!node) return;
+  if (node->flatIndex != NoFlatIndex)
+  {
+    KFlatNode const &flat = m_flatTree.nodes()[node->flatIndex];
+    Karma::MinMaxKVector3D bounds;
+    bounds.min = KVector3D(flat.min[0], flat.min[1], flat.min[2]);
+    bounds.max = KVector3D(flat.max[0], flat.max[1], flat.max[2]);
+    node->aabb.setMinMaxBounds(bounds);
+  }
+  refitBounds(node->left);
+  refitBounds(node->right);
+}
+
+void KStaticGeometryPrivate::markBuilt(KStaticGeometryNode *node)
+{
+  if (!node) return;
+  node->builtCost = node->cost / std::max(aabbArea(node->aabb), std::numeric_limits<float>::min());
+  markBuilt(node->left);
+  markBuilt(node->right);
+}
+
+size_t KStaticGeometryPrivate::rebuildDegraded(KStaticGeometryNode **node, float threshold)
+{
+  // Leaves can only grow, there is nothing within them to reorganize
+  KStaticGeometryNode *current = *node;
+  if (!current || current->isLeaf()) return 0;
+
+  // Rebuild the topmost subtrees which got too expensive since they were built
+  float relativeCost = current->cost / std::max(aabbArea(current->aabb), std::numeric_limits<float>::min());
+  if (relativeCost > threshold * current->builtCost)
+  {
+    *node = rebuildSubtree(current);
+    return 1;
+  }
+  return rebuildDegraded(&current->left, threshold) + rebuildDegraded(&current->right, threshold);
+}
+
+KStaticGeometryNode *KStaticGeometryPrivate::rebuildSubtree(KStaticGeometryNode *node)
+{
+  KTriangleIndexCloud triangleCloud;
+  collectTriangles(node, triangleCloud);
+  std::vector<KSahReference> references(triangleCloud.size());
+  prepareReferences(triangleCloud.begin(), references);
+
+  // Subtrees are rebuilt with the binned SAH builder, regardless of how the tree was built
+  size_t depth = node->depth;
+  m_parallelDepth = depth;
+  while ((static_cast<size_t>(1) << (m_parallelDepth - depth)) < Karma::threadCount()) ++m_parallelDepth;
+  m_sahReferences = references.data();
+  KStaticGeometryNode *result = recursiveSah(depth, references.data(), references.data() + references.size(), triangleCloud.begin(), m_pred);
+  m_sahReferences = 0;
+  destroy(node);
+
+  sahCost(result);
+  markBuilt(result);
+  return result;
+}
+
+void KStaticGeometryPrivate::collectTriangles(KStaticGeometryNode const *node, KTriangleIndexCloud &triangles) const
+{
+  if (!node) return;
+  if (node->instance)
+  {
+    // Reminder: Instances hold zero-based point indices, FaceIndices start from 1
+    KIndexCloud const &indices = node->instance->m_indexCloud;
+    for (KIndexCloud::ConstIterator it = indices.begin(); it != indices.end(); it += 3)
+    {
+      triangles.emplace_back(KTriangleIndexCloud::ElementType(it[0] + 1, it[1] + 1, it[2] + 1));
+    }
+  }
+  collectTriangles(node->left, triangles);
+  collectTriangles(node->right, triangles);
+}
+
+void KStaticGeometryPrivate::destroy(KStaticGeometryNode *node)
+{
+  if (!node) return;
+  destroy(node->left);
+  destroy(node->right);
+  delete node->instance;
+  delete node;
+}
+
 /*******************************************************************************
  * KStaticGeometry
  ******************************************************************************/
@@ -276,6 +685,8 @@ void KStaticGeometry::build(BuildMethod method, TerminationPred pred)
 
   // If there is no new geometry to build, do nothing.
   if (!dirty()) return;
+  p.m_buildMethod = method;
+  p.m_sourceHash = hash();
 
   // Build based on selected method
   switch (method)
@@ -286,16 +697,19 @@ void KStaticGeometry::build(BuildMethod method, TerminationPred pred)
   case TopDownMethod:
     p.buildTopDown(pred);
     break;
+  case SahMethod:
+    p.buildSah(pred);
+    break;
   }
 
-  // We no longer need this data
-  KGeometryCloud::clear();
-
-  // Next: Depth-first search to find all leaf nodes.
-  //       Form an index buffer of all contiguous leaf nodes.
-  //       As we iterate through, update the parent nodes so they
-  //       understand the "drawable range" of the children.
+  // Depth-first search forming one contiguous index array of all leaf nodes.
+  p.flatten();
+  p.m_pred = pred;
+  p.sahCost(p.m_root);
+  p.markBuilt(p.m_root);
 
+  // We no longer need this data (Points are kept for refitting)
+  KGeometryCloud::clear();
 }
 
 void KStaticGeometry::clear()
@@ -310,6 +724,107 @@ size_t KStaticGeometry::depth() const
   return p.m_maxDepth;
 }
 
+float KStaticGeometry::sahCost() const
+{
+  P(const KStaticGeometryPrivate);
+  if (!p.m_root) return p.m_loadedCost;
+  float area = aabbArea(p.m_root->aabb);
+  return (area > 0.0f) ? p.m_root->cost / area : 0.0f;
+}
+
+KFlatTree const &KStaticGeometry::flatTree() const
+{
+  P(const KStaticGeometryPrivate);
+  return p.m_flatTree;
+}
+
+void KStaticGeometry::updateGeometry(size_t geometry, KHalfEdgeMesh const &mesh, KTransform3D const &trans)
+{
+  P(KStaticGeometryPrivate);
+  p.m_parent.updateGeometry(geometry, mesh, trans);
+}
+
+size_t KStaticGeometry::refit(float rebuildThreshold)
+{
+  P(KStaticGeometryPrivate);
+  if (!p.m_root)
+  {
+    // Loaded trees have no node hierarchy, only their bounds can follow the points
+    if (p.m_flatTree.empty()) return 0;
+    p.m_flatTree.setPoints(p.m_parent.pointCloud());
+    p.m_flatTree.refit();
+    return 0;
+  }
+
+  // Refit the flattened tree (Level by level, in parallel), then mirror it
+  p.m_flatTree.setPoints(p.m_parent.pointCloud());
+  p.m_flatTree.refit();
+  p.refitBounds(p.m_root);
+  p.sahCost(p.m_root);
+
+  // Quality monitor: Degraded subtrees are rebuilt, which requires flattening again
+  size_t rebuilt = p.rebuildDegraded(&p.m_root, rebuildThreshold);
+  if (rebuilt > 0)
+  {
+    p.m_root->correctDepth(0);
+    p.m_maxDepth = p.m_root->getMaxDepth();
+    p.flatten();
+    p.sahCost(p.m_root);
+  }
+  return rebuilt;
+}
+
+bool KStaticGeometry::save(const char *filename, uint32_t parameters) const
+{
+  P(const KStaticGeometryPrivate);
+  if (p.m_flatTree.empty()) return false;
+  KFlatTreeHeader header = KFlatTreeHeader();
+  header.structure = KFlatTreeHeader::BoundingVolumeHierarchy;
+  header.buildMethod = p.m_buildMethod;
+  header.parameters = parameters;
+  header.depth = static_cast<uint32_t>(p.m_maxDepth);
+  header.sourceHash = p.m_sourceHash;
+  header.cost = sahCost();
+  return p.m_flatTree.save(filename, header);
+}
+
+bool KStaticGeometry::load(const char *filename, BuildMethod method, uint32_t parameters)
+{
+  // Only valid for the geometry waiting to be built, which is consumed like build() would.
+  if (!dirty()) return false;
+  KFlatTreeHeader header = KFlatTreeHeader();
+  header.structure = KFlatTreeHeader::BoundingVolumeHierarchy;
+  header.buildMethod = method;
+  header.parameters = parameters;
+  header.sourceHash = hash();
+
+  KStaticGeometryPrivate *loaded = new KStaticGeometryPrivate(*this);
+  if (!loaded->m_flatTree.load(filename, &header))
+  {
+    delete loaded;
+    return false;
+  }
+  loaded->m_buildMethod = method;
+  loaded->m_sourceHash = header.sourceHash;
+  loaded->m_maxDepth = header.depth;
+  loaded->m_loadedCost = header.cost;
+  m_private = loaded;
+  KGeometryCloud::clear();
+  return true;
+}
+
+bool KStaticGeometry::raycast(KVector3D const &origin, KVector3D const &direction, float tMax, KRayHit *hit) const
+{
+  P(const KStaticGeometryPrivate);
+  return p.m_flatTree.raycast(origin, direction, tMax, hit);
+}
+
+bool KStaticGeometry::occluded(KVector3D const &origin, KVector3D const &direction, float tMax) const
+{
+  P(const KStaticGeometryPrivate);
+  return p.m_flatTree.occluded(origin, direction, tMax);
+}
+
 void KStaticGeometry::drawAabbs(KTransform3D &trans, const KColor &color)
 {
   drawAabbs(trans, color, 0);
@@ -317,12 +832,14 @@ void KStaticGeometry::drawAabbs(KTransform3D &trans, const KColor &color)
 
 void KStaticGeometry::drawAabbs(KTransform3D &trans, const KColor &color, size_t min)
 {
-  P(KStaticGeometryPrivate);
-  p.m_root->drawAabb(trans, color, min, std::numeric_limits<size_t>::max());
+  drawAabbs(trans, color, min, std::numeric_limits<size_t>::max());
 }
 
 void KStaticGeometry::drawAabbs(KTransform3D &trans, const KColor &color, size_t min, size_t max)
 {
   P(KStaticGeometryPrivate);
-  p.m_root->drawAabb(trans, color, min, max);
+  if (p.m_root)
+  {
+    p.m_root->drawAabb(trans, color, min, max);
+  }
 }
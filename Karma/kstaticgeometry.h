@@ -2,9 +2,13 @@
 #define KSTATICGEOMETRY_H KStaticGeometry
 
 class KColor;
+class KFlatTree;
 class KHalfEdgeMesh;
 class KTransform3D;
+class KVector3D;
+struct KRayHit;
 #include <cstddef>
+#include <cstdint>
 #include <KGeometryCloud>
 #include <KSharedPointer>
 
@@ -17,7 +21,21 @@ public:
 
   void clear();
   size_t depth() const;
+  float sahCost() const;
+  KFlatTree const &flatTree() const;
+  bool raycast(KVector3D const &origin, KVector3D const &direction, float tMax, KRayHit *hit) const;
+  bool occluded(KVector3D const &origin, KVector3D const &direction, float tMax) const;
   void build(BuildMethod method, TerminationPred pred);
+
+  // Serialization (Loading replaces a build, and fails unless the file was built from
+  // the same geometry, method and caller defined `parameters`)
+  bool save(char const *filename, uint32_t parameters = 0) const;
+  bool load(char const *filename, BuildMethod method, uint32_t parameters = 0);
+
+  // Animation (Geometry keeps its index from the order it was added in)
+  // Refitting rebuilds subtrees whose relative SAH cost grew past the threshold.
+  void updateGeometry(size_t geometry, KHalfEdgeMesh const &mesh, KTransform3D const &trans);
+  size_t refit(float rebuildThreshold = 1.5f);
   void drawAabbs(KTransform3D &trans, KColor const &color);
   void drawAabbs(KTransform3D &trans, KColor const &color, size_t min);
   void drawAabbs(KTransform3D &trans, KColor const &color, size_t min, size_t max);
@@ -0,0 +1,340 @@
+#include "ksweepandprune.h"
+
+#include <algorithm>
+#include <limits>
+#include <KMacros>
+#include <KParallel>
+#include <KVector3D>
+
+/*******************************************************************************
+ * KSweepAndPrune Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // Bulk insertions are cheaper to sort from scratch than to sift in one by one
+  static const size_t SweepResortDivisor = 8;
+
+  struct KSweepObject
+  {
+    KVector3D minExtent;
+    KVector3D maxExtent;
+    bool alive;
+  };
+
+  // Entries copy the whole box, so sweeps never leave the array they walk.
+  struct KSweepEntry
+  {
+    float min[3];
+    float max[3];
+    KSweepAndPrune::Handle handle;
+  };
+
+  inline bool overlaps(KSweepEntry const &a, KSweepEntry const &b)
+  {
+    return a.min[0] <= b.max[0] && a.max[0] >= b.min[0] &&
+           a.min[1] <= b.max[1] && a.max[1] >= b.min[1] &&
+           a.min[2] <= b.max[2] && a.max[2] >= b.min[2];
+  }
+
+  // Sweeps already know the boxes overlap along `axis`, the rest is tested without branches
+  inline bool overlapsOther(KSweepEntry const &a, KSweepEntry const &b, int axis1, int axis2)
+  {
+    return (a.min[axis1] <= b.max[axis1]) & (a.max[axis1] >= b.min[axis1]) &
+           (a.min[axis2] <= b.max[axis2]) & (a.max[axis2] >= b.min[axis2]);
+  }
+
+  inline KSweepAndPrune::HandlePair makePair(KSweepAndPrune::Handle a, KSweepAndPrune::Handle b)
+  {
+    return (a < b) ? KSweepAndPrune::HandlePair(a, b) : KSweepAndPrune::HandlePair(b, a);
+  }
+
+}
+
+/*******************************************************************************
+ * KSweepAndPrunePrivate
+ ******************************************************************************/
+class KSweepAndPrunePrivate
+{
+public:
+  typedef KSweepAndPrune::Handle Handle;
+  KSweepAndPrunePrivate();
+  void clear();
+  void clean() const;
+  size_t sortAxis(std::vector<KSweepEntry> &entries, int axis, bool resort) const;
+
+  std::vector<KSweepObject> m_objects;
+  std::vector<Handle> m_freeHandles;
+
+  // Sorted state is refreshed lazily by queries
+  mutable std::vector<Handle> m_added;
+  mutable std::vector<char> m_listed;  // Present within the sorted axes
+  mutable bool m_removed;
+  mutable bool m_dirty;
+  mutable int m_axis;
+  mutable size_t m_swapCount;
+  mutable float m_maxSize[3];
+  mutable std::vector<KSweepEntry> m_entries[3];
+};
+
+KSweepAndPrunePrivate::KSweepAndPrunePrivate() :
+  m_removed(false), m_dirty(false), m_axis(0), m_swapCount(0)
+{
+  m_maxSize[0] = m_maxSize[1] = m_maxSize[2] = 0.0f;
+}
+
+void KSweepAndPrunePrivate::clear()
+{
+  m_objects.clear();
+  m_freeHandles.clear();
+  m_added.clear();
+  m_listed.clear();
+  m_removed = false;
+  m_dirty = false;
+  m_swapCount = 0;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_entries[axis].clear();
+    m_maxSize[axis] = 0.0f;
+  }
+}
+
+// Insertion sort keeps the work proportional to how much the order changed
+size_t KSweepAndPrunePrivate::sortAxis(std::vector<KSweepEntry> &entries, int axis, bool resort) const
+{
+  if (resort)
+  {
+    std::sort(entries.begin(), entries.end(), [axis](KSweepEntry const &lhs, KSweepEntry const &rhs)
+    {
+      return lhs.min[axis] < rhs.min[axis];
+    });
+    return 0;
+  }
+
+  size_t swaps = 0;
+  for (size_t i = 1; i < entries.size(); ++i)
+  {
+    if (!(entries[i - 1].min[axis] > entries[i].min[axis])) continue;
+    KSweepEntry entry = entries[i];
+    size_t j = i;
+    do
+    {
+      entries[j] = entries[j - 1];
+      --j;
+    } while (j > 0 && entries[j - 1].min[axis] > entry.min[axis]);
+    entries[j] = entry;
+    swaps += i - j;
+  }
+  return swaps;
+}
+
+void KSweepAndPrunePrivate::clean() const
+{
+  if (!m_dirty) return;
+  m_dirty = false;
+  m_listed.resize(m_objects.size(), 0);
+
+  // Membership changes are applied to every axis, then the boxes are refreshed in place.
+  bool resort = m_added.size() > m_entries[0].size() / SweepResortDivisor;
+  for (Handle handle : m_added)
+  {
+    if (!m_objects[handle].alive || m_listed[handle]) continue;
+    m_listed[handle] = 1;
+    KSweepEntry entry;
+    entry.handle = handle;
+    for (int axis = 0; axis < 3; ++axis) m_entries[axis].push_back(entry);
+  }
+  m_added.clear();
+
+  m_swapCount = 0;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    std::vector<KSweepEntry> &entries = m_entries[axis];
+    if (m_removed)
+    {
+      entries.erase(std::remove_if(entries.begin(), entries.end(), [this](KSweepEntry const &entry)
+      {
+        return !m_objects[entry.handle].alive;
+      }), entries.end());
+    }
+    m_maxSize[axis] = 0.0f;
+    for (KSweepEntry &entry : entries)
+    {
+      KSweepObject const &object = m_objects[entry.handle];
+      for (int a = 0; a < 3; ++a)
+      {
+        entry.min[a] = object.minExtent[a];
+        entry.max[a] = object.maxExtent[a];
+      }
+      m_maxSize[axis] = std::max(m_maxSize[axis], entry.max[axis] - entry.min[axis]);
+    }
+    m_swapCount += sortAxis(entries, axis, resort);
+  }
+  if (m_removed)
+  {
+    for (size_t handle = 0; handle < m_objects.size(); ++handle)
+    {
+      if (!m_objects[handle].alive) m_listed[handle] = 0;
+    }
+    m_removed = false;
+  }
+
+  // Sweep along the axis with the largest variance of centers
+  double sum[3] = { 0.0, 0.0, 0.0 }, sumSquared[3] = { 0.0, 0.0, 0.0 };
+  for (KSweepEntry const &entry : m_entries[0])
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      double center = 0.5 * (entry.min[axis] + entry.max[axis]);
+      sum[axis] += center;
+      sumSquared[axis] += center * center;
+    }
+  }
+  double count = std::max<double>(1.0, m_entries[0].size());
+  double best = -1.0;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    double variance = sumSquared[axis] / count - (sum[axis] / count) * (sum[axis] / count);
+    if (variance > best)
+    {
+      best = variance;
+      m_axis = axis;
+    }
+  }
+}
+
+/*******************************************************************************
+ * KSweepAndPrune
+ ******************************************************************************/
+KSweepAndPrune::KSweepAndPrune() :
+  m_private(new KSweepAndPrunePrivate)
+{
+  // Intentionally Empty
+}
+
+KSweepAndPrune::~KSweepAndPrune()
+{
+  // Intentionally Empty
+}
+
+void KSweepAndPrune::clear()
+{
+  P(KSweepAndPrunePrivate);
+  p.clear();
+}
+
+auto KSweepAndPrune::insert(KVector3D const &minExtent, KVector3D const &maxExtent) -> Handle
+{
+  P(KSweepAndPrunePrivate);
+  Handle handle;
+  if (p.m_freeHandles.empty())
+  {
+    handle = static_cast<Handle>(p.m_objects.size());
+    p.m_objects.push_back(KSweepObject());
+  }
+  else
+  {
+    handle = p.m_freeHandles.back();
+    p.m_freeHandles.pop_back();
+  }
+  KSweepObject &object = p.m_objects[handle];
+  object.minExtent = minExtent;
+  object.maxExtent = maxExtent;
+  object.alive = true;
+  p.m_added.push_back(handle);
+  p.m_dirty = true;
+  return handle;
+}
+
+void KSweepAndPrune::update(Handle handle, KVector3D const &minExtent, KVector3D const &maxExtent)
+{
+  P(KSweepAndPrunePrivate);
+  KSweepObject &object = p.m_objects[handle];
+  object.minExtent = minExtent;
+  object.maxExtent = maxExtent;
+  p.m_dirty = true;
+}
+
+void KSweepAndPrune::remove(Handle handle)
+{
+  P(KSweepAndPrunePrivate);
+  p.m_objects[handle].alive = false;
+  p.m_freeHandles.push_back(handle);
+  p.m_removed = true;
+  p.m_dirty = true;
+}
+
+void KSweepAndPrune::pairs(std::vector<HandlePair> &results) const
+{
+  P(const KSweepAndPrunePrivate);
+  p.clean();
+
+  // Every box is swept against the boxes starting before it ends
+  int axis = p.m_axis;
+  int axis1 = (axis + 1) % 3, axis2 = (axis + 2) % 3;
+  std::vector<KSweepEntry> const &entries = p.m_entries[axis];
+  size_t chunks = Karma::parallelChunkCount(entries.size());
+  std::vector<std::vector<HandlePair>> found(chunks);
+  Karma::parallelChunks(entries.size(), chunks, [&](size_t chunk, size_t begin, size_t end)
+  {
+    std::vector<HandlePair> &local = found[chunk];
+    for (size_t i = begin; i < end; ++i)
+    {
+      KSweepEntry const &entry = entries[i];
+      float end = entry.max[axis];
+      for (size_t j = i + 1; j < entries.size() && entries[j].min[axis] <= end; ++j)
+      {
+        if (overlapsOther(entry, entries[j], axis1, axis2)) local.push_back(makePair(entry.handle, entries[j].handle));
+      }
+    }
+  });
+  for (std::vector<HandlePair> const &local : found)
+  {
+    results.insert(results.end(), local.begin(), local.end());
+  }
+}
+
+void KSweepAndPrune::query(KVector3D const &minExtent, KVector3D const &maxExtent, std::vector<Handle> &results) const
+{
+  P(const KSweepAndPrunePrivate);
+  p.clean();
+
+  // Nothing starting earlier than the largest box could still reach the region
+  int axis = p.m_axis;
+  std::vector<KSweepEntry> const &entries = p.m_entries[axis];
+  KSweepEntry region;
+  for (int a = 0; a < 3; ++a)
+  {
+    region.min[a] = minExtent[a];
+    region.max[a] = maxExtent[a];
+  }
+  float first = region.min[axis] - p.m_maxSize[axis];
+  auto it = std::lower_bound(entries.begin(), entries.end(), first, [axis](KSweepEntry const &entry, float value)
+  {
+    return entry.min[axis] < value;
+  });
+  for (; it != entries.end() && it->min[axis] <= region.max[axis]; ++it)
+  {
+    if (overlaps(*it, region)) results.push_back(it->handle);
+  }
+}
+
+size_t KSweepAndPrune::size() const
+{
+  P(const KSweepAndPrunePrivate);
+  return p.m_objects.size() - p.m_freeHandles.size();
+}
+
+size_t KSweepAndPrune::swapCount() const
+{
+  P(const KSweepAndPrunePrivate);
+  p.clean();
+  return p.m_swapCount;
+}
+
+int KSweepAndPrune::sweepAxis() const
+{
+  P(const KSweepAndPrunePrivate);
+  p.clean();
+  return p.m_axis;
+}
@@ -0,0 +1,46 @@
+#ifndef KSWEEPANDPRUNE_H
+#define KSWEEPANDPRUNE_H KSweepAndPrune
+
+class KVector3D;
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <KSharedPointer>
+
+// Broadphase over dynamic bounding boxes, addressed by handles.
+// Boxes are kept sorted by their minimum along all three axes. Changes are only
+// applied once the next query runs, as an insertion sort of the previous order,
+// so the cost follows how far boxes moved rather than how many there are.
+// Queries sweep along the axis where box centers are spread out the most.
+class KSweepAndPrunePrivate;
+class KSweepAndPrune
+{
+public:
+  typedef uint32_t Handle;
+  typedef std::pair<Handle, Handle> HandlePair;
+  static const Handle InvalidHandle = 0xFFFFFFFF;
+
+  KSweepAndPrune();
+  ~KSweepAndPrune();
+  void clear();
+
+  // Modification
+  Handle insert(KVector3D const &minExtent, KVector3D const &maxExtent);
+  void update(Handle handle, KVector3D const &minExtent, KVector3D const &maxExtent);
+  void remove(Handle handle);
+
+  // Queries (Results are appended, pairs are reported once with first < second)
+  void pairs(std::vector<HandlePair> &results) const;
+  void query(KVector3D const &minExtent, KVector3D const &maxExtent, std::vector<Handle> &results) const;
+
+  // Statistics
+  size_t size() const;
+  size_t swapCount() const;  // Moves made by the last re-sort
+  int sweepAxis() const;
+
+private:
+  KSharedPointer<KSweepAndPrunePrivate> m_private;
+};
+
+#endif // KSWEEPANDPRUNE_H
@@ -0,0 +1,310 @@
+#include "ktransformarray.h"
+
+#include <cstring>
+#include <KMatrix4x4>
+#include <KParallel>
+#include <KTransform3D>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*******************************************************************************
+ * KTransformArray Helpers
+ ******************************************************************************/
+namespace
+{
+
+  // The affine prefix, split into the parts each output element needs.
+  struct KTransformPrefix
+  {
+    float m[3][3];        // Upper 3x3 [row][column]
+    float t[3];
+    float normal[3][3];   // Inverse transpose of the upper 3x3
+  };
+
+  struct KTransformComponents
+  {
+    float const *translation[3];
+    float const *rotation[4];
+    float const *scale[3];
+    float const *localOffset[3];
+    float const *localScale[3];
+  };
+
+  KTransformPrefix makePrefix(KMatrix4x4 const &mtx)
+  {
+    KTransformPrefix prefix;
+    for (int r = 0; r < 3; ++r)
+    {
+      for (int c = 0; c < 3; ++c) prefix.m[r][c] = mtx(r, c);
+      prefix.t[r] = mtx(r, 3);
+    }
+
+    // Cofactors divided by the determinant (Only computed once per batch, so precision wins)
+    float const (&m)[3][3] = prefix.m;
+    float cofactor[3][3] =
+    {
+      { m[1][1] * m[2][2] - m[1][2] * m[2][1], m[1][2] * m[2][0] - m[1][0] * m[2][2], m[1][0] * m[2][1] - m[1][1] * m[2][0] },
+      { m[0][2] * m[2][1] - m[0][1] * m[2][2], m[0][0] * m[2][2] - m[0][2] * m[2][0], m[0][1] * m[2][0] - m[0][0] * m[2][1] },
+      { m[0][1] * m[1][2] - m[0][2] * m[1][1], m[0][2] * m[1][0] - m[0][0] * m[1][2], m[0][0] * m[1][1] - m[0][1] * m[1][0] }
+    };
+    float determinant = m[0][0] * cofactor[0][0] + m[0][1] * cofactor[0][1] + m[0][2] * cofactor[0][2];
+    for (int r = 0; r < 3; ++r)
+    {
+      for (int c = 0; c < 3; ++c) prefix.normal[r][c] = cofactor[r][c] / determinant;
+    }
+    return prefix;
+  }
+
+  // One transform per lane, the SIMD types below provide the same operations on more lanes.
+  struct KTransformScalar
+  {
+    typedef float Vec;
+    static const int Width = 1;
+    static Vec load(float const *p) { return *p; }
+    static Vec set1(float v) { return v; }
+    static Vec add(Vec a, Vec b) { return a + b; }
+    static Vec sub(Vec a, Vec b) { return a - b; }
+    static Vec mul(Vec a, Vec b) { return a * b; }
+    static Vec div(Vec a, Vec b) { return a / b; }
+    static void storeColumn(Vec const rows[4], char *dst, size_t, int column)
+    {
+      std::memcpy(dst + column * 4 * sizeof(float), rows, 4 * sizeof(float));
+    }
+  };
+
+#if defined(__AVX__) || defined(__SSE2__)
+  // Rows of one column for four lanes become the column of each lane
+  inline void storeColumn4(__m128 r0, __m128 r1, __m128 r2, __m128 r3, char *dst, size_t stride, int column)
+  {
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    float *base = reinterpret_cast<float*>(dst + column * 4 * sizeof(float));
+    _mm_storeu_ps(base, r0);
+    _mm_storeu_ps(reinterpret_cast<float*>(reinterpret_cast<char*>(base) + stride), r1);
+    _mm_storeu_ps(reinterpret_cast<float*>(reinterpret_cast<char*>(base) + 2 * stride), r2);
+    _mm_storeu_ps(reinterpret_cast<float*>(reinterpret_cast<char*>(base) + 3 * stride), r3);
+  }
+#endif
+
+#if defined(__AVX__)
+  struct KTransformSimd
+  {
+    typedef __m256 Vec;
+    static const int Width = 8;
+    static Vec load(float const *p) { return _mm256_loadu_ps(p); }
+    static Vec set1(float v) { return _mm256_set1_ps(v); }
+    static Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+    static Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+    static Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+    static Vec div(Vec a, Vec b) { return _mm256_div_ps(a, b); }
+    static void storeColumn(Vec const rows[4], char *dst, size_t stride, int column)
+    {
+      storeColumn4(_mm256_castps256_ps128(rows[0]), _mm256_castps256_ps128(rows[1]), _mm256_castps256_ps128(rows[2]), _mm256_castps256_ps128(rows[3]), dst, stride, column);
+      storeColumn4(_mm256_extractf128_ps(rows[0], 1), _mm256_extractf128_ps(rows[1], 1), _mm256_extractf128_ps(rows[2], 1), _mm256_extractf128_ps(rows[3], 1), dst + 4 * stride, stride, column);
+    }
+  };
+#elif defined(__SSE2__)
+  struct KTransformSimd
+  {
+    typedef __m128 Vec;
+    static const int Width = 4;
+    static Vec load(float const *p) { return _mm_loadu_ps(p); }
+    static Vec set1(float v) { return _mm_set1_ps(v); }
+    static Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+    static Vec sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+    static Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+    static Vec div(Vec a, Vec b) { return _mm_div_ps(a, b); }
+    static void storeColumn(Vec const rows[4], char *dst, size_t stride, int column)
+    {
+      storeColumn4(rows[0], rows[1], rows[2], rows[3], dst, stride, column);
+    }
+  };
+#endif
+
+  // Builds the matrices of Simd::Width consecutive entries, starting at `index`.
+  template <typename Simd>
+  inline void buildMatrices(KTransformPrefix const &prefix, KTransformComponents const &in, size_t index, char *matrices, char *normals, size_t stride)
+  {
+    typedef typename Simd::Vec Vec;
+    Vec const zero = Simd::set1(0.0f), one = Simd::set1(1.0f), two = Simd::set1(2.0f);
+
+    // Rotation matrix of the quaternion (Same terms as QMatrix4x4::rotate)
+    Vec x = Simd::load(in.rotation[0] + index), y = Simd::load(in.rotation[1] + index);
+    Vec z = Simd::load(in.rotation[2] + index), w = Simd::load(in.rotation[3] + index);
+    Vec xx = Simd::mul(x, x), yy = Simd::mul(y, y), zz = Simd::mul(z, z);
+    Vec xy = Simd::mul(x, y), xz = Simd::mul(x, z), yz = Simd::mul(y, z);
+    Vec xw = Simd::mul(x, w), yw = Simd::mul(y, w), zw = Simd::mul(z, w);
+    Vec rotation[3][3] =
+    {
+      { Simd::sub(one, Simd::mul(two, Simd::add(yy, zz))), Simd::mul(two, Simd::sub(xy, zw)), Simd::mul(two, Simd::add(xz, yw)) },
+      { Simd::mul(two, Simd::add(xy, zw)), Simd::sub(one, Simd::mul(two, Simd::add(xx, zz))), Simd::mul(two, Simd::sub(yz, xw)) },
+      { Simd::mul(two, Simd::sub(xz, yw)), Simd::mul(two, Simd::add(yz, xw)), Simd::sub(one, Simd::mul(two, Simd::add(xx, yy))) }
+    };
+    Vec scale[3], translation[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      scale[axis] = Simd::load(in.scale[axis] + index);
+      translation[axis] = Simd::load(in.translation[axis] + index);
+    }
+
+    // prefix * translation, and prefix * rotation * scale
+    Vec translated[3], linear[3][3];
+    for (int r = 0; r < 3; ++r)
+    {
+      translated[r] = Simd::set1(prefix.t[r]);
+      for (int k = 0; k < 3; ++k) translated[r] = Simd::add(translated[r], Simd::mul(Simd::set1(prefix.m[r][k]), translation[k]));
+      for (int c = 0; c < 3; ++c)
+      {
+        Vec sum = Simd::mul(Simd::set1(prefix.m[r][0]), rotation[0][c]);
+        sum = Simd::add(sum, Simd::mul(Simd::set1(prefix.m[r][1]), rotation[1][c]));
+        sum = Simd::add(sum, Simd::mul(Simd::set1(prefix.m[r][2]), rotation[2][c]));
+        linear[r][c] = Simd::mul(sum, scale[c]);
+      }
+    }
+
+    // The local scale and offset are applied first
+    Vec column[4];
+    Vec localOffset[3];
+    for (int c = 0; c < 3; ++c)
+    {
+      Vec localScale = Simd::load(in.localScale[c] + index);
+      localOffset[c] = Simd::load(in.localOffset[c] + index);
+      for (int r = 0; r < 3; ++r) column[r] = Simd::mul(linear[r][c], localScale);
+      column[3] = zero;
+      Simd::storeColumn(column, matrices, stride, c);
+    }
+    for (int r = 0; r < 3; ++r)
+    {
+      column[r] = translated[r];
+      for (int c = 0; c < 3; ++c) column[r] = Simd::add(column[r], Simd::mul(linear[r][c], localOffset[c]));
+    }
+    column[3] = one;
+    Simd::storeColumn(column, matrices, stride, 3);
+    if (!normals) return;
+
+    // Rotations are orthonormal, so the inverse transpose only needs the prefix's and the inverse scale.
+    // The bottom row cancels the translation, as it would in a general inverse.
+    for (int c = 0; c < 3; ++c)
+    {
+      Vec inverseScale = Simd::div(one, scale[c]);
+      Vec bottom = zero;
+      for (int r = 0; r < 3; ++r)
+      {
+        Vec sum = Simd::mul(Simd::set1(prefix.normal[r][0]), rotation[0][c]);
+        sum = Simd::add(sum, Simd::mul(Simd::set1(prefix.normal[r][1]), rotation[1][c]));
+        sum = Simd::add(sum, Simd::mul(Simd::set1(prefix.normal[r][2]), rotation[2][c]));
+        column[r] = Simd::mul(sum, inverseScale);
+        bottom = Simd::sub(bottom, Simd::mul(column[r], translated[r]));
+      }
+      column[3] = bottom;
+      Simd::storeColumn(column, normals, stride, c);
+    }
+    column[0] = column[1] = column[2] = zero;
+    column[3] = one;
+    Simd::storeColumn(column, normals, stride, 3);
+  }
+
+}
+
+/*******************************************************************************
+ * KTransformArray
+ ******************************************************************************/
+KTransformArray::KTransformArray()
+{
+  // Intentionally Empty
+}
+
+void KTransformArray::clear()
+{
+  resize(0);
+}
+
+void KTransformArray::reserve(size_t count)
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_translation[axis].reserve(count);
+    m_scale[axis].reserve(count);
+    m_localOffset[axis].reserve(count);
+    m_localScale[axis].reserve(count);
+  }
+  for (int i = 0; i < 4; ++i) m_rotation[i].reserve(count);
+}
+
+void KTransformArray::resize(size_t count)
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_translation[axis].resize(count, 0.0f);
+    m_scale[axis].resize(count, 1.0f);
+    m_localOffset[axis].resize(count, 0.0f);
+    m_localScale[axis].resize(count, 1.0f);
+  }
+  for (int i = 0; i < 3; ++i) m_rotation[i].resize(count, 0.0f);
+  m_rotation[3].resize(count, 1.0f);
+}
+
+void KTransformArray::set(size_t index, KTransform3D const &transform)
+{
+  KQuaternion const &rotation = transform.rotation();
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_translation[axis][index] = transform.translation()[axis];
+    m_scale[axis][index] = transform.scale()[axis];
+    m_localOffset[axis][index] = 0.0f;
+    m_localScale[axis][index] = 1.0f;
+  }
+  m_rotation[0][index] = rotation.x();
+  m_rotation[1][index] = rotation.y();
+  m_rotation[2][index] = rotation.z();
+  m_rotation[3][index] = rotation.scalar();
+}
+
+void KTransformArray::set(size_t index, KTransform3D const &transform, KMatrix4x4 const &local)
+{
+  set(index, transform);
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_localOffset[axis][index] = local(axis, 3);
+    m_localScale[axis][index] = local(axis, axis);
+  }
+}
+
+void KTransformArray::toMatrices(KMatrix4x4 const &prefix, void *matrices, size_t stride) const
+{
+  toMatrices(prefix, matrices, 0, stride);
+}
+
+void KTransformArray::toMatrices(KMatrix4x4 const &prefix, void *matrices, void *normals, size_t stride) const
+{
+  KTransformPrefix split = makePrefix(prefix);
+  KTransformComponents in;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    in.translation[axis] = m_translation[axis].data();
+    in.scale[axis] = m_scale[axis].data();
+    in.localOffset[axis] = m_localOffset[axis].data();
+    in.localScale[axis] = m_localScale[axis].data();
+  }
+  for (int i = 0; i < 4; ++i) in.rotation[i] = m_rotation[i].data();
+
+  char *matrixBytes = static_cast<char*>(matrices);
+  char *normalBytes = static_cast<char*>(normals);
+  Karma::parallelFor(size(), [&](size_t begin, size_t end)
+  {
+    size_t i = begin;
+#if defined(__AVX__) || defined(__SSE2__)
+    for (; i + KTransformSimd::Width <= end; i += KTransformSimd::Width)
+    {
+      buildMatrices<KTransformSimd>(split, in, i, matrixBytes + i * stride, normalBytes ? normalBytes + i * stride : 0, stride);
+    }
+#endif
+    for (; i < end; ++i)
+    {
+      buildMatrices<KTransformScalar>(split, in, i, matrixBytes + i * stride, normalBytes ? normalBytes + i * stride : 0, stride);
+    }
+  });
+}
@@ -0,0 +1,52 @@
+#ifndef KTRANSFORMARRAY_H
+#define KTRANSFORMARRAY_H KTransformArray
+
+class KMatrix4x4;
+class KTransform3D;
+#include <cstddef>
+#include <vector>
+
+// Many transforms (translation, rotation, scale), stored as one array per component
+// (structure of arrays) so their matrices can be built several at a time.
+// Every entry can also carry a local scale and offset, applied before the transform
+// (Such as the dequantization of a mesh).
+class KTransformArray
+{
+public:
+  KTransformArray();
+
+  // Container
+  size_t size() const;
+  bool empty() const;
+  void clear();
+  void reserve(size_t count);
+  void resize(size_t count);
+  void set(size_t index, KTransform3D const &transform);
+  void set(size_t index, KTransform3D const &transform, KMatrix4x4 const &local); // `local` may only scale and translate
+
+  // Batched Matrices
+  // Writes `prefix * transform * local` of every entry as 16 column-major floats, `stride` bytes apart.
+  // Normals receive the inverse transpose of `prefix * transform`, derived from the rotation and
+  // the inverse scale instead of a general inverse. The prefix has to be affine.
+  void toMatrices(KMatrix4x4 const &prefix, void *matrices, size_t stride) const;
+  void toMatrices(KMatrix4x4 const &prefix, void *matrices, void *normals, size_t stride) const;
+
+private:
+  std::vector<float> m_translation[3];
+  std::vector<float> m_rotation[4];  // x, y, z, scalar
+  std::vector<float> m_scale[3];
+  std::vector<float> m_localOffset[3];
+  std::vector<float> m_localScale[3];
+};
+
+inline size_t KTransformArray::size() const
+{
+  return m_scale[0].size();
+}
+
+inline bool KTransformArray::empty() const
+{
+  return m_scale[0].empty();
+}
+
+#endif // KTRANSFORMARRAY_H
@@ -123,11 +123,7 @@ inline auto KTriangleIndexCloud::end() -> Iterator
 template <typename It>
 void KTriangleIndexCloud::copy(It begin, It end)
 {
-  while (begin != end)
-  {
-    m_container.push_back(*begin);
-    ++begin;
-  }
+  m_container.insert(m_container.end(), begin, end);
 }
 
 #endif // KTRIANGLEINDEXCLOUD_H
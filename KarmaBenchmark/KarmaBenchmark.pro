@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Karma Benchmarks (console, never run by KarmaView)
+#
+#-------------------------------------------------
+
+TEMPLATE  = app
+CONFIG   -= app_bundle
+CONFIG   += console
+QT       += core gui widgets
+TARGET    = KarmaBenchmark
+include(../config.pri)
+
+# Karma's debug drawing pulls in the OpenGL framework
+LIBS += $${KARMA_LIB}
+LIBS += $${OPENGL_LIB}
+LIBS += $${QTBASEEXT_LIB}
+
+PRE_TARGETDEPS += $${KARMA_DEP}
+PRE_TARGETDEPS += $${OPENGL_DEP}
+PRE_TARGETDEPS += $${QTBASEEXT_DEP}
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,549 @@
+// Standard Template Library
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+// Qt Framework
+#include <QCoreApplication>
+#include <QTemporaryFile>
+
+// Karma Framework
+#include <KDebug>
+#include <KElapsedTimer>
+#include <KHalfEdgeMesh>
+#include <KMath>
+#include <KMatrix4x4>
+#include <KTransform3D>
+#include <KTransformArray>
+#include <KVector3D>
+
+// Bounding Volumes / Culling
+#include <KSweepAndPrune>
+#include <KHashGrid>
+#include <KLooseOctree>
+#include <KAabbArray>
+#include <KAabbBoundingVolume>
+#include <KFrustum>
+#include <KStaticGeometry>
+#include <KAdaptiveOctree>
+#include <KFlatTree>
+#include <KOcclusionBuffer>
+
+/*******************************************************************************
+ * Scene
+ ******************************************************************************/
+
+// Acceleration structures stop splitting at small leaves (or absurd depths).
+static bool terminateAtSmallLeaves(size_t numTriangles, size_t depth)
+{
+  return numTriangles <= 4 || depth >= 64;
+}
+
+// Places four copies of the mesh on a ring, the same layout KarmaView builds.
+template <typename T>
+static void addRing(T &geom, KHalfEdgeMesh const &mesh, float radius)
+{
+  KTransform3D transform;
+  geom.clear();
+  for (int i = 0; i < 4; ++i)
+  {
+    float rads = float(i * Karma::Pi) / 2;
+    transform.setTranslation(cos(rads) * radius, 0.0f, sin(rads) * radius);
+    geom.addGeometry(mesh, transform);
+  }
+}
+
+// Moves the copies on the ring to a new radius and refits the geometry, returning the subtrees rebuilt.
+static size_t refitRing(KStaticGeometry &geom, KHalfEdgeMesh const &mesh, float radius)
+{
+  KTransform3D transform;
+  for (int i = 0; i < 4; ++i)
+  {
+    float rads = float(i * Karma::Pi) / 2;
+    transform.setTranslation(cos(rads) * radius, 0.0f, sin(rads) * radius);
+    geom.updateGeometry(i, mesh, transform);
+  }
+  return geom.refit();
+}
+
+/*******************************************************************************
+ * Benchmarks
+ ******************************************************************************/
+
+// Moves a cloud of boxes for a few frames, comparing both broadphases against each other.
+static void benchmarkBroadphase(size_t count)
+{
+  static const int Frames = 4;
+  std::vector<KVector3D> minExtents(count), sizes(count), velocities(count);
+  float world = 4.0f * std::cbrt(float(count));
+  auto random = []() -> float { return float(rand()) / RAND_MAX; };
+  for (size_t i = 0; i < count; ++i)
+  {
+    minExtents[i] = KVector3D(random(), random(), random()) * world;
+    sizes[i] = KVector3D(0.5f, 0.5f, 0.5f) + KVector3D(random(), random(), random()) * 1.5f;
+    velocities[i] = (KVector3D(random(), random(), random()) - KVector3D(0.5f, 0.5f, 0.5f)) * 0.2f;
+  }
+
+  KSweepAndPrune sweep;
+  KHashGrid grid(2.0f);
+  std::vector<KSweepAndPrune::Handle> sweepHandles(count);
+  std::vector<KHashGrid::Handle> gridHandles(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    sweepHandles[i] = sweep.insert(minExtents[i], minExtents[i] + sizes[i]);
+    gridHandles[i] = grid.insert(minExtents[i], minExtents[i] + sizes[i]);
+  }
+
+  KElapsedTimer timer;
+  quint64 sweepNs = 0, gridNs = 0;
+  size_t sweepPairs = 0, gridPairs = 0;
+  std::vector<KSweepAndPrune::HandlePair> pairs;
+  for (int frame = 0; frame < Frames; ++frame)
+  {
+    for (size_t i = 0; i < count; ++i) minExtents[i] += velocities[i];
+    timer.start();
+    for (size_t i = 0; i < count; ++i) sweep.update(sweepHandles[i], minExtents[i], minExtents[i] + sizes[i]);
+    pairs.clear();
+    sweep.pairs(pairs);
+    sweepNs += timer.nsecsElapsed();
+    sweepPairs += pairs.size();
+    timer.start();
+    for (size_t i = 0; i < count; ++i) grid.update(gridHandles[i], minExtents[i], minExtents[i] + sizes[i]);
+    pairs.clear();
+    grid.pairs(pairs);
+    gridNs += timer.nsecsElapsed();
+    gridPairs += pairs.size();
+  }
+  kDebug() << "Broadphase (ms/frame)        :" << count << "boxes," << float(sweepNs) / (1e6f * Frames) << "sort and sweep," << float(gridNs) / (1e6f * Frames) << "hash grid," << sweepPairs / Frames << "pairs" << (sweepPairs == gridPairs ? "" : "(mismatch)");
+}
+
+// Moves boxes through a loose octree, removing and reinserting some every frame.
+// Frustum, box and sphere queries are checked against testing every box.
+static void benchmarkLooseOctree(size_t count)
+{
+  static const int Frames = 16;
+  std::vector<KVector3D> minExtents(count), sizes(count), velocities(count);
+  float world = 4.0f * std::cbrt(float(count));
+  auto random = []() -> float { return float(rand()) / RAND_MAX; };
+  for (size_t i = 0; i < count; ++i)
+  {
+    minExtents[i] = KVector3D(random(), random(), random()) * world;
+    sizes[i] = KVector3D(0.5f, 0.5f, 0.5f) + KVector3D(random(), random(), random()) * 1.5f;
+    velocities[i] = (KVector3D(random(), random(), random()) - KVector3D(0.5f, 0.5f, 0.5f)) * 0.2f;
+  }
+
+  // The world bounds are a little larger than the field, some boxes drift out of them
+  KLooseOctree tree(KVector3D(0.5f, 0.5f, 0.5f) * world, 0.55f * world);
+  std::vector<KLooseOctree::Handle> handles(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    handles[i] = tree.insert(minExtents[i], minExtents[i] + sizes[i]);
+  }
+
+  KElapsedTimer timer;
+  quint64 updateNs = 0, queryNs = 0, bruteNs = 0;
+  size_t found = 0, mismatches = 0;
+  std::vector<KLooseOctree::Handle> results, expected;
+  auto compare = [&results, &expected, &mismatches, &found]()
+  {
+    std::sort(results.begin(), results.end());
+    std::sort(expected.begin(), expected.end());
+    mismatches += (results != expected);
+    found += results.size();
+    results.clear();
+    expected.clear();
+  };
+  for (int frame = 0; frame < Frames; ++frame)
+  {
+    // Every 16th box leaves and comes back in the next frame, the rest move
+    timer.start();
+    for (size_t i = 0; i < count; ++i)
+    {
+      minExtents[i] += velocities[i];
+      if (handles[i] == KLooseOctree::InvalidHandle)
+      {
+        handles[i] = tree.insert(minExtents[i], minExtents[i] + sizes[i]);
+      }
+      else if ((i + frame) % 16 == 0)
+      {
+        tree.remove(handles[i]);
+        handles[i] = KLooseOctree::InvalidHandle;
+      }
+      else
+      {
+        tree.update(handles[i], minExtents[i], minExtents[i] + sizes[i]);
+      }
+    }
+    updateNs += timer.nsecsElapsed();
+
+    // One query of each kind from a point moving through the field
+    float rads = float(frame) / Frames * 2.0f * Karma::Pi;
+    KVector3D eye = KVector3D(0.5f + 0.3f * std::cos(rads), 0.5f, 0.5f + 0.3f * std::sin(rads)) * world;
+    KMatrix4x4 projection, camera;
+    projection.perspective(60.0f, 16.0f / 9.0f, 0.1f, 0.5f * world);
+    camera.lookAt(eye, eye + KVector3D(-std::sin(rads), 0.0f, std::cos(rads)), KVector3D(0.0f, 1.0f, 0.0f));
+    KFrustum frustum(projection * camera);
+    KVector3D boxMin = eye - KVector3D(0.1f, 0.1f, 0.1f) * world, boxMax = eye + KVector3D(0.1f, 0.1f, 0.1f) * world;
+    float radius = 0.1f * world;
+
+    timer.start();
+    tree.query(frustum, results);
+    queryNs += timer.nsecsElapsed();
+    timer.start();
+    for (size_t i = 0; i < count; ++i)
+    {
+      int planeMask = KFrustum::AllPlanes;
+      if (handles[i] != KLooseOctree::InvalidHandle && frustum.intersects(minExtents[i], minExtents[i] + sizes[i], &planeMask)) expected.push_back(handles[i]);
+    }
+    bruteNs += timer.nsecsElapsed();
+    compare();
+
+    timer.start();
+    tree.query(boxMin, boxMax, results);
+    queryNs += timer.nsecsElapsed();
+    timer.start();
+    for (size_t i = 0; i < count; ++i)
+    {
+      KVector3D maxExtent = minExtents[i] + sizes[i];
+      bool overlaps = true;
+      for (int axis = 0; axis < 3; ++axis) overlaps = overlaps && minExtents[i][axis] <= boxMax[axis] && maxExtent[axis] >= boxMin[axis];
+      if (handles[i] != KLooseOctree::InvalidHandle && overlaps) expected.push_back(handles[i]);
+    }
+    bruteNs += timer.nsecsElapsed();
+    compare();
+
+    timer.start();
+    tree.query(eye, radius, results);
+    queryNs += timer.nsecsElapsed();
+    timer.start();
+    for (size_t i = 0; i < count; ++i)
+    {
+      KVector3D maxExtent = minExtents[i] + sizes[i];
+      float distanceSq = 0.0f;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        float d = std::max(std::max(minExtents[i][axis] - eye[axis], eye[axis] - maxExtent[axis]), 0.0f);
+        distanceSq += d * d;
+      }
+      if (handles[i] != KLooseOctree::InvalidHandle && distanceSq <= radius * radius) expected.push_back(handles[i]);
+    }
+    bruteNs += timer.nsecsElapsed();
+    compare();
+  }
+  kDebug() << "Loose Octree (ms/frame)      :" << count << "boxes," << float(updateNs) / (1e6f * Frames) << "update," << float(queryNs) / (1e6f * Frames) << "queries," << float(bruteNs) / (1e6f * Frames) << "brute force," << found / (3 * Frames) << "found per query," << tree.reinsertCount() << "reinserts" << (mismatches == 0 ? "" : "(mismatch)");
+}
+
+// Turns a camera around within a field of boxes, comparing batched culling with testing boxes one by one.
+static void benchmarkFrustumCulling(size_t count)
+{
+  static const int Views = 64;
+  size_t side = static_cast<size_t>(std::sqrt(float(count)));
+  KAabbArray boxes;
+  boxes.reserve(side * side);
+  auto random = []() -> float { return float(rand()) / RAND_MAX; };
+  for (size_t z = 0; z < side; ++z)
+  {
+    for (size_t x = 0; x < side; ++x)
+    {
+      KVector3D minExtent = KVector3D(float(x) - 0.5f * side, random() * 4.0f - 2.0f, float(z) - 0.5f * side) * 2.0f;
+      boxes.push_back(KAabbBoundingVolume(minExtent, minExtent + KVector3D(0.5f, 0.5f, 0.5f) + KVector3D(random(), random(), random())));
+    }
+  }
+
+  KElapsedTimer timer;
+  quint64 batchedNs = 0, singleNs = 0;
+  size_t batchedVisible = 0, singleVisible = 0;
+  std::vector<uint8_t> visible(boxes.size()), planeCache(boxes.size(), 0);
+  for (int view = 0; view < Views; ++view)
+  {
+    float rads = float(view) / Views * 2.0f * Karma::Pi;
+    KMatrix4x4 projection, camera;
+    projection.perspective(60.0f, 16.0f / 9.0f, 0.1f, 250.0f);
+    camera.lookAt(KVector3D(0.0f, 5.0f, 0.0f), KVector3D(std::cos(rads), 5.0f, std::sin(rads)), KVector3D(0.0f, 1.0f, 0.0f));
+    KFrustum frustum(projection * camera);
+    timer.start();
+    batchedVisible += frustum.cull(boxes, visible.data(), planeCache.data());
+    batchedNs += timer.nsecsElapsed();
+    timer.start();
+    for (size_t i = 0; i < boxes.size(); ++i)
+    {
+      int planeMask = KFrustum::AllPlanes;
+      singleVisible += frustum.intersects(boxes.minExtent(i), boxes.maxExtent(i), &planeMask);
+    }
+    singleNs += timer.nsecsElapsed();
+  }
+  kDebug() << "Frustum Culling (ms/view)    :" << boxes.size() << "boxes," << float(batchedNs) / (1e6f * Views) << "batched," << float(singleNs) / (1e6f * Views) << "one by one," << batchedVisible / Views << "visible" << (batchedVisible == singleVisible ? "" : "(mismatch)");
+}
+
+// Builds model-view and normal matrices the way instances are committed, batched against one glm inverse per instance.
+static void benchmarkInstanceMatrices(size_t count)
+{
+  static const int Frames = 16;
+  static const size_t Stride = 256; // Typical uniform buffer offset alignment
+  auto random = []() -> float { return float(rand()) / RAND_MAX; };
+  std::vector<KTransform3D> transforms(count);
+  KTransformArray batch;
+  batch.resize(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    transforms[i].setTranslation(random() * 100.0f - 50.0f, random() * 10.0f, random() * 100.0f - 50.0f);
+    transforms[i].setRotation(random() * 360.0f, random(), random() + 0.1f, random());
+    transforms[i].setScale(0.5f + random(), 0.5f + random(), 0.5f + random());
+    batch.set(i, transforms[i]);
+  }
+  KMatrix4x4 worldToView;
+  worldToView.lookAt(KVector3D(0.0f, 5.0f, 0.0f), KVector3D(1.0f, 5.0f, 1.0f), KVector3D(0.0f, 1.0f, 0.0f));
+  glm::mat4 glmWorldToView = Karma::ToGlm(worldToView);
+
+  KElapsedTimer timer;
+  quint64 batchedNs = 0, singleNs = 0;
+  std::vector<char> batched(count * Stride), single(count * Stride);
+  for (int frame = 0; frame < Frames; ++frame)
+  {
+    timer.start();
+    batch.toMatrices(worldToView, batched.data(), batched.data() + sizeof(glm::mat4), Stride);
+    batchedNs += timer.nsecsElapsed();
+    timer.start();
+    for (size_t i = 0; i < count; ++i)
+    {
+      glm::mat4 *data = reinterpret_cast<glm::mat4*>(single.data() + i * Stride);
+      data[0] = glmWorldToView * Karma::ToGlm(transforms[i].toMatrix());
+      data[1] = glm::transpose(glm::inverse(data[0]));
+    }
+    singleNs += timer.nsecsElapsed();
+  }
+
+  float maxError = 0.0f;
+  for (size_t i = 0; i < count * Stride / sizeof(float); i += Stride / sizeof(float))
+  {
+    float const *lhs = reinterpret_cast<float const*>(batched.data()) + i;
+    float const *rhs = reinterpret_cast<float const*>(single.data()) + i;
+    for (int k = 0; k < 32; ++k) maxError = std::max(maxError, std::abs(lhs[k] - rhs[k]));
+  }
+  kDebug() << "Instance Matrices (ms/frame) :" << count << "instances," << float(batchedNs) / (1e6f * Frames) << "batched," << float(singleNs) / (1e6f * Frames) << "one by one," << maxError << "max difference";
+}
+
+// Builds the ring with both BVH builders, comparing build time and the resulting SAH cost.
+static void benchmarkStaticGeometry(KHalfEdgeMesh const &mesh)
+{
+  KElapsedTimer timer;
+  KStaticGeometry topDown, sah;
+  addRing(topDown, mesh, 10.0f);
+  addRing(sah, mesh, 10.0f);
+  timer.start();
+  topDown.build(KStaticGeometry::TopDownMethod, &terminateAtSmallLeaves);
+  quint64 topDownNs = timer.nsecsElapsed();
+  timer.start();
+  sah.build(KStaticGeometry::SahMethod, &terminateAtSmallLeaves);
+  quint64 sahNs = timer.nsecsElapsed();
+  KFlatTree const &flatTree = sah.flatTree();
+  kDebug() << "Top-Down BVH (ms)            :" << float(topDownNs) / 1e6f << "SAH cost" << topDown.sahCost();
+  kDebug() << "Binned SAH BVH (ms)          :" << float(sahNs) / 1e6f << "SAH cost" << sah.sahCost();
+  kDebug() << "Flattened BVH                :" << flatTree.size() << "nodes," << float(flatTree.memoryUsage()) / 1024.0f << "KiB";
+}
+
+// Builds the ring into an octree top-down and bottom-up from sorted Morton codes.
+static void benchmarkOctree(KHalfEdgeMesh const &mesh)
+{
+  KElapsedTimer timer;
+  KAdaptiveOctree topDown, morton;
+  addRing(topDown, mesh, 10.0f);
+  addRing(morton, mesh, 10.0f);
+  timer.start();
+  topDown.build(KAdaptiveOctree::TopDownMethod, &terminateAtSmallLeaves);
+  quint64 topDownNs = timer.nsecsElapsed();
+  timer.start();
+  morton.build(KAdaptiveOctree::BottomUpMethod, &terminateAtSmallLeaves);
+  quint64 mortonNs = timer.nsecsElapsed();
+  kDebug() << "Top-Down Octree (ms)         :" << float(topDownNs) / 1e6f << "depth" << topDown.depth() << "," << topDown.flatTree().size() << "nodes";
+  kDebug() << "Morton Octree (ms)           :" << float(mortonNs) / 1e6f << "depth" << morton.depth() << "," << morton.flatTree().size() << "nodes";
+}
+
+// Saves a built BVH to a temporary file and loads it back over the same geometry.
+static void benchmarkSerialization(KHalfEdgeMesh const &mesh)
+{
+  QTemporaryFile file;
+  if (!file.open()) return;
+  file.close();
+
+  KElapsedTimer timer;
+  KStaticGeometry built, loaded;
+  addRing(built, mesh, 10.0f);
+  addRing(loaded, mesh, 10.0f);
+  built.build(KStaticGeometry::SahMethod, &terminateAtSmallLeaves);
+  timer.start();
+  bool saveResult = built.save(qPrintable(file.fileName()));
+  quint64 saveNs = timer.nsecsElapsed();
+  timer.start();
+  bool loadResult = loaded.load(qPrintable(file.fileName()), KStaticGeometry::SahMethod);
+  quint64 loadNs = timer.nsecsElapsed();
+  kDebug() << "Save/Load BVH (ms)           :" << float(saveNs) / 1e6f << "save," << float(loadNs) / 1e6f << "load" << ((saveResult && loadResult) ? "" : "(failed)");
+}
+
+// Casts a grid of camera-like rays at the geometry, comparing traversal modes (Mrays/s).
+static void benchmarkRaycasts(KStaticGeometry const &geometry, KAabbBoundingVolume const &aabb)
+{
+  static const int GridSize = 256;
+  static const int BruteForceRays = 64;
+  KFlatTree const &tree = geometry.flatTree();
+  KVector3D extent = aabb.maxExtent() - aabb.minExtent();
+  KVector3D origin = aabb.center() - KVector3D(0.0f, 0.0f, 2.0f * extent.z() + 1.0f);
+  auto direction = [&](int x, int y) -> KVector3D
+  {
+    KVector3D target = aabb.minExtent() + KVector3D(extent.x() * (x + 0.5f) / GridSize, extent.y() * (y + 0.5f) / GridSize, 0.5f * extent.z());
+    return target - origin;
+  };
+  auto mrays = [](size_t rays, quint64 ns) -> float
+  {
+    return float(rays) * 1e3f / std::max<quint64>(ns, 1);
+  };
+
+  KRayHit hit;
+  KElapsedTimer timer;
+  size_t hits = 0;
+  timer.start();
+  for (int y = 0; y < GridSize; ++y)
+  {
+    for (int x = 0; x < GridSize; ++x)
+    {
+      hits += geometry.raycast(origin, direction(x, y), std::numeric_limits<float>::max(), &hit);
+    }
+  }
+  float single = mrays(GridSize * GridSize, timer.nsecsElapsed());
+
+  // Packets cover 2x2 pixel quads, so their rays stay coherent
+  KRayPacket packet;
+  KRayHit hits4[KRayPacket::Width];
+  timer.start();
+  for (int y = 0; y < GridSize; y += 2)
+  {
+    for (int x = 0; x < GridSize; x += 2)
+    {
+      for (int ray = 0; ray < KRayPacket::Width; ++ray)
+      {
+        KVector3D d = direction(x + (ray & 1), y + (ray >> 1));
+        for (int axis = 0; axis < 3; ++axis)
+        {
+          packet.origin[axis][ray] = origin[axis];
+          packet.direction[axis][ray] = d[axis];
+        }
+        packet.tMax[ray] = std::numeric_limits<float>::max();
+      }
+      tree.raycast(packet, hits4);
+    }
+  }
+  float packets = mrays(GridSize * GridSize, timer.nsecsElapsed());
+
+  timer.start();
+  for (int ray = 0; ray < BruteForceRays; ++ray)
+  {
+    tree.raycastBruteForce(origin, direction(ray * GridSize / BruteForceRays, GridSize / 2), std::numeric_limits<float>::max(), &hit);
+  }
+  float bruteForce = mrays(BruteForceRays, timer.nsecsElapsed());
+  kDebug() << "Raycasts (Mrays/s)           :" << single << "single," << packets << "packets," << bruteForce << "brute force," << hits << "hits";
+}
+
+// Rasterizes the mesh as an occluder, and tests a wall of boxes hidden right behind it.
+static void benchmarkOcclusion(KHalfEdgeMesh const &mesh, KAabbBoundingVolume const &aabb)
+{
+  static const int GridSize = 64;
+  std::vector<KVector3D> positions;
+  std::vector<uint32_t> indices;
+  positions.reserve(mesh.vertices().size());
+  for (KHalfEdgeMesh::Vertex const &v : mesh.vertices()) positions.push_back(v.position);
+  for (KHalfEdgeMesh::Face const &f : mesh.faces())
+  {
+    KHalfEdgeMesh::HalfEdge const *edge = mesh.halfEdge(f.first);
+    for (int i = 0; i < 3; ++i, edge = mesh.halfEdge(edge->next)) indices.push_back(edge->to - 1);
+  }
+
+  KVector3D extent = aabb.maxExtent() - aabb.minExtent();
+  KVector3D eye = aabb.center() - KVector3D(0.0f, 0.0f, 2.0f * extent.z() + 1.0f);
+  KMatrix4x4 projection, view;
+  projection.perspective(45.0f, 2.0f, 0.1f, 1000.0f);
+  view.lookAt(eye, aabb.center(), KVector3D(0.0f, 1.0f, 0.0f));
+
+  KElapsedTimer timer;
+  KOcclusionBuffer buffer;
+  timer.start();
+  buffer.begin(projection * view);
+  buffer.addOccluder(positions.data(), positions.size(), indices.data(), indices.size(), KMatrix4x4());
+  buffer.rasterize();
+  quint64 rasterize = timer.nsecsElapsed();
+
+  size_t occluded = 0;
+  KVector3D size = extent / GridSize;
+  timer.start();
+  for (int y = 0; y < GridSize; ++y)
+  {
+    for (int x = 0; x < GridSize; ++x)
+    {
+      KVector3D minExtent = KVector3D(aabb.minExtent().x() + x * size.x(), aabb.minExtent().y() + y * size.y(), aabb.maxExtent().z() + size.z());
+      occluded += !buffer.visible(minExtent, minExtent + size);
+    }
+  }
+  quint64 queries = timer.nsecsElapsed();
+  kDebug() << "Occlusion Culling (ms)       :" << float(rasterize) / 1e6f << "raster," << float(queries) / 1e6f << "queries," << occluded << "of" << GridSize * GridSize << "occluded," << buffer.triangleCount() << "triangles";
+}
+
+// Spreads the ring apart and back, refitting a scratch BVH instead of rebuilding it.
+static void benchmarkRefit(KHalfEdgeMesh const &mesh)
+{
+  KStaticGeometry geometry;
+  addRing(geometry, mesh, 10.0f);
+  geometry.build(KStaticGeometry::SahMethod, &terminateAtSmallLeaves);
+
+  KElapsedTimer timer;
+  for (float radius : { 12.0f, 10.0f })
+  {
+    timer.start();
+    size_t rebuilt = refitRing(geometry, mesh, radius);
+    quint64 ns = timer.nsecsElapsed();
+    kDebug() << "Refit BVH (ms)               :" << float(ns) / 1e6f << "SAH cost" << geometry.sahCost() << "," << rebuilt << "subtrees rebuilt";
+  }
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  char const *fileName = (argc > 1) ? argv[1] : ":/resources/objects/sphere.obj";
+
+  // Mesh benchmarks, prepared the way KarmaView loads objects
+  KHalfEdgeMesh mesh;
+  if (!mesh.create(fileName))
+  {
+    kDebug() << "Failed to load" << fileName;
+    return 1;
+  }
+  mesh.fixToCenter();
+  mesh.normalizeVertices();
+  KAabbBoundingVolume aabb(mesh, KAabbBoundingVolume::MinMaxMethod);
+  benchmarkStaticGeometry(mesh);
+  benchmarkOctree(mesh);
+  benchmarkSerialization(mesh);
+  {
+    KStaticGeometry geometry;
+    addRing(geometry, mesh, 10.0f);
+    geometry.build(KStaticGeometry::SahMethod, &terminateAtSmallLeaves);
+    benchmarkRaycasts(geometry, aabb);
+  }
+  benchmarkOcclusion(mesh, aabb);
+  benchmarkRefit(mesh);
+
+  // Synthetic benchmarks
+  benchmarkBroadphase(10000);
+  benchmarkBroadphase(100000);
+  benchmarkLooseOctree(10000);
+  benchmarkLooseOctree(100000);
+  benchmarkFrustumCulling(100000);
+  benchmarkInstanceMatrices(2000);
+  benchmarkInstanceMatrices(100000);
+
+  return 0;
+}
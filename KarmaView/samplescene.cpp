@@ -1,6 +1,8 @@
 #include "samplescene.h"
 
 // Standard Template Library
+#include <cmath>
+#include <cstdlib>
 #include <vector>
 #include <time.h>
 
@@ -13,7 +15,9 @@
 #include <KElapsedTimer>
 #include <KHalfEdgeMesh>
 #include <KLinq>
+#include <KMeshOptimizer>
 #include <KMacros>
+#include <KMatrix4x4>
 #include <KMath>
 #include <KString>
 #include <KVector3D>
@@ -143,7 +147,7 @@ void SampleScenePrivate::loadObj(const KString &fileName)
 
   // Boundary Query
   auto query =
-    COUNT
+    PARALLEL_COUNT
       FROM  ( edge : halfEdgeMesh.halfEdges() )
       WHERE ( edge.face == 0 )
       INCREMENT (1);
@@ -183,7 +187,9 @@ void SampleScenePrivate::loadObj(const KString &fileName)
     // Calculate OpenGLMesh
     {
       timer.start();
-      openGLMesh.create(halfEdgeMesh);
+      openGLMesh.setPositionStream(true);
+      openGLMesh.setOccluder(true);
+      openGLMesh.create(halfEdgeMesh, OpenGLMesh::QuantizedVertexFormat);
       ms = timer.elapsed();
       kDebug() << "Create OpenGLMesh (sec)      :" << float(ms) / 1e3f;
     }
@@ -218,7 +224,15 @@ void SampleScenePrivate::loadObj(const KString &fileName)
     kDebug() << "Mesh Vertexes  :" << halfEdgeMesh.numVertices();
     kDebug() << "Mesh Faces     :" << halfEdgeMesh.numFaces();
     kDebug() << "Mesh HalfEdges :" << halfEdgeMesh.numHalfEdges();
+    kDebug() << "Welded Vertexes:" << halfEdgeMesh.numWeldedVertices();
+    kDebug() << "Degenerate Faces:" << halfEdgeMesh.numDegenerateFaces();
     kDebug() << "Boundary Edges :" << boundaries;
+    kDebug() << "Mesh ACMR      :" << openGLMesh.originalCacheStatistics().acmr << "->" << openGLMesh.optimizedCacheStatistics().acmr;
+    kDebug() << "Mesh ATVR      :" << openGLMesh.originalCacheStatistics().atvr << "->" << openGLMesh.optimizedCacheStatistics().atvr;
+    for (size_t level = 1; level < openGLMesh.levelOfDetailCount(); ++level)
+    {
+      kDebug() << "Mesh LOD" << level << "     :" << openGLMesh.triangleCount(level) << "faces, error" << openGLMesh.levelOfDetailError(level);
+    }
   }
 
   for (std::vector<OpenGLInstance *> layer : m_instances)
@@ -286,6 +300,8 @@ void SampleScene::start()
   OpenGLMesh floorMeshGL;
   floorMesh.create(":/resources/objects/floor.obj");
   floorMesh.calculateVertexNormals();
+  floorMeshGL.setPositionStream(true);
+  floorMeshGL.setOccluder(true);
   floorMeshGL.create(floorMesh);
   OpenGLMeshManager::setMesh("Floor", floorMeshGL);
 
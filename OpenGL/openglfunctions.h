@@ -899,6 +899,13 @@ public:
     GL::getInstance()->glBindBufferBase (target, index, buffer);
   }
 
+#if !defined(QT_OPENGL_ES_3)
+  static inline void glMultiDrawElements (GLenum mode, const GLsizei *count, GLenum type, const GLvoid *const *indices, GLsizei drawcount)
+  {
+    GL::getInstance()->glMultiDrawElements (mode, count, type, indices, drawcount);
+  }
+#endif
+
   static inline void glTransformFeedbackVaryings (GLuint program, GLsizei count, const GLchar *const*varyings, GLenum bufferMode)
   {
     GL::getInstance()->glTransformFeedbackVaryings (program, count, varyings, bufferMode);
@@ -1044,6 +1051,13 @@ public:
     GL::getInstance()->glDrawElementsInstanced (mode, count, type, indices, instancecount);
   }
 
+#if !defined(QT_OPENGL_ES_3)
+  static inline void glDrawElementsInstancedBaseInstance (GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount, GLuint baseinstance)
+  {
+    GL::getInstance()->glDrawElementsInstancedBaseInstance (mode, count, type, indices, instancecount, baseinstance);
+  }
+#endif
+
   static inline void glDrawElementsInstancedBaseVertex (GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount, GLsizei basevertex)
   {
     GL::getInstance()->glDrawElementsInstancedBaseVertex (mode, count, type, indices, instancecount, basevertex);
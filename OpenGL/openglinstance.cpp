@@ -6,25 +6,22 @@
 #include <KMacros>
 #include <OpenGLUniformBufferObject>
 #include <OpenGLBindings>
-#include <OpenGLInstanceData>
-#include <OpenGLViewport>
-#include <OpenGLRenderBlock>
 
 class OpenGLInstancePrivate
 {
 public:
   bool m_visible;
+  size_t m_levelOfDetail;
   KTransform3D m_currTransform;
   KTransform3D m_prevTransform;
   OpenGLMaterial m_material;
   OpenGLMesh m_mesh;
-  OpenGLUniformBufferObject m_buffer;
 
   OpenGLInstancePrivate();
 };
 
 OpenGLInstancePrivate::OpenGLInstancePrivate() :
-  m_visible(true)
+  m_visible(true), m_levelOfDetail(0)
 {
   // Intentionally Empty
 }
@@ -32,11 +29,7 @@ OpenGLInstancePrivate::OpenGLInstancePrivate() :
 OpenGLInstance::OpenGLInstance() :
   m_private(new OpenGLInstancePrivate)
 {
-  P(OpenGLInstancePrivate);
-  p.m_buffer.create();
-  p.m_buffer.bind();
-  p.m_buffer.allocate(sizeof(OpenGLInstanceData));
-  p.m_buffer.release();
+  // Intentionally Empty
 }
 
 OpenGLInstance::~OpenGLInstance()
@@ -44,35 +37,6 @@ OpenGLInstance::~OpenGLInstance()
   delete m_private;
 }
 
-void OpenGLInstance::bind()
-{
-  P(OpenGLInstancePrivate);
-  p.m_buffer.bindBase(K_OBJECT_BINDING);
-}
-
-void OpenGLInstance::commit(const OpenGLViewport &viewport)
-{
-  P(OpenGLInstancePrivate);
-  OpenGLBuffer::RangeAccessFlags flags =
-    OpenGLBuffer::RangeUnsynchronized   |
-    OpenGLBuffer::RangeInvalidateBuffer |
-    OpenGLBuffer::RangeWrite;
-
-  p.m_buffer.bind();
-
-  // Send data to the GPU
-  {
-    OpenGLInstanceData *data = (OpenGLInstanceData*)p.m_buffer.mapRange(0, sizeof(OpenGLInstanceData), flags);
-    data->m_currModelView = viewport.current().worldToView()  * Karma::ToGlm(currentTransform().toMatrix() );
-    data->m_prevModelView = viewport.previous().worldToView() * Karma::ToGlm(previousTransform().toMatrix());
-    data->m_normalTransform = glm::transpose(glm::inverse(data->m_currModelView));
-    p.m_buffer.unmap();
-  }
-
-  update(); // Updates current/previous pairs
-  p.m_buffer.release();
-}
-
 void OpenGLInstance::release()
 {
   OpenGLUniformBufferObject::bindBufferId(K_OBJECT_BINDING, 0);
@@ -155,3 +119,15 @@ bool OpenGLInstance::visible() const
   P(const OpenGLInstancePrivate);
   return p.m_visible;
 }
+
+void OpenGLInstance::setLevelOfDetail(size_t level)
+{
+  P(OpenGLInstancePrivate);
+  p.m_levelOfDetail = level;
+}
+
+size_t OpenGLInstance::levelOfDetail() const
+{
+  P(const OpenGLInstancePrivate);
+  return p.m_levelOfDetail;
+}
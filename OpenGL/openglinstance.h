@@ -7,7 +7,6 @@ class KHalfEdgeMesh;
 class OpenGLMesh;
 #include <string>
 #include <KAabbBoundingVolume>
-class OpenGLViewport;
 
 class OpenGLInstancePrivate;
 class OpenGLInstance
@@ -16,9 +15,7 @@ public:
   OpenGLInstance();
   ~OpenGLInstance();
 
-  // OpenGL
-  void bind();
-  void commit(OpenGLViewport const &viewport);
+  // OpenGL (Instance data is bound by OpenGLInstanceManager)
   void release();
 
   KTransform3D &transform();
@@ -34,6 +31,8 @@ public:
   KAabbBoundingVolume aabb() const;
   void setVisible(bool v);
   bool visible() const;
+  void setLevelOfDetail(size_t level);
+  size_t levelOfDetail() const;
 private:
   OpenGLInstancePrivate *m_private;
 };
@@ -9,6 +9,7 @@ public:
   glm::mat4 m_currModelView;
   glm::mat4 m_prevModelView;
   glm::mat4 m_normalTransform;
+  glm::uvec4 m_meshFlags;   // x: Octahedral normals
 };
 
 #endif // OPENGLINSTANCEDATA_H
@@ -1,6 +1,7 @@
 #include "openglinstancemanager.h"
 
 #include <vector>
+#include <unordered_set>
 #include <KMacros>
 #include <OpenGLMeshManager>
 #include <OpenGLInstance>
@@ -11,21 +12,21 @@
 #include <OpenGLViewport>
 #include <OpenGLRenderBlock>
 #include <OpenGLMaterial>
-
-struct OpenGLInstancePartitionWithinView : public std::unary_function<bool, OpenGLInstance*>
-{
-  OpenGLInstancePartitionWithinView(const OpenGLViewport &view) :
-    m_frustum(view.frustum())
-  {
-    // Intentionally Empty
-  }
-  inline bool operator()(OpenGLInstance *instance) const
-  {
-    return m_frustum.intersects(instance->aabb());
-  }
-private:
-  KFrustum m_frustum;
-};
+#include <KCamera3D>
+#include <KTransform3D>
+#include <KSize>
+#include <KAabbArray>
+#include <KFlatTree>
+#include <KOcclusionBuffer>
+#include <KParallel>
+#include <KSweepAndPrune>
+#include <KTransformArray>
+#include <KMath>
+#include <OpenGLBindings>
+#include <OpenGLInstanceData>
+#include <OpenGLDynamicUniformBufferObject>
+#include <cmath>
+#include <cstddef>
 
 struct OpenGLInstanceSortByMeshMaterial : public std::binary_function<bool, OpenGLInstance*, OpenGLInstance*>
 {
@@ -44,35 +45,457 @@ struct OpenGLInstanceSortByMeshMaterial : public std::binary_function<bool, Open
   }
 };
 
+struct OpenGLInstanceSelectLevelOfDetail
+{
+  OpenGLInstanceSelectLevelOfDetail() :
+    m_pixelsPerUnit(0.0f), m_threshold(0.0f)
+  {
+    // Intentionally Empty
+  }
+  OpenGLInstanceSelectLevelOfDetail(const OpenGLViewport &view, float threshold) :
+    m_eye(view.camera().translation())
+  {
+    // Pixels covered by one world unit at a distance of one unit
+    float halfFov = view.camera().fieldOfView() * 0.5f * 3.14159265f / 180.0f;
+    m_pixelsPerUnit = view.size().height() / (2.0f * std::tan(halfFov));
+    m_threshold = threshold;
+  }
+  inline size_t operator()(OpenGLMesh const &mesh, KVector3D const &minExtent, KVector3D const &maxExtent) const
+  {
+    KVector3D size = maxExtent - minExtent;
+    float extent = std::max(size.x(), std::max(size.y(), size.z()));
+    float distance = std::max(((minExtent + maxExtent) * 0.5f - m_eye).length() - size.length() * 0.5f, 1e-3f);
+
+    // Select the coarsest level whose projected error stays below the threshold
+    size_t level = 0;
+    for (size_t i = 1; i < mesh.levelOfDetailCount(); ++i)
+    {
+      float pixels = mesh.levelOfDetailError(i) * extent / distance * m_pixelsPerUnit;
+      if (pixels > m_threshold) break;
+      level = i;
+    }
+    return level;
+  }
+private:
+  KVector3D m_eye;
+  float m_pixelsPerUnit;
+  float m_threshold;
+};
+
+/*******************************************************************************
+ * OpenGLInstanceHierarchy
+ ******************************************************************************/
+static const uint32_t InstanceLeafSize = 4;
+static const size_t InstanceStackSize = 128;
+
+// BVH over the world-space bounds of all instances, in depth-first order (see KFlatNode).
+// The topology is rebuilt whenever instances are added, otherwise bounds are only refit.
+class OpenGLInstanceHierarchy
+{
+public:
+  typedef std::vector<OpenGLInstance*> InstanceContainer;
+  void refit(InstanceContainer const &instances);
+  void cull(KFrustum const &frustum, std::vector<uint32_t> &visible) const;
+  KVector3D minExtent(uint32_t instance) const { return m_bounds.minExtent(instance); }
+  KVector3D maxExtent(uint32_t instance) const { return m_bounds.maxExtent(instance); }
+private:
+  void recursiveBuild(uint32_t begin, uint32_t end);
+  void appendSubtree(uint32_t node, std::vector<uint32_t> &visible) const;
+  std::vector<KFlatNode> m_nodes;
+  std::vector<uint32_t> m_order;
+  KAabbArray m_bounds;
+};
+
+void OpenGLInstanceHierarchy::refit(InstanceContainer const &instances)
+{
+  // Each instance is transformed once, culling only reads the cached bounds
+  m_bounds.resize(instances.size());
+  for (size_t i = 0; i < instances.size(); ++i)
+  {
+    m_bounds.set(i, instances[i]->aabb());
+  }
+
+  if (m_order.size() != instances.size())
+  {
+    m_nodes.clear();
+    m_order.resize(instances.size());
+    for (uint32_t i = 0; i < m_order.size(); ++i) m_order[i] = i;
+    if (!m_order.empty()) recursiveBuild(0, static_cast<uint32_t>(m_order.size()));
+  }
+
+  // Children always follow their parent, so a reverse sweep refits bottom-up
+  for (size_t i = m_nodes.size(); i-- > 0;)
+  {
+    KFlatNode &node = m_nodes[i];
+    KVector3D minExtent(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    KVector3D maxExtent = -minExtent;
+    auto grow = [&minExtent, &maxExtent](KVector3D const &min, KVector3D const &max)
+    {
+      minExtent = KVector3D(std::min(minExtent.x(), min.x()), std::min(minExtent.y(), min.y()), std::min(minExtent.z(), min.z()));
+      maxExtent = KVector3D(std::max(maxExtent.x(), max.x()), std::max(maxExtent.y(), max.y()), std::max(maxExtent.z(), max.z()));
+    };
+    if (node.isLeaf())
+    {
+      for (uint32_t k = node.offset; k != node.offset + node.count; ++k)
+      {
+        grow(m_bounds.minExtent(m_order[k]), m_bounds.maxExtent(m_order[k]));
+      }
+    }
+    else
+    {
+      for (size_t child = i + 1; child < i + node.offset; child += m_nodes[child].subtreeSize())
+      {
+        KFlatNode const &c = m_nodes[child];
+        grow(KVector3D(c.min[0], c.min[1], c.min[2]), KVector3D(c.max[0], c.max[1], c.max[2]));
+      }
+    }
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      node.min[axis] = minExtent[axis];
+      node.max[axis] = maxExtent[axis];
+    }
+  }
+}
+
+void OpenGLInstanceHierarchy::recursiveBuild(uint32_t begin, uint32_t end)
+{
+  size_t index = m_nodes.size();
+  m_nodes.push_back(KFlatNode());
+  if (end - begin <= InstanceLeafSize)
+  {
+    m_nodes[index].offset = begin;
+    m_nodes[index].count = end - begin;
+    return;
+  }
+
+  // Median split along the axis with the largest spread of centers
+  auto center = [this](uint32_t instance) -> KVector3D
+  {
+    return m_bounds.center(instance);
+  };
+  KVector3D minCenter = center(m_order[begin]), maxCenter = minCenter;
+  for (uint32_t i = begin + 1; i < end; ++i)
+  {
+    KVector3D c = center(m_order[i]);
+    minCenter = KVector3D(std::min(minCenter.x(), c.x()), std::min(minCenter.y(), c.y()), std::min(minCenter.z(), c.z()));
+    maxCenter = KVector3D(std::max(maxCenter.x(), c.x()), std::max(maxCenter.y(), c.y()), std::max(maxCenter.z(), c.z()));
+  }
+  KVector3D spread = maxCenter - minCenter;
+  int axis = (spread.x() > spread.y()) ? ((spread.x() > spread.z()) ? 0 : 2) : ((spread.y() > spread.z()) ? 1 : 2);
+  uint32_t middle = begin + (end - begin) / 2;
+  std::nth_element(m_order.begin() + begin, m_order.begin() + middle, m_order.begin() + end, [&center, axis](uint32_t lhs, uint32_t rhs)
+  {
+    return center(lhs)[axis] < center(rhs)[axis];
+  });
+
+  recursiveBuild(begin, middle);
+  recursiveBuild(middle, end);
+  m_nodes[index].offset = static_cast<uint32_t>(m_nodes.size() - index);
+  m_nodes[index].count = 0;
+}
+
+void OpenGLInstanceHierarchy::appendSubtree(uint32_t node, std::vector<uint32_t> &visible) const
+{
+  uint32_t end = node + m_nodes[node].subtreeSize();
+  for (; node < end; ++node)
+  {
+    KFlatNode const &leaf = m_nodes[node];
+    if (!leaf.isLeaf()) continue;
+    visible.insert(visible.end(), m_order.begin() + leaf.offset, m_order.begin() + leaf.offset + leaf.count);
+  }
+}
+
+void OpenGLInstanceHierarchy::cull(KFrustum const &frustum, std::vector<uint32_t> &visible) const
+{
+  struct Entry
+  {
+    uint32_t node;
+    int planeMask;
+  };
+
+  visible.clear();
+  if (m_nodes.empty()) return;
+  size_t top = 0;
+  Entry stack[InstanceStackSize];
+  stack[top++] = { 0, KFrustum::AllPlanes };
+  while (top > 0)
+  {
+    Entry entry = stack[--top];
+    KFlatNode const &node = m_nodes[entry.node];
+    KVector3D minExtent(node.min[0], node.min[1], node.min[2]);
+    KVector3D maxExtent(node.max[0], node.max[1], node.max[2]);
+    if (!frustum.intersects(minExtent, maxExtent, &entry.planeMask)) continue;
+
+    // Subtrees entirely within the frustum skip all further plane tests
+    if (entry.planeMask == 0)
+    {
+      appendSubtree(entry.node, visible);
+    }
+    else if (node.isLeaf())
+    {
+      for (uint32_t k = node.offset; k != node.offset + node.count; ++k)
+      {
+        int planeMask = entry.planeMask;
+        uint32_t instance = m_order[k];
+        if (frustum.intersects(m_bounds.minExtent(instance), m_bounds.maxExtent(instance), &planeMask)) visible.push_back(instance);
+      }
+    }
+    else
+    {
+      for (uint32_t child = entry.node + 1; child < entry.node + node.offset && top < InstanceStackSize; child += m_nodes[child].subtreeSize())
+      {
+        stack[top++] = { child, entry.planeMask };
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+ * OpenGLInstanceManagerPrivate
+ ******************************************************************************/
 class OpenGLInstanceManagerPrivate
 {
 public:
   typedef std::vector<OpenGLInstance*> InstanceContainer;
   typedef InstanceContainer::iterator InstanceIterator;
+  OpenGLInstanceManagerPrivate();
   InstanceContainer m_instances;
+  InstanceContainer m_visible;
   InstanceIterator m_begin, m_end;
+  OpenGLInstanceHierarchy m_hierarchy;
+  std::vector<uint32_t> m_visibleIndices;
+  KTransformArray m_currTransforms;
+  KTransformArray m_prevTransforms;
+  mutable OpenGLDynamicUniformBufferObject<OpenGLInstanceData> m_instanceData;  // Bound by range while rendering
+  std::unordered_set<int> m_committedMaterials;
+  std::vector<size_t> m_committedFrame;   // Frame each instance was last committed in
+  std::vector<uint32_t> m_slots;          // Uniform buffer slot of each instance this frame
+  std::vector<uint32_t> m_pendingIndices; // Instances outside the view, committed on first use
+  bool m_pendingCommitted;
+  size_t m_frame;
+  KMatrix4x4 m_currWorldToView;
+  KMatrix4x4 m_prevWorldToView;
+  OpenGLInstanceSelectLevelOfDetail m_selectLevel;
+  KFrustum m_frustum;
+  KVector3D m_eye;
+  KOcclusionBuffer m_occlusion;
+  std::vector<char> m_occluded;
+  KSweepAndPrune m_broadphase;
+  std::vector<KSweepAndPrune::Handle> m_broadphaseHandles;
+  bool m_occlusionCulling;
+  float m_lodThreshold;
+  size_t m_triangleCount;
+  size_t m_culledCount;
+  size_t m_occludedCount;
+  void create();
   void commit(const OpenGLViewport &view);
+  void commitInstances(std::vector<uint32_t> const &indices, uint32_t firstSlot, OpenGLBuffer::RangeAccessFlags flags);
+  void commitPending();
+  void bindInstance(uint32_t index) const;
+  void cullOccluded(const OpenGLViewport &view);
+  void updateBroadphase();
   void render() const;
-  void renderAll() const;
+  void renderAll();
+  void renderAllDepthOnly();
 };
 
+OpenGLInstanceManagerPrivate::OpenGLInstanceManagerPrivate() :
+  m_pendingCommitted(true), m_frame(1),
+  m_occlusionCulling(true), m_lodThreshold(1.0f), m_triangleCount(0), m_culledCount(0), m_occludedCount(0)
+{
+  // Intentionally Empty
+}
+
+void OpenGLInstanceManagerPrivate::create()
+{
+  m_instanceData.create();
+}
+
 void OpenGLInstanceManagerPrivate::commit(const OpenGLViewport &view)
 {
-  m_begin = m_instances.begin();
-  m_end = m_instances.end();
-  //m_end = std::partition(m_begin, m_end, OpenGLInstancePartitionWithinView(view));
-  std::sort(m_begin, m_end, OpenGLInstanceSortByMeshMaterial());
+  // Only instances within the view are sorted and drawn
+  m_frustum = view.frustum();
+  m_hierarchy.refit(m_instances);
+  updateBroadphase();
+  m_hierarchy.cull(m_frustum, m_visibleIndices);
+  cullOccluded(view);
+  OpenGLInstanceSortByMeshMaterial byMeshMaterial;
+  std::sort(m_visibleIndices.begin(), m_visibleIndices.end(), [this, &byMeshMaterial](uint32_t lhs, uint32_t rhs)
+  {
+    return byMeshMaterial(m_instances[lhs], m_instances[rhs]);
+  });
+  m_visible.clear();
+  for (uint32_t index : m_visibleIndices)
+  {
+    m_visible.push_back(m_instances[index]);
+  }
+  m_culledCount = m_instances.size() - m_visible.size();
+  m_begin = m_visible.begin();
+  m_end = m_visible.end();
 
-  InstanceIterator it = m_begin;
-  while (it != m_end)
+  // Only the visible set is committed here, instances outside the view take the slots
+  // after it once a pass which draws everything (eg. shadows) needs them.
+  ++m_frame;
+  m_currWorldToView = KMatrix4x4(glm::value_ptr(view.current().worldToView())).transposed();
+  m_prevWorldToView = KMatrix4x4(glm::value_ptr(view.previous().worldToView())).transposed();
+  m_selectLevel = OpenGLInstanceSelectLevelOfDetail(view, m_lodThreshold);
+  m_committedFrame.resize(m_instances.size(), 0);
+  m_slots.resize(m_instances.size());
+  m_committedMaterials.clear();
+  m_instanceData.bind();
+  m_instanceData.reserve(static_cast<int>(m_instances.size()));
+  m_instanceData.release();
+  OpenGLBuffer::RangeAccessFlags flags =
+    OpenGLBuffer::RangeUnsynchronized   |
+    OpenGLBuffer::RangeInvalidateBuffer |
+    OpenGLBuffer::RangeWrite;
+  commitInstances(m_visibleIndices, 0, flags);
+  m_pendingCommitted = (m_visibleIndices.size() == m_instances.size());
+
+  m_eye = view.camera().translation();
+  m_triangleCount = 0;
+  for (OpenGLInstance *instance : m_visible)
   {
-    OpenGLInstance *instance = *it;
-    instance->commit(view);
-    instance->material().commit();
-    ++it;
+    if (instance->visible()) m_triangleCount += instance->mesh().triangleCount(instance->levelOfDetail());
   }
 }
 
+// Writes the given instances into consecutive uniform buffer slots, starting at `firstSlot`.
+// Instances which skipped the last frame have no valid previous transform, so they're
+// committed without motion instead.
+void OpenGLInstanceManagerPrivate::commitInstances(std::vector<uint32_t> const &indices, uint32_t firstSlot, OpenGLBuffer::RangeAccessFlags flags)
+{
+  size_t count = indices.size();
+  if (count == 0) return;
+
+  // Quantized positions are decoded by folding the dequantization into the model matrix.
+  m_currTransforms.resize(count);
+  m_prevTransforms.resize(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    uint32_t index = indices[i];
+    OpenGLInstance *instance = m_instances[index];
+    if (m_committedFrame[index] + 1 != m_frame) instance->update();
+    m_committedFrame[index] = m_frame;
+    m_slots[index] = firstSlot + static_cast<uint32_t>(i);
+    instance->setLevelOfDetail(m_selectLevel(instance->mesh(), m_hierarchy.minExtent(index), m_hierarchy.maxExtent(index)));
+    if (m_committedMaterials.insert(instance->material().objectId()).second) instance->material().commit();
+    KMatrix4x4 const &dequantization = instance->mesh().dequantization();
+    m_currTransforms.set(i, instance->currentTransform(), dequantization);
+    m_prevTransforms.set(i, instance->previousTransform(), dequantization);
+  }
+
+  // Send data to the GPU
+  m_instanceData.bind();
+  {
+    size_t skip = static_cast<size_t>(m_instanceData.skipSize());
+    char *data = static_cast<char*>(m_instanceData.mapRange(skip * firstSlot, skip * count, flags));
+    m_currTransforms.toMatrices(m_currWorldToView, data + offsetof(OpenGLInstanceData, m_currModelView), data + offsetof(OpenGLInstanceData, m_normalTransform), skip);
+    m_prevTransforms.toMatrices(m_prevWorldToView, data + offsetof(OpenGLInstanceData, m_prevModelView), skip);
+    for (size_t i = 0; i < count; ++i)
+    {
+      OpenGLInstanceData *instanceData = reinterpret_cast<OpenGLInstanceData*>(data + skip * i);
+      bool quantized = (m_instances[indices[i]]->mesh().vertexFormat() == OpenGLMesh::QuantizedVertexFormat);
+      instanceData->m_meshFlags = glm::uvec4(quantized ? 1u : 0u, 0u, 0u, 0u);
+    }
+    m_instanceData.unmap();
+  }
+  m_instanceData.release();
+
+  // Written transforms become the previous ones of the next frame
+  for (uint32_t index : indices)
+  {
+    m_instances[index]->update();
+  }
+}
+
+// Commits the instances outside the view once per frame, for passes which draw everything.
+// Their slots follow the visible ones, which this frame's draws may already read, so the
+// rest of the buffer is left untouched.
+void OpenGLInstanceManagerPrivate::commitPending()
+{
+  if (m_pendingCommitted) return;
+  m_pendingCommitted = true;
+  m_pendingIndices.clear();
+  for (uint32_t index = 0; index < m_instances.size(); ++index)
+  {
+    if (m_committedFrame[index] != m_frame) m_pendingIndices.push_back(index);
+  }
+  OpenGLBuffer::RangeAccessFlags flags =
+    OpenGLBuffer::RangeUnsynchronized |
+    OpenGLBuffer::RangeInvalidate     |
+    OpenGLBuffer::RangeWrite;
+  commitInstances(m_pendingIndices, static_cast<uint32_t>(m_visibleIndices.size()), flags);
+}
+
+void OpenGLInstanceManagerPrivate::bindInstance(uint32_t index) const
+{
+  m_instanceData.bindRange(OpenGLUniformBufferObject::UniformBuffer, K_OBJECT_BINDING, m_instanceData.skipSize() * static_cast<int>(m_slots[index]), static_cast<int>(sizeof(OpenGLInstanceData)));
+}
+
+// Instances are never removed, so handles only grow with the instance list
+void OpenGLInstanceManagerPrivate::updateBroadphase()
+{
+  for (uint32_t i = 0; i < m_instances.size(); ++i)
+  {
+    if (i < m_broadphaseHandles.size())
+    {
+      m_broadphase.update(m_broadphaseHandles[i], m_hierarchy.minExtent(i), m_hierarchy.maxExtent(i));
+    }
+    else
+    {
+      m_broadphaseHandles.push_back(m_broadphase.insert(m_hierarchy.minExtent(i), m_hierarchy.maxExtent(i)));
+    }
+  }
+}
+
+void OpenGLInstanceManagerPrivate::cullOccluded(const OpenGLViewport &view)
+{
+  m_occludedCount = 0;
+  if (!m_occlusionCulling) return;
+
+  // The buffer keeps a fixed width, and follows the aspect ratio of the view
+  int width = KOcclusionBuffer::DefaultWidth;
+  int height = std::max(1, width * view.size().height() / std::max(1, view.size().width()));
+  if (m_occlusion.height() != (height + KOcclusionBuffer::TileSize - 1) / KOcclusionBuffer::TileSize * KOcclusionBuffer::TileSize)
+  {
+    m_occlusion.resize(width, height);
+  }
+
+  // Occluders within the view are rasterized with their coarsest level
+  KCamera3D const &camera = view.camera();
+  m_occlusion.begin(camera.projection() * camera.toMatrix());
+  for (uint32_t index : m_visibleIndices)
+  {
+    OpenGLInstance *instance = m_instances[index];
+    OpenGLMesh const &mesh = instance->mesh();
+    if (!instance->visible() || !mesh.isOccluder()) continue;
+    m_occlusion.addOccluder(mesh.occluderPositions().data(), mesh.occluderPositions().size(), mesh.occluderIndices().data(), mesh.occluderIndices().size(), instance->currentTransform().toMatrix());
+  }
+  if (m_occlusion.triangleCount() == 0) return;
+  m_occlusion.rasterize();
+
+  // Occluders are tested as well, a box is only hidden by pixels strictly nearer than
+  // all of its corners, which its own surface never is.
+  m_occluded.assign(m_visibleIndices.size(), 0);
+  Karma::parallelFor(m_visibleIndices.size(), [this](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      uint32_t index = m_visibleIndices[i];
+      m_occluded[i] = !m_occlusion.visible(m_hierarchy.minExtent(index), m_hierarchy.maxExtent(index));
+    }
+  }, 1024);
+
+  size_t last = 0;
+  for (size_t i = 0; i < m_visibleIndices.size(); ++i)
+  {
+    if (!m_occluded[i]) m_visibleIndices[last++] = m_visibleIndices[i];
+  }
+  m_occludedCount = m_visibleIndices.size() - last;
+  m_visibleIndices.resize(last);
+}
+
 void OpenGLInstanceManagerPrivate::render() const
 {
   OpenGLInstance *instance;
@@ -94,19 +517,30 @@ void OpenGLInstanceManagerPrivate::render() const
         instance->material().bind();
         currMat = instance->material().objectId();
       }
-      instance->bind();
-      instance->mesh().draw();
+      bindInstance(m_visibleIndices[begin - m_visible.begin()]);
+
+      // Only the full detail level is clustered, coarser levels are cheap enough as-is.
+      if (instance->levelOfDetail() == 0 && instance->mesh().clusterCount() > 0)
+      {
+        instance->mesh().drawClusters(instance->currentTransform().toMatrix(), m_frustum, m_eye);
+      }
+      else
+      {
+        instance->mesh().draw(instance->levelOfDetail());
+      }
     }
     ++begin;
   }
 }
 
-void OpenGLInstanceManagerPrivate::renderAll() const
+void OpenGLInstanceManagerPrivate::renderAll()
 {
+  commitPending();
   int currMat  = 0;
   int currMesh = 0;
-  for (OpenGLInstance *instance : m_instances)
+  for (uint32_t index = 0; index < m_instances.size(); ++index)
   {
+    OpenGLInstance *instance = m_instances[index];
     if (instance->visible())
     {
       if (currMesh != instance->mesh().objectId())
@@ -119,8 +553,23 @@ void OpenGLInstanceManagerPrivate::renderAll() const
         instance->material().bind();
         currMat = instance->material().objectId();
       }
-      instance->bind();
-      instance->mesh().draw();
+      bindInstance(index);
+      instance->mesh().draw(instance->levelOfDetail());
+    }
+  }
+}
+
+void OpenGLInstanceManagerPrivate::renderAllDepthOnly()
+{
+  commitPending();
+  // Materials don't affect depth, only the object transforms are bound.
+  for (uint32_t index = 0; index < m_instances.size(); ++index)
+  {
+    OpenGLInstance *instance = m_instances[index];
+    if (instance->visible())
+    {
+      bindInstance(index);
+      instance->mesh().drawDepthOnly(instance->levelOfDetail());
     }
   }
 }
@@ -138,7 +587,8 @@ OpenGLInstanceManager::~OpenGLInstanceManager()
 
 void OpenGLInstanceManager::create()
 {
-  // Do nothing
+  P(OpenGLInstanceManagerPrivate);
+  p.create();
 }
 
 void OpenGLInstanceManager::commit(const OpenGLViewport &view)
@@ -153,12 +603,18 @@ void OpenGLInstanceManager::render() const
   p.render();
 }
 
-void OpenGLInstanceManager::renderAll() const
+void OpenGLInstanceManager::renderAll()
 {
-  P(const OpenGLInstanceManagerPrivate);
+  P(OpenGLInstanceManagerPrivate);
   p.renderAll();
 }
 
+void OpenGLInstanceManager::renderAllDepthOnly()
+{
+  P(OpenGLInstanceManagerPrivate);
+  p.renderAllDepthOnly();
+}
+
 OpenGLInstance *OpenGLInstanceManager::createInstance()
 {
   P(OpenGLInstanceManagerPrivate);
@@ -167,3 +623,60 @@ OpenGLInstance *OpenGLInstanceManager::createInstance()
   return instance;
 }
 
+void OpenGLInstanceManager::setOcclusionCulling(bool enabled)
+{
+  P(OpenGLInstanceManagerPrivate);
+  p.m_occlusionCulling = enabled;
+}
+
+void OpenGLInstanceManager::setLevelOfDetailThreshold(float pixels)
+{
+  P(OpenGLInstanceManagerPrivate);
+  p.m_lodThreshold = pixels;
+}
+
+size_t OpenGLInstanceManager::triangleCount() const
+{
+  P(const OpenGLInstanceManagerPrivate);
+  return p.m_triangleCount;
+}
+
+size_t OpenGLInstanceManager::visibleCount() const
+{
+  P(const OpenGLInstanceManagerPrivate);
+  return p.m_visible.size();
+}
+
+size_t OpenGLInstanceManager::culledCount() const
+{
+  P(const OpenGLInstanceManagerPrivate);
+  return p.m_culledCount;
+}
+
+size_t OpenGLInstanceManager::occludedCount() const
+{
+  P(const OpenGLInstanceManagerPrivate);
+  return p.m_occludedCount;
+}
+
+void OpenGLInstanceManager::overlapping(const KVector3D &minExtent, const KVector3D &maxExtent, std::vector<OpenGLInstance*> &results) const
+{
+  P(const OpenGLInstanceManagerPrivate);
+  std::vector<KSweepAndPrune::Handle> handles;
+  p.m_broadphase.query(minExtent, maxExtent, handles);
+  for (KSweepAndPrune::Handle handle : handles)
+  {
+    results.push_back(p.m_instances[handle]);
+  }
+}
+
+void OpenGLInstanceManager::overlappingPairs(std::vector<InstancePair> &results) const
+{
+  P(const OpenGLInstanceManagerPrivate);
+  std::vector<KSweepAndPrune::HandlePair> pairs;
+  p.m_broadphase.pairs(pairs);
+  for (KSweepAndPrune::HandlePair const &pair : pairs)
+  {
+    results.emplace_back(p.m_instances[pair.first], p.m_instances[pair.second]);
+  }
+}
@@ -1,6 +1,10 @@
 #ifndef OPENGLINSTANCEMANAGER_H
 #define OPENGLINSTANCEMANAGER_H OpenGLInstanceManager
 
+#include <cstddef>
+#include <utility>
+#include <vector>
+class KVector3D;
 class OpenGLInstance;
 class OpenGLViewport;
 #include <KUniquePointer>
@@ -9,13 +13,25 @@ class OpenGLInstanceManagerPrivate;
 class OpenGLInstanceManager
 {
 public:
+  typedef std::pair<OpenGLInstance*, OpenGLInstance*> InstancePair;
   OpenGLInstanceManager();
   ~OpenGLInstanceManager();
   void create();
   void commit(const OpenGLViewport &view);
   void render() const;
-  void renderAll() const;
+  void renderAll();           // Commits instances outside the view on first use each frame
+  void renderAllDepthOnly();
   OpenGLInstance *createInstance();
+  void setLevelOfDetailThreshold(float pixels);
+  void setOcclusionCulling(bool enabled); // Hides instances behind meshes marked as occluders
+  size_t triangleCount() const;
+  size_t visibleCount() const;
+  size_t culledCount() const;   // Outside the view or occluded
+  size_t occludedCount() const; // Within the view, but behind occluders
+
+  // Overlap Queries (World bounds as of the last commit, results are appended)
+  void overlapping(const KVector3D &minExtent, const KVector3D &maxExtent, std::vector<OpenGLInstance*> &results) const;
+  void overlappingPairs(std::vector<InstancePair> &results) const;
 private:
   KUniquePointer<OpenGLInstanceManagerPrivate> m_private;
 };
@@ -215,7 +215,7 @@ void OpenGLLightGroup<T, D>::drawShadowed(OpenGLScene &scene)
       GL::glClearColor(std::numeric_limits<float>::infinity(), 1.0, 1.0f, 1.0f);
       GL::glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
       GL::glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-      scene.renderAllGeometry();
+      scene.renderAllGeometryDepthOnly();
       m_shadowMappingLight->release();
     GL::popViewport();
     GL::glEnable(GL_CULL_FACE);
@@ -1,5 +1,12 @@
 #include "openglmesh.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <vector>
+
 #include <KVertex>
 #include <KMacros>
 #include <KHalfEdgeMesh>
@@ -7,47 +14,241 @@
 #include <OpenGLFunctions>
 #include <OpenGLVertexArrayObject>
 #include <KAabbBoundingVolume>
+#include <KMeshOptimizer>
+#include <KMeshlet>
+#include <KFrustum>
+#include <KMatrix4x4>
+
+// Compressed vertex, positions are relative to the mesh bounds (see dequantization).
+struct OpenGLQuantizedVertex
+{
+  uint16_t position[3];
+  int16_t normal[2];
+};
+static_assert(sizeof(OpenGLQuantizedVertex) == 10, "Quantized vertices are expected to be tightly packed!");
+
+// Position of a quantized vertex for depth-only passes, padded to keep fetches 4-byte aligned.
+struct OpenGLQuantizedPosition
+{
+  uint16_t position[4];
+};
+
+inline uint16_t quantizeUnorm16(float v)
+{
+  return static_cast<uint16_t>(std::floor(std::min(1.0f, std::max(0.0f, v)) * 65535.0f + 0.5f));
+}
+
+inline int16_t quantizeSnorm16(float v)
+{
+  return static_cast<int16_t>(std::floor(std::min(1.0f, std::max(-1.0f, v)) * 32767.0f + (v >= 0.0f ? 0.5f : -0.5f)));
+}
+
+// Octahedral normal encoding, decoded by decodeOctahedralNormal() (EncodeDecode.glsl)
+inline void encodeOctahedral(KVector3D const &n, int16_t *dest)
+{
+  float sum = std::abs(n.x()) + std::abs(n.y()) + std::abs(n.z());
+  float x = (sum > 0.0f) ? n.x() / sum : 0.0f;
+  float y = (sum > 0.0f) ? n.y() / sum : 0.0f;
+  if (n.z() < 0.0f)
+  {
+    float ox = x;
+    x = (1.0f - std::abs(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+    y = (1.0f - std::abs(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+  }
+  dest[0] = quantizeSnorm16(x);
+  dest[1] = quantizeSnorm16(y);
+}
+
+struct OpenGLMeshLevel
+{
+  size_t offset;
+  GLsizei count;
+  float error;
+};
+
+#if defined(QT_OPENGL_ES_3)
+// Per-instance attribute, ES 3.0 has no base instance so these are re-pointed to offset instances.
+struct OpenGLInstancedAttribute
+{
+  GLuint buffer;
+  int location;
+  int elements;
+  OpenGLElementType type;
+  bool normalized;
+  int stride;
+  int offset;
+};
+#endif
+
+// Element range [begin, end) of a buffer (or of the source mesh) that needs uploading.
+struct OpenGLMeshRange
+{
+  size_t begin;
+  size_t end;
+};
+typedef std::vector<OpenGLMeshRange> OpenGLMeshRanges;
+
+// Ranges closer than this are uploaded together, trading a few bytes for fewer calls.
+static const size_t OpenGLMeshRangeGap = 32;
+
+static void coalesceRanges(OpenGLMeshRanges &ranges, size_t gap)
+{
+  if (ranges.empty()) return;
+  std::sort(ranges.begin(), ranges.end(), [](OpenGLMeshRange const &a, OpenGLMeshRange const &b) { return a.begin < b.begin; });
+  size_t last = 0;
+  for (size_t i = 1; i < ranges.size(); ++i)
+  {
+    if (ranges[i].begin <= ranges[last].end + gap)
+      ranges[last].end = std::max(ranges[last].end, ranges[i].end);
+    else
+      ranges[++last] = ranges[i];
+  }
+  ranges.resize(last + 1);
+}
 
 class OpenGLMeshPrivate
 {
 public:
+  typedef std::vector<uint32_t> IndexContainer;
   OpenGLMeshPrivate();
-  void create(const KHalfEdgeMesh &mesh);
+  void create(const KHalfEdgeMesh &mesh, OpenGLMesh::VertexFormat format);
+  void calculateBounds(const KHalfEdgeMesh &mesh);
+  void writeVertices(const KHalfEdgeMesh &mesh);
+  void writeVertex(char *dest, size_t slot, KHalfEdgeMesh::Vertex const &vertex);
+  void writeIndices(void *dest, IndexContainer const &indices);
+  void setVertexAttributes();
+  void writePositions(const KHalfEdgeMesh &mesh);
+  void update(const KHalfEdgeMesh &mesh);
+  void upload(OpenGLBuffer &buffer, OpenGLMeshRanges &pending, std::vector<char> const &shadow, size_t elementSize);
+  size_t vertexSize() const;
+  void buildLevels(IndexContainer &indices, const KHalfEdgeMesh &mesh);
+  void captureOccluder(IndexContainer const &indices, const KHalfEdgeMesh &mesh);
+  void optimize(IndexContainer &indices, const KHalfEdgeMesh &mesh);
+  void draw(size_t level);
+  const GLvoid *indexOffset(size_t index) const;
+  size_t drawClusters(const KMatrix4x4 &toWorld, const KFrustum &frustum, const KVector3D &eye);
   void vertexAttribPointer(int location, int elements, OpenGLElementType type, bool normalized, int stride, int offset);
   void vertexAttribPointer(int location, int elements, int count, OpenGLElementType type, bool normalized, int stride, int offset);
   void vertexAttribPointerDivisor(int location, int elements, OpenGLElementType type, bool normalized, int stride, int offset, int divisor);
   void vertexAttribPointerDivisor(int location, int elements, int count, OpenGLElementType type, bool normalized, int stride, int offset, int divisor);
+#if defined(QT_OPENGL_ES_3)
+  void rebaseInstances(size_t first);
+  std::vector<OpenGLInstancedAttribute> m_instancedAttributes;
+#endif
   GLsizei m_elementCount;
   OpenGLBuffer m_indexBuffer;
   OpenGLBuffer m_vertexBuffer;
   OpenGLVertexArrayObject m_vertexArrayObject;
+  OpenGLBuffer m_positionBuffer;
+  OpenGLVertexArrayObject m_positionArrayObject;
+  bool m_positionStream;
+  bool m_hasPositionStream;
+  bool m_occluder;
+  std::vector<KVector3D> m_occluderPositions;
+  std::vector<uint32_t> m_occluderIndices;
   KAabbBoundingVolume m_aabb;
+  KMatrix4x4 m_dequantization;
+  OpenGLElementType m_indexType;
+  OpenGLMesh::VertexFormat m_vertexFormat;
+  OpenGLMesh::OptimizationFlags m_optimizations;
+  KVertexCacheStatistics m_originalStatistics;
+  KVertexCacheStatistics m_optimizedStatistics;
+  std::vector<float> m_levelErrors;
+  std::vector<OpenGLMeshLevel> m_levels;
+  std::vector<KMeshlet> m_meshlets;
+  std::vector<GLsizei> m_drawCounts;
+  std::vector<const GLvoid*> m_drawOffsets;
+
+  // Dynamic meshes keep a CPU copy of both buffers, and draw from one half of each
+  // buffer while the other is updated. Every half tracks the ranges it's missing.
+  bool m_dynamic;
+  size_t m_frame;
+  std::vector<uint32_t> m_remap;
+  std::vector<char> m_vertexShadow;
+  std::vector<char> m_indexShadow;
+  OpenGLMeshRanges m_dirtyVertices;
+  OpenGLMeshRanges m_dirtyFaces;
+  OpenGLMeshRanges m_pendingVertices[2];
+  OpenGLMeshRanges m_pendingIndices[2];
 };
 
 OpenGLMeshPrivate::OpenGLMeshPrivate() :
-  m_indexBuffer(OpenGLBuffer::IndexBuffer), m_vertexBuffer(OpenGLBuffer::VertexBuffer)
+  m_indexBuffer(OpenGLBuffer::IndexBuffer), m_vertexBuffer(OpenGLBuffer::VertexBuffer), m_positionBuffer(OpenGLBuffer::VertexBuffer), m_positionStream(false), m_hasPositionStream(false), m_occluder(false),
+  m_indexType(OpenGLElementType::UnsignedInteger), m_vertexFormat(OpenGLMesh::FloatVertexFormat), m_optimizations(OpenGLMesh::OptimizeAll), m_levelErrors({ 0.0025f, 0.01f, 0.04f }),
+  m_dynamic(false), m_frame(0)
 {
   // Intentionally Empty
 }
 
-void OpenGLMeshPrivate::create(const KHalfEdgeMesh &mesh)
+void OpenGLMeshPrivate::create(const KHalfEdgeMesh &mesh, OpenGLMesh::VertexFormat format)
 {
 
   // Helpers
-  m_aabb = KAabbBoundingVolume(mesh.aabb());
   KHalfEdgeMesh::FaceContainer const &faces = mesh.faces();
   KHalfEdgeMesh::VertexContainer const &vertices = mesh.vertices();
-  size_t verticesSize = sizeof(KVertex) * vertices.size();
   size_t indicesCount = faces.size() * 3;
-  size_t indicesSize  = sizeof(uint32_t) * indicesCount;
   OpenGLBuffer::RangeAccessFlags flags =
       OpenGLBuffer::RangeInvalidate
     | OpenGLBuffer::RangeUnsynchronized
     | OpenGLBuffer::RangeWrite;
 
+  // Iterators
+  uint32_t *baseIndDest;
+  const KHalfEdgeMesh::HalfEdge *halfEdge;
+  IndexContainer indices(indicesCount);
+  std::vector<uint32_t> &remap = m_remap;
+  remap.clear();
+  m_vertexFormat = format;
+  m_dynamic = (m_vertexBuffer.usagePattern() == OpenGLBuffer::DynamicDraw || m_vertexBuffer.usagePattern() == OpenGLBuffer::StreamDraw);
+  m_frame = 0;
+
+  // Construct Indices
+  for (size_t i = 0; i < faces.size(); ++i)
+  {
+    baseIndDest = &indices[3 * i];
+    halfEdge = mesh.halfEdge(faces[i].first);
+    baseIndDest[0] = halfEdge->to - 1;
+    halfEdge = mesh.halfEdge(halfEdge->next);
+    baseIndDest[1] = halfEdge->to - 1;
+    halfEdge = mesh.halfEdge(halfEdge->next);
+    baseIndDest[2] = halfEdge->to - 1;
+  }
+
+  // Levels of detail share the vertex buffer, so fetch order is decided once all are known.
+  // Dynamic meshes keep faces in order (and skip derived data that would go stale on edits).
+  m_originalStatistics = Karma::analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+  if (m_dynamic)
+  {
+    OpenGLMeshLevel level = { 0, static_cast<GLsizei>(indices.size()), 0.0f };
+    m_levels.assign(1, level);
+    m_meshlets.clear();
+  }
+  else
+  {
+    buildLevels(indices, mesh);
+    captureOccluder(indices, mesh);
+    m_meshlets.clear();
+    if (!vertices.empty())
+    {
+      Karma::buildMeshlets(m_meshlets, indices.data(), m_levels[0].count, &vertices[0].position, sizeof(KHalfEdgeMesh::Vertex), vertices.size());
+    }
+  }
+  if (m_optimizations & OpenGLMesh::OptimizeVertexFetch)
+  {
+    Karma::optimizeVertexFetch(indices.data(), indices.size(), vertices.size(), remap);
+  }
+  m_optimizedStatistics = Karma::analyzeVertexCache(indices.data(), m_levels[0].count, vertices.size());
+
+  // Small meshes can address all of their vertices with 16-bit indices
+  m_indexType = (vertices.size() <= 65536) ? OpenGLElementType::UnsignedShort : OpenGLElementType::UnsignedInteger;
+  size_t indicesSize  = OpenGLElementSize(m_indexType) * indices.size();
+
   // Create Buffers
-  m_elementCount = static_cast<GLsizei>(indicesCount);
+  m_elementCount = m_levels[0].count;
   m_vertexArrayObject.create();
+#if defined(QT_OPENGL_ES_3)
+  m_instancedAttributes.clear();
+#endif
   m_vertexBuffer.create();
   m_indexBuffer.create();
 
@@ -57,39 +258,428 @@ void OpenGLMeshPrivate::create(const KHalfEdgeMesh &mesh)
   m_indexBuffer.bind();
 
   // Allocate Mesh
-  m_vertexBuffer.allocate(verticesSize);
-  m_indexBuffer.allocate(indicesSize);
-  KVertex *vertDest = (KVertex*)m_vertexBuffer.mapRange(0, verticesSize, flags);
-  uint32_t *indDest = (uint32_t*)m_indexBuffer.mapRange(0, indicesSize, flags);
-
-  // Iterators
-  uint32_t *baseIndDest;
-  const KHalfEdgeMesh::HalfEdge *halfEdge;
+  size_t halves = m_dynamic ? 2 : 1;
+  m_vertexBuffer.allocate(halves * vertexSize() * vertices.size());
+  m_indexBuffer.allocate(halves * indicesSize);
+  m_vertexShadow.clear();
+  m_indexShadow.clear();
+  for (size_t half = 0; half < 2; ++half)
+  {
+    m_pendingVertices[half].clear();
+    m_pendingIndices[half].clear();
+  }
 
   // Construct Mesh
-  for (size_t i = 0; i < vertices.size(); ++i)
+  if (m_dynamic)
   {
-    vertDest[i] = KVertex(vertices[i].position, vertices[i].normal);
+    m_indexShadow.resize(indicesSize);
+    writeIndices(m_indexShadow.data(), indices);
+    m_indexBuffer.write(0, m_indexShadow.data(), static_cast<int>(indicesSize));
+    m_indexBuffer.write(static_cast<int>(indicesSize), m_indexShadow.data(), static_cast<int>(indicesSize));
   }
-  for (size_t i = 0; i < faces.size(); ++i)
+  else
   {
-    baseIndDest = &indDest[3 * i];
-    halfEdge = mesh.halfEdge(faces[i].first);
-    baseIndDest[0] = halfEdge->to - 1;
-    halfEdge = mesh.halfEdge(halfEdge->next);
-    baseIndDest[1] = halfEdge->to - 1;
-    halfEdge = mesh.halfEdge(halfEdge->next);
-    baseIndDest[2] = halfEdge->to - 1;
+    writeIndices(m_indexBuffer.mapRange(0, indicesSize, flags), indices);
+    m_indexBuffer.unmap();
   }
-
-  // Setup Vertex Pointers
-  vertexAttribPointer(0, KVertex::PositionTupleSize, OpenGLElementType::Float, false, KVertex::stride(), KVertex::positionOffset());
-  vertexAttribPointer(1, KVertex::NormalTupleSize, OpenGLElementType::Float, true, KVertex::stride(), KVertex::normalOffset());
+  if (remap.empty())
+  {
+    remap.resize(vertices.size());
+    std::iota(remap.begin(), remap.end(), 0);
+  }
+  writeVertices(mesh);
 
   // Finalize Construction
-  m_indexBuffer.unmap();
-  m_vertexBuffer.unmap();
   m_vertexArrayObject.release();
+  m_hasPositionStream = (m_positionStream && !m_dynamic);
+  if (m_hasPositionStream)
+  {
+    writePositions(mesh);
+  }
+}
+
+void OpenGLMeshPrivate::writePositions(const KHalfEdgeMesh &mesh)
+{
+  KHalfEdgeMesh::VertexContainer const &vertices = mesh.vertices();
+  OpenGLBuffer::RangeAccessFlags flags =
+      OpenGLBuffer::RangeInvalidate
+    | OpenGLBuffer::RangeUnsynchronized
+    | OpenGLBuffer::RangeWrite;
+
+  // Shares the index buffer, only the vertex fetch differs from the full stream.
+  m_positionArrayObject.create();
+  m_positionBuffer.create();
+  m_positionArrayObject.bind();
+  m_positionBuffer.bind();
+  m_indexBuffer.bind();
+
+  switch (m_vertexFormat)
+  {
+  case OpenGLMesh::FloatVertexFormat:
+  {
+    m_positionBuffer.allocate(sizeof(KVector3D) * vertices.size());
+    KVector3D *dest = static_cast<KVector3D*>(m_positionBuffer.mapRange(0, sizeof(KVector3D) * vertices.size(), flags));
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+      dest[m_remap[i]] = vertices[i].position;
+    }
+    vertexAttribPointer(0, 3, OpenGLElementType::Float, false, sizeof(KVector3D), 0);
+    break;
+  }
+  case OpenGLMesh::QuantizedVertexFormat:
+  {
+    KVector3D extent = m_aabb.maxExtent() - m_aabb.minExtent();
+    m_positionBuffer.allocate(sizeof(OpenGLQuantizedPosition) * vertices.size());
+    OpenGLQuantizedPosition *dest = static_cast<OpenGLQuantizedPosition*>(m_positionBuffer.mapRange(0, sizeof(OpenGLQuantizedPosition) * vertices.size(), flags));
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+      OpenGLQuantizedPosition &quantized = dest[m_remap[i]];
+      KVector3D offset = vertices[i].position - m_aabb.minExtent();
+      quantized.position[0] = quantizeUnorm16(offset.x() / std::max(extent.x(), 1e-20f));
+      quantized.position[1] = quantizeUnorm16(offset.y() / std::max(extent.y(), 1e-20f));
+      quantized.position[2] = quantizeUnorm16(offset.z() / std::max(extent.z(), 1e-20f));
+      quantized.position[3] = 0;
+    }
+    vertexAttribPointer(0, 3, OpenGLElementType::UnsignedShort, true, sizeof(OpenGLQuantizedPosition), 0);
+    break;
+  }
+  }
+
+  m_positionBuffer.unmap();
+  m_positionArrayObject.release();
+}
+
+void OpenGLMeshPrivate::update(const KHalfEdgeMesh &mesh)
+{
+  KHalfEdgeMesh::FaceContainer const &faces = mesh.faces();
+  KHalfEdgeMesh::VertexContainer const &vertices = mesh.vertices();
+
+  // Static meshes, or meshes whose element counts changed, can only be recreated.
+  if (!m_dynamic || vertices.size() != m_remap.size() || 3 * faces.size() != static_cast<size_t>(m_elementCount))
+  {
+    m_dirtyVertices.clear();
+    m_dirtyFaces.clear();
+    create(mesh, m_vertexFormat);
+    return;
+  }
+  coalesceRanges(m_dirtyVertices, 0);
+  coalesceRanges(m_dirtyFaces, 0);
+  if (m_dirtyVertices.empty() && m_dirtyFaces.empty()) return;
+
+  // Float positions grow the bounds, quantized positions are requantized if they leave them.
+  bool requantize = false;
+  for (OpenGLMeshRange const &range : m_dirtyVertices)
+  {
+    for (size_t v = range.begin; v < range.end; ++v)
+    {
+      if (m_vertexFormat == OpenGLMesh::FloatVertexFormat)
+        m_aabb.encompassPoint(vertices[v].position);
+      else if (!m_aabb.contains(vertices[v].position))
+        requantize = true;
+    }
+  }
+  if (requantize)
+  {
+    calculateBounds(mesh);
+    m_dirtyVertices.assign(1, OpenGLMeshRange { 0, vertices.size() });
+  }
+
+  // Update the CPU copies, both halves are now missing these ranges
+  OpenGLMeshRanges ranges;
+  for (OpenGLMeshRange const &range : m_dirtyVertices)
+  {
+    for (size_t v = range.begin; v < range.end; ++v)
+    {
+      writeVertex(m_vertexShadow.data(), m_remap[v], vertices[v]);
+      ranges.push_back(OpenGLMeshRange { m_remap[v], m_remap[v] + size_t(1) });
+    }
+  }
+  coalesceRanges(ranges, 0);
+  for (size_t half = 0; half < 2; ++half)
+  {
+    m_pendingVertices[half].insert(m_pendingVertices[half].end(), ranges.begin(), ranges.end());
+  }
+
+  IndexContainer indices;
+  for (OpenGLMeshRange const &range : m_dirtyFaces)
+  {
+    indices.clear();
+    for (size_t f = range.begin; f < range.end; ++f)
+    {
+      const KHalfEdgeMesh::HalfEdge *halfEdge = mesh.halfEdge(faces[f].first);
+      for (size_t i = 0; i < 3; ++i)
+      {
+        indices.push_back(m_remap[halfEdge->to - 1]);
+        halfEdge = mesh.halfEdge(halfEdge->next);
+      }
+    }
+    writeIndices(&m_indexShadow[3 * range.begin * OpenGLElementSize(m_indexType)], indices);
+    for (size_t half = 0; half < 2; ++half)
+    {
+      m_pendingIndices[half].push_back(OpenGLMeshRange { 3 * range.begin, 3 * range.end });
+    }
+  }
+  m_dirtyVertices.clear();
+  m_dirtyFaces.clear();
+
+  // Switch to the half the last frame didn't use, and bring it up to date
+  m_frame = 1 - m_frame;
+  m_vertexArrayObject.bind();
+  upload(m_vertexBuffer, m_pendingVertices[m_frame], m_vertexShadow, vertexSize());
+  upload(m_indexBuffer, m_pendingIndices[m_frame], m_indexShadow, OpenGLElementSize(m_indexType));
+  setVertexAttributes();
+  m_vertexArrayObject.release();
+}
+
+void OpenGLMeshPrivate::upload(OpenGLBuffer &buffer, OpenGLMeshRanges &pending, std::vector<char> const &shadow, size_t elementSize)
+{
+  size_t base = m_frame * shadow.size();
+  coalesceRanges(pending, OpenGLMeshRangeGap);
+  buffer.bind();
+  for (OpenGLMeshRange const &range : pending)
+  {
+    size_t offset = range.begin * elementSize;
+    size_t size = std::min(range.end * elementSize, shadow.size()) - offset;
+    buffer.write(static_cast<int>(base + offset), &shadow[offset], static_cast<int>(size));
+  }
+  pending.clear();
+}
+
+size_t OpenGLMeshPrivate::vertexSize() const
+{
+  return (m_vertexFormat == OpenGLMesh::QuantizedVertexFormat) ? sizeof(OpenGLQuantizedVertex) : sizeof(KVertex);
+}
+
+void OpenGLMeshPrivate::writeIndices(void *dest, IndexContainer const &indices)
+{
+  if (m_indexType == OpenGLElementType::UnsignedShort)
+    std::copy(indices.begin(), indices.end(), static_cast<uint16_t*>(dest));
+  else
+    std::copy(indices.begin(), indices.end(), static_cast<uint32_t*>(dest));
+}
+
+void OpenGLMeshPrivate::calculateBounds(const KHalfEdgeMesh &mesh)
+{
+  KHalfEdgeMesh::VertexContainer const &vertices = mesh.vertices();
+
+  // Bounds are recalculated, the mesh's aabb isn't updated by normalization.
+  Karma::MinMaxKVector3D bounds(-std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+  for (KHalfEdgeMesh::Vertex const &v : vertices)
+  {
+    bounds.max = KVector3D(std::max(bounds.max.x(), v.position.x()), std::max(bounds.max.y(), v.position.y()), std::max(bounds.max.z(), v.position.z()));
+    bounds.min = KVector3D(std::min(bounds.min.x(), v.position.x()), std::min(bounds.min.y(), v.position.y()), std::min(bounds.min.z(), v.position.z()));
+  }
+  if (vertices.empty()) bounds = Karma::MinMaxKVector3D(0.0f, 0.0f);
+  m_aabb.setMinMaxBounds(bounds);
+  m_dequantization.setToIdentity();
+
+  // Quantized positions are stored as [0,1] within the bounds, the model matrix scales them back.
+  if (m_vertexFormat == OpenGLMesh::QuantizedVertexFormat)
+  {
+    KVector3D extent = bounds.max - bounds.min;
+    KVector3D safeExtent(std::max(extent.x(), 1e-20f), std::max(extent.y(), 1e-20f), std::max(extent.z(), 1e-20f));
+    m_dequantization.translate(bounds.min);
+    m_dequantization.scale(safeExtent);
+  }
+}
+
+void OpenGLMeshPrivate::writeVertices(const KHalfEdgeMesh &mesh)
+{
+  KHalfEdgeMesh::VertexContainer const &vertices = mesh.vertices();
+  size_t verticesSize = vertexSize() * vertices.size();
+  OpenGLBuffer::RangeAccessFlags flags =
+      OpenGLBuffer::RangeInvalidate
+    | OpenGLBuffer::RangeUnsynchronized
+    | OpenGLBuffer::RangeWrite;
+
+  calculateBounds(mesh);
+  if (m_dynamic)
+  {
+    m_vertexShadow.resize(verticesSize);
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+      writeVertex(m_vertexShadow.data(), m_remap[i], vertices[i]);
+    }
+    m_vertexBuffer.write(0, m_vertexShadow.data(), static_cast<int>(verticesSize));
+    m_vertexBuffer.write(static_cast<int>(verticesSize), m_vertexShadow.data(), static_cast<int>(verticesSize));
+  }
+  else
+  {
+    char *vertDest = static_cast<char*>(m_vertexBuffer.mapRange(0, verticesSize, flags));
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+      writeVertex(vertDest, m_remap[i], vertices[i]);
+    }
+    m_vertexBuffer.unmap();
+  }
+  setVertexAttributes();
+}
+
+void OpenGLMeshPrivate::writeVertex(char *dest, size_t slot, const KHalfEdgeMesh::Vertex &vertex)
+{
+  switch (m_vertexFormat)
+  {
+  case OpenGLMesh::FloatVertexFormat:
+    reinterpret_cast<KVertex*>(dest)[slot] = KVertex(vertex.position, vertex.normal);
+    break;
+  case OpenGLMesh::QuantizedVertexFormat:
+  {
+    // Note: Quantized meshes keep their aabb at the quantization bounds.
+    OpenGLQuantizedVertex &quantized = reinterpret_cast<OpenGLQuantizedVertex*>(dest)[slot];
+    KVector3D extent = m_aabb.maxExtent() - m_aabb.minExtent();
+    KVector3D offset = vertex.position - m_aabb.minExtent();
+    quantized.position[0] = quantizeUnorm16(offset.x() / std::max(extent.x(), 1e-20f));
+    quantized.position[1] = quantizeUnorm16(offset.y() / std::max(extent.y(), 1e-20f));
+    quantized.position[2] = quantizeUnorm16(offset.z() / std::max(extent.z(), 1e-20f));
+    encodeOctahedral(vertex.normal.normalized(), quantized.normal);
+    break;
+  }
+  }
+}
+
+void OpenGLMeshPrivate::setVertexAttributes()
+{
+  // Dynamic meshes point at the half of the vertex buffer being drawn
+  int base = static_cast<int>(m_frame * m_vertexShadow.size());
+  switch (m_vertexFormat)
+  {
+  case OpenGLMesh::FloatVertexFormat:
+    vertexAttribPointer(0, KVertex::PositionTupleSize, OpenGLElementType::Float, false, KVertex::stride(), base + KVertex::positionOffset());
+    vertexAttribPointer(1, KVertex::NormalTupleSize, OpenGLElementType::Float, true, KVertex::stride(), base + KVertex::normalOffset());
+    break;
+  case OpenGLMesh::QuantizedVertexFormat:
+    vertexAttribPointer(0, 3, OpenGLElementType::UnsignedShort, true, sizeof(OpenGLQuantizedVertex), base + offsetof(OpenGLQuantizedVertex, position));
+    vertexAttribPointer(1, 2, OpenGLElementType::Short, true, sizeof(OpenGLQuantizedVertex), base + offsetof(OpenGLQuantizedVertex, normal));
+    break;
+  }
+}
+
+void OpenGLMeshPrivate::buildLevels(IndexContainer &indices, const KHalfEdgeMesh &mesh)
+{
+  KHalfEdgeMesh::VertexContainer const &vertices = mesh.vertices();
+  std::vector<IndexContainer> levels(1, indices);
+  std::vector<float> errors(1, 0.0f);
+
+  // Each level is simplified from the last, levels that barely reduce are dropped.
+  for (float target : m_levelErrors)
+  {
+    if (levels.back().empty() || vertices.empty()) break;
+    IndexContainer const &source = levels.back();
+    IndexContainer simplified(source.size());
+    float error;
+    size_t count = Karma::simplify(simplified.data(), source.data(), source.size(), &vertices[0].position, sizeof(KHalfEdgeMesh::Vertex), vertices.size(), 0, target, &error);
+    if (count > source.size() * 9 / 10) continue;
+    simplified.resize(count);
+    levels.push_back(std::move(simplified));
+    errors.push_back(error);
+  }
+
+  // Optimize and pack the levels into one index buffer
+  indices.clear();
+  m_levels.clear();
+  for (size_t i = 0; i < levels.size(); ++i)
+  {
+    optimize(levels[i], mesh);
+    OpenGLMeshLevel level;
+    level.offset = indices.size();
+    level.count = static_cast<GLsizei>(levels[i].size());
+    level.error = errors[i];
+    m_levels.push_back(level);
+    indices.insert(indices.end(), levels[i].begin(), levels[i].end());
+  }
+}
+
+// Occluders rasterize on the CPU, so they keep a compact copy of the coarsest level.
+void OpenGLMeshPrivate::captureOccluder(IndexContainer const &indices, const KHalfEdgeMesh &mesh)
+{
+  KHalfEdgeMesh::VertexContainer const &vertices = mesh.vertices();
+  m_occluderPositions.clear();
+  m_occluderIndices.clear();
+  if (!m_occluder || m_levels.empty()) return;
+
+  OpenGLMeshLevel const &coarsest = m_levels.back();
+  std::vector<uint32_t> compact(vertices.size(), std::numeric_limits<uint32_t>::max());
+  m_occluderIndices.reserve(coarsest.count);
+  for (size_t i = coarsest.offset; i < coarsest.offset + coarsest.count; ++i)
+  {
+    uint32_t &slot = compact[indices[i]];
+    if (slot == std::numeric_limits<uint32_t>::max())
+    {
+      slot = static_cast<uint32_t>(m_occluderPositions.size());
+      m_occluderPositions.push_back(vertices[indices[i]].position);
+    }
+    m_occluderIndices.push_back(slot);
+  }
+}
+
+void OpenGLMeshPrivate::optimize(IndexContainer &indices, const KHalfEdgeMesh &mesh)
+{
+  KHalfEdgeMesh::VertexContainer const &vertices = mesh.vertices();
+  if (indices.empty() || vertices.empty()) return;
+
+  // Note: Overdraw ordering relies on the cache ordering to find clusters.
+  std::vector<uint32_t> scratch(indices.size());
+  if (m_optimizations & OpenGLMesh::OptimizeVertexCache)
+  {
+    Karma::optimizeVertexCache(scratch.data(), indices.data(), indices.size(), vertices.size());
+    indices.swap(scratch);
+    if (m_optimizations & OpenGLMesh::OptimizeOverdraw)
+    {
+      Karma::optimizeOverdraw(scratch.data(), indices.data(), indices.size(), &vertices[0].position, sizeof(KHalfEdgeMesh::Vertex), vertices.size());
+      indices.swap(scratch);
+    }
+  }
+}
+
+void OpenGLMeshPrivate::draw(size_t level)
+{
+  OpenGLMeshLevel const &lod = m_levels[std::min(level, m_levels.size() - 1)];
+  GL::glDrawElements(GL_TRIANGLES, lod.count, static_cast<GLenum>(m_indexType), indexOffset(lod.offset));
+}
+
+const GLvoid *OpenGLMeshPrivate::indexOffset(size_t index) const
+{
+  return reinterpret_cast<const GLvoid*>(m_frame * m_indexShadow.size() + index * OpenGLElementSize(m_indexType));
+}
+
+size_t OpenGLMeshPrivate::drawClusters(const KMatrix4x4 &toWorld, const KFrustum &frustum, const KVector3D &eye)
+{
+  // Note: Assumes uniform scale, which keeps the normal cones valid.
+  float scale = toWorld.mapVector(KVector3D(1.0f, 0.0f, 0.0f)).length();
+  size_t drawn = 0;
+  m_drawCounts.clear();
+  m_drawOffsets.clear();
+  for (KMeshlet const &meshlet : m_meshlets)
+  {
+    if (!frustum.intersects(toWorld * meshlet.center, meshlet.radius * scale)) continue;
+    KVector3D axis = toWorld.mapVector(meshlet.coneAxis) / scale;
+    if (Karma::meshletBackfacing(toWorld * meshlet.coneApex, axis, meshlet.coneCutoff, eye)) continue;
+    ++drawn;
+
+    // Neighboring clusters are neighbors in the index buffer, merge their draws
+    const GLvoid *offset = indexOffset(meshlet.indexOffset);
+    GLsizei count = static_cast<GLsizei>(3 * meshlet.triangleCount);
+    if (!m_drawOffsets.empty() && reinterpret_cast<size_t>(m_drawOffsets.back()) + m_drawCounts.back() * OpenGLElementSize(m_indexType) == reinterpret_cast<size_t>(offset))
+    {
+      m_drawCounts.back() += count;
+    }
+    else
+    {
+      m_drawOffsets.push_back(offset);
+      m_drawCounts.push_back(count);
+    }
+  }
+  if (m_drawCounts.empty()) return 0;
+
+#if defined(QT_OPENGL_ES_3)
+  for (size_t i = 0; i < m_drawCounts.size(); ++i)
+  {
+    GL::glDrawElements(GL_TRIANGLES, m_drawCounts[i], static_cast<GLenum>(m_indexType), m_drawOffsets[i]);
+  }
+#else
+  GL::glMultiDrawElements(GL_TRIANGLES, m_drawCounts.data(), static_cast<GLenum>(m_indexType), m_drawOffsets.data(), static_cast<GLsizei>(m_drawCounts.size()));
+#endif
+  return drawn;
 }
 
 void OpenGLMeshPrivate::vertexAttribPointer(int location, int elements, OpenGLElementType type, bool normalized, int stride, int offset)
@@ -110,6 +700,14 @@ void OpenGLMeshPrivate::vertexAttribPointerDivisor(int location, int elements, O
 {
   vertexAttribPointer(location, elements, type, normalized, stride, offset);
   GL::glVertexAttribDivisor(location, divisor);
+#if defined(QT_OPENGL_ES_3)
+  if (divisor > 0)
+  {
+    if (stride == 0) stride = static_cast<int>(elements * OpenGLElementSize(type));
+    OpenGLInstancedAttribute attribute = { static_cast<GLuint>(GL::getInteger(GL_ARRAY_BUFFER_BINDING)), location, elements, type, normalized, stride, offset };
+    m_instancedAttributes.push_back(attribute);
+  }
+#endif
 }
 
 void OpenGLMeshPrivate::vertexAttribPointerDivisor(int location, int elements, int count, OpenGLElementType type, bool normalized, int stride, int offset, int divisor)
@@ -120,6 +718,21 @@ void OpenGLMeshPrivate::vertexAttribPointerDivisor(int location, int elements, i
   }
 }
 
+#if defined(QT_OPENGL_ES_3)
+// Points the per-instance attributes of the bound vertex array at instance `first`.
+void OpenGLMeshPrivate::rebaseInstances(size_t first)
+{
+  GLint previous = GL::getInteger(GL_ARRAY_BUFFER_BINDING);
+  for (OpenGLInstancedAttribute const &attribute : m_instancedAttributes)
+  {
+    int offset = attribute.offset + static_cast<int>(first) * attribute.stride; // Base instances skip elements, regardless of the divisor
+    GL::glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer);
+    GL::glVertexAttribPointer(attribute.location, attribute.elements, static_cast<GLenum>(attribute.type), attribute.normalized ? GL_TRUE : GL_FALSE, attribute.stride, reinterpret_cast<const GLvoid*>(offset));
+  }
+  GL::glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(previous));
+}
+#endif
+
 ///
 
 OpenGLMesh::OpenGLMesh() :
@@ -146,24 +759,126 @@ void OpenGLMesh::setUsagePattern(OpenGLMesh::UsagePattern pattern)
   p.m_vertexBuffer.setUsagePattern(pattern);
 }
 
-void OpenGLMesh::create(const char *filename)
+void OpenGLMesh::setOptimizations(OpenGLMesh::OptimizationFlags flags)
+{
+  P(OpenGLMeshPrivate);
+  p.m_optimizations = flags;
+}
+
+size_t OpenGLMesh::drawClusters(const KMatrix4x4 &toWorld, const KFrustum &frustum, const KVector3D &eye)
+{
+  P(OpenGLMeshPrivate);
+  bind();
+  size_t drawn = p.drawClusters(toWorld, frustum, eye);
+  release();
+  return drawn;
+}
+
+void OpenGLMesh::setLevelOfDetailErrors(const std::vector<float> &errors)
+{
+  P(OpenGLMeshPrivate);
+  p.m_levelErrors = errors;
+}
+
+void OpenGLMesh::create(const char *filename, VertexFormat format)
 {
   KHalfEdgeMesh mesh;
   mesh.create(filename);
-  create(mesh);
+  create(mesh, format);
+}
+
+void OpenGLMesh::create(const KHalfEdgeMesh &mesh, VertexFormat format)
+{
+  P(OpenGLMeshPrivate);
+  p.create(mesh, format);
 }
 
-void OpenGLMesh::create(const KHalfEdgeMesh &mesh)
+void OpenGLMesh::markVerticesDirty(size_t begin, size_t end)
 {
   P(OpenGLMeshPrivate);
-  p.create(mesh);
+  if (begin < end) p.m_dirtyVertices.push_back(OpenGLMeshRange { begin, end });
+}
+
+void OpenGLMesh::markFacesDirty(size_t begin, size_t end)
+{
+  P(OpenGLMeshPrivate);
+  if (begin < end) p.m_dirtyFaces.push_back(OpenGLMeshRange { begin, end });
+}
+
+void OpenGLMesh::update(const KHalfEdgeMesh &mesh)
+{
+  P(OpenGLMeshPrivate);
+  p.update(mesh);
+}
+
+bool OpenGLMesh::isDynamic() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_dynamic;
+}
+
+void OpenGLMesh::setPositionStream(bool enabled)
+{
+  P(OpenGLMeshPrivate);
+  p.m_positionStream = enabled;
+}
+
+bool OpenGLMesh::hasPositionStream() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_hasPositionStream;
+}
+
+void OpenGLMesh::setOccluder(bool enabled)
+{
+  P(OpenGLMeshPrivate);
+  p.m_occluder = enabled;
+}
+
+bool OpenGLMesh::isOccluder() const
+{
+  P(const OpenGLMeshPrivate);
+  return !p.m_occluderIndices.empty();
+}
+
+const std::vector<KVector3D> &OpenGLMesh::occluderPositions() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_occluderPositions;
+}
+
+const std::vector<uint32_t> &OpenGLMesh::occluderIndices() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_occluderIndices;
+}
+
+void OpenGLMesh::drawDepthOnly(size_t level)
+{
+  P(OpenGLMeshPrivate);
+  if (!p.m_hasPositionStream)
+  {
+    draw(level);
+    return;
+  }
+  p.m_positionArrayObject.bind();
+  p.draw(level);
+  p.m_positionArrayObject.release();
 }
 
 void OpenGLMesh::draw()
 {
   P(OpenGLMeshPrivate);
   bind();
-  GL::glDrawElements(GL_TRIANGLES, p.m_elementCount, GL_UNSIGNED_INT, (const GLvoid*)0);
+  GL::glDrawElements(GL_TRIANGLES, p.m_elementCount, static_cast<GLenum>(p.m_indexType), p.indexOffset(0));
+  release();
+}
+
+void OpenGLMesh::draw(size_t level)
+{
+  P(OpenGLMeshPrivate);
+  bind();
+  p.draw(level);
   release();
 }
 
@@ -179,11 +894,22 @@ void OpenGLMesh::drawInstanced(size_t begin, size_t end)
   if (begin == end)
     return;
 
+  // Note: Offsetting instances requires a base instance, not a base vertex.
   bind();
+  GLenum indexType = static_cast<GLenum>(p.m_indexType);
   if (begin == 0)
-    GL::glDrawElementsInstanced(GL_TRIANGLES, p.m_elementCount, GL_UNSIGNED_INT, (const GLvoid*)0, static_cast<GLsizei>(end));
+    GL::glDrawElementsInstanced(GL_TRIANGLES, p.m_elementCount, indexType, p.indexOffset(0), static_cast<GLsizei>(end));
   else
-    GL::glDrawElementsInstancedBaseVertex(GL_TRIANGLES, p.m_elementCount, GL_UNSIGNED_INT, (const GLvoid*)0, static_cast<int>(end - begin), static_cast<GLsizei>(begin));
+#if defined(QT_OPENGL_ES_3)
+  {
+    // No base instance in ES 3.0, so the instanced attributes start at `begin` for this draw instead.
+    p.rebaseInstances(begin);
+    GL::glDrawElementsInstanced(GL_TRIANGLES, p.m_elementCount, indexType, p.indexOffset(0), static_cast<GLsizei>(end - begin));
+    p.rebaseInstances(0);
+  }
+#else
+    GL::glDrawElementsInstancedBaseInstance(GL_TRIANGLES, p.m_elementCount, indexType, p.indexOffset(0), static_cast<GLsizei>(end - begin), static_cast<GLuint>(begin));
+#endif
   release();
 }
 
@@ -235,3 +961,58 @@ const KAabbBoundingVolume &OpenGLMesh::aabb() const
   P(const OpenGLMeshPrivate);
   return p.m_aabb;
 }
+
+const KVertexCacheStatistics &OpenGLMesh::originalCacheStatistics() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_originalStatistics;
+}
+
+const KVertexCacheStatistics &OpenGLMesh::optimizedCacheStatistics() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_optimizedStatistics;
+}
+
+size_t OpenGLMesh::levelOfDetailCount() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_levels.size();
+}
+
+float OpenGLMesh::levelOfDetailError(size_t level) const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_levels[level].error;
+}
+
+size_t OpenGLMesh::triangleCount(size_t level) const
+{
+  P(const OpenGLMeshPrivate);
+  if (p.m_levels.empty()) return 0;
+  return p.m_levels[std::min(level, p.m_levels.size() - 1)].count / 3;
+}
+
+size_t OpenGLMesh::clusterCount() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_meshlets.size();
+}
+
+OpenGLMesh::VertexFormat OpenGLMesh::vertexFormat() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_vertexFormat;
+}
+
+const KMatrix4x4 &OpenGLMesh::dequantization() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_dequantization;
+}
+
+OpenGLElementType OpenGLMesh::indexType() const
+{
+  P(const OpenGLMeshPrivate);
+  return p.m_indexType;
+}
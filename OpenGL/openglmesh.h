@@ -2,12 +2,17 @@
 #define OPENGLMESH_H OpenGLMesh
 
 #include <cstdint>
+#include <vector>
 #include <KSharedPointer>
 #include <OpenGLBuffer>
 #include <OpenGLElementType>
 
 class KHalfEdgeMesh;
 class KAabbBoundingVolume;
+class KFrustum;
+class KMatrix4x4;
+class KVector3D;
+struct KVertexCacheStatistics;
 
 class OpenGLMeshPrivate;
 class OpenGLMesh
@@ -15,6 +20,20 @@ class OpenGLMesh
 public:
 
   typedef OpenGLBuffer::UsagePattern UsagePattern;
+  enum OptimizationFlag
+  {
+    NoOptimization          = 0x0,
+    OptimizeVertexCache     = 0x1,
+    OptimizeOverdraw        = 0x2,
+    OptimizeVertexFetch     = 0x4,
+    OptimizeAll             = 0x7
+  };
+  typedef int OptimizationFlags;
+  enum VertexFormat
+  {
+    FloatVertexFormat,      // 24 bytes (float3 position, float3 normal)
+    QuantizedVertexFormat   // 10 bytes (unorm16x3 position within the aabb, snorm16x2 octahedral normal)
+  };
 
   // Constructors / Destructor
   OpenGLMesh();
@@ -23,9 +42,24 @@ public:
   // Public Methods
   void bind();
   void setUsagePattern(UsagePattern pattern);
-  void create(const char *filename);
-  void create(const KHalfEdgeMesh &mesh);
+  void setOptimizations(OptimizationFlags flags);
+  void setLevelOfDetailErrors(const std::vector<float> &errors);
+  void setPositionStream(bool enabled); // Position-only buffer for depth passes (static meshes)
+  void setOccluder(bool enabled);       // CPU copy of the coarsest level for occlusion culling (static meshes)
+  void create(const char *filename, VertexFormat format = FloatVertexFormat);
+  void create(const KHalfEdgeMesh &mesh, VertexFormat format = FloatVertexFormat);
+
+  // Dynamic Updates (meshes created with a DynamicDraw or StreamDraw usage pattern)
+  // Ranges are [begin, end) into the mesh's vertices and faces, update() uploads them.
+  void markVerticesDirty(size_t begin, size_t end);
+  void markFacesDirty(size_t begin, size_t end);
+  void update(const KHalfEdgeMesh &mesh);
+  bool isDynamic() const;
+
   void draw();
+  void draw(size_t level);
+  void drawDepthOnly(size_t level = 0);
+  size_t drawClusters(const KMatrix4x4 &toWorld, const KFrustum &frustum, const KVector3D &eye);
   void drawInstanced(size_t begin, size_t end);
   void vertexAttribPointer(int location, int elements, OpenGLElementType type, bool normalized, int stride, int offset);
   void vertexAttribPointer(int location, int elements, int count, OpenGLElementType type, bool normalized, int stride, int offset);
@@ -34,7 +68,26 @@ public:
   void release();
   bool isCreated() const;
   int objectId() const;
+  bool hasPositionStream() const;
   KAabbBoundingVolume const &aabb() const;
+  OpenGLElementType indexType() const;
+  VertexFormat vertexFormat() const;
+  KMatrix4x4 const &dequantization() const;
+  KVertexCacheStatistics const &originalCacheStatistics() const;
+  KVertexCacheStatistics const &optimizedCacheStatistics() const;
+
+  // Levels of Detail (errors are relative to the mesh extents)
+  size_t levelOfDetailCount() const;
+  float levelOfDetailError(size_t level) const;
+  size_t triangleCount(size_t level = 0) const;
+
+  // Occlusion (model space triangles of the coarsest level, empty unless an occluder)
+  bool isOccluder() const;
+  std::vector<KVector3D> const &occluderPositions() const;
+  std::vector<uint32_t> const &occluderIndices() const;
+
+  // Clusters (meshlets of the most detailed level)
+  size_t clusterCount() const;
 
 private:
   KSharedPointer<OpenGLMeshPrivate> m_private;
@@ -121,6 +121,12 @@ void OpenGLScene::renderAllGeometry()
   p.m_instanceManager.renderAll();
 }
 
+void OpenGLScene::renderAllGeometryDepthOnly()
+{
+  P(OpenGLScenePrivate);
+  p.m_instanceManager.renderAllDepthOnly();
+}
+
 void OpenGLScene::renderLights()
 {
   P(OpenGLScenePrivate);
@@ -145,3 +151,15 @@ OpenGLEnvironment *OpenGLScene::environment()
   P(OpenGLScenePrivate);
   return &p.m_environment;
 }
+
+size_t OpenGLScene::visibleInstanceCount() const
+{
+  P(const OpenGLScenePrivate);
+  return p.m_instanceManager.visibleCount();
+}
+
+size_t OpenGLScene::culledInstanceCount() const
+{
+  P(const OpenGLScenePrivate);
+  return p.m_instanceManager.culledCount();
+}
@@ -15,6 +15,7 @@ class OpenGLDirectionLightGroup;
 class OpenGLRectangleLightGroup;
 class OpenGLViewport;
 class OpenGLEnvironment;
+#include <cstddef>
 #include <KUniquePointer>
 
 class OpenGLScenePrivate;
@@ -45,12 +46,15 @@ public:
   OpenGLRectangleLightGroup &rectangleLights();
   void renderGeometry();
   void renderAllGeometry();
+  void renderAllGeometryDepthOnly();
   void renderLights();
   void renderShadowedLights();
   void commit(const OpenGLViewport &view);
 
   // Scene stats
   OpenGLEnvironment *environment();
+  size_t visibleInstanceCount() const;
+  size_t culledInstanceCount() const;
 
 private:
   KUniquePointer<OpenGLScenePrivate> m_private;
@@ -22,6 +22,15 @@ highp vec3 decodeNormal(highp vec2 n)
   return decN.xyz * 2.0 + vec3(0.0, 0.0, -1.0);
 }
 
+highp vec3 decodeOctahedralNormal(highp vec2 e)
+{
+  highp vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  highp float t = max(-n.z, 0.0);
+  n.x += (n.x >= 0.0) ? -t : t;
+  n.y += (n.y >= 0.0) ? -t : t;
+  return normalize(n);
+}
+
 highp float encodeSpecularColor(highp vec3 s)
 {
   return (s.x + s.y + s.z) / 3.0;
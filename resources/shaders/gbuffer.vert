@@ -6,8 +6,9 @@
 
 #include <GlobalBuffer.ubo>
 #include <Object.ubo>
+#include <EncodeDecode.glsl>
 
-// Per-Vertex Attributes
+// Per-Vertex Attributes (normal is octahedral encoded in .xy when Object.MeshFlags.x is set)
 layout(location = 0)  in highp vec3 position;
 layout(location = 1)  in highp vec3 normal;
 
@@ -21,7 +22,8 @@ void main()
   // Calculations
   highp vec4 currViewPos = Object.CurrentModelToView  * vec4(position, 1.0);
   highp vec4 prevViewPos = Object.PreviousModelToView * vec4(position, 1.0);
-  highp vec4 viewNormal  = Object.NormalTransform     * vec4(normal  , 1.0);
+  highp vec3 meshNormal  = (Object.MeshFlags.x != 0u) ? decodeOctahedralNormal(normal.xy) : normal;
+  highp vec4 viewNormal  = Object.NormalTransform     * vec4(meshNormal, 1.0);
 
   // Outputs
   vViewNormal       = viewNormal.xyz;